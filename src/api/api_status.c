@@ -26,6 +26,8 @@
 #include "api.h"
 #include "tcp.h"
 #include "input.h"
+#include "mempool.h"
+#include "descrambler.h"
 
 static int
 api_status_inputs
@@ -90,12 +92,40 @@ api_status_connections
   return 0;
 }
 
+static int
+api_status_memory
+  ( void *opaque, const char *op, htsmsg_t *args, htsmsg_t **resp )
+{
+  htsmsg_t *l = mempool_stats();
+  htsmsg_field_t *f;
+  int c = 0;
+
+  HTSMSG_FOREACH(f, l)
+    c++;
+
+  *resp = htsmsg_create_map();
+  htsmsg_add_msg(*resp, "entries", l);
+  htsmsg_add_u32(*resp, "totalCount", c);
+
+  return 0;
+}
+
+static int
+api_status_descrambler
+  ( void *opaque, const char *op, htsmsg_t *args, htsmsg_t **resp )
+{
+  *resp = descrambler_status();
+  return 0;
+}
+
 void api_status_init ( void )
 {
   static api_hook_t ah[] = {
     { "status/connections",   ACCESS_ADMIN, api_status_connections, NULL },
     { "status/subscriptions", ACCESS_ADMIN, api_status_subscriptions, NULL },
     { "status/inputs",        ACCESS_ADMIN, api_status_inputs, NULL },
+    { "status/memory",        ACCESS_ADMIN, api_status_memory, NULL },
+    { "status/descrambler",   ACCESS_ADMIN, api_status_descrambler, NULL },
     { NULL },
   };
 
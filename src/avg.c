@@ -16,14 +16,17 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include "avg.h"
-#include <stdlib.h>
+#include <string.h>
+
+#include "tvheadend.h"
+#include "atomic.h"
 
 void
 avgstat_init(avgstat_t *as, int depth)
 {
-  TAILQ_INIT(&as->as_queue);
-  pthread_mutex_init(&as->as_mutex, NULL);
+  memset(as->as_ring, 0, sizeof(as->as_ring));
+  if(depth >= AVGSTAT_SLOTS)
+    depth = AVGSTAT_SLOTS - 1;
   as->as_depth = depth;
 }
 
@@ -31,82 +34,67 @@ avgstat_init(avgstat_t *as, int depth)
 void
 avgstat_flush(avgstat_t *as)
 {
-  avgstat_entry_t *ase;
+  int i;
 
-  while((ase = TAILQ_FIRST(&as->as_queue)) != NULL) {
-    TAILQ_REMOVE(&as->as_queue, ase, ase_link);
-    free(ase);
+  for(i = 0; i < AVGSTAT_SLOTS; i++) {
+    atomic_exchange(&as->as_ring[i].ase_count, 0);
+    atomic_exchange(&as->as_ring[i].ase_clock, 0);
   }
 }
 
 
-static void
-avgstat_expire(avgstat_t *as, int now)
+void
+avgstat_add(avgstat_t *as, int count, time_t now)
 {
-  avgstat_entry_t *ase;
-
-  while(1) {
-    ase = TAILQ_LAST(&as->as_queue, avgstat_entry_queue);
-    if(ase == NULL || ase->ase_clock > now - as->as_depth) 
-      break;
-    TAILQ_REMOVE(&as->as_queue, ase, ase_link);
-    free(ase);
+  avgstat_entry_t *ase = &as->as_ring[now & (AVGSTAT_SLOTS - 1)];
+  int clk = ase->ase_clock;
+
+  /* New second, whoever moves the clock on resets the count
+   *
+   * Note: an add racing with the reset may be lost, it's only stats
+   */
+  if(clk != now &&
+     __sync_bool_compare_and_swap(&ase->ase_clock, clk, (int)now)) {
+    atomic_exchange(&ase->ase_count, count);
+    return;
   }
+
+  atomic_add(&ase->ase_count, count);
 }
 
 
-void
-avgstat_add(avgstat_t *as, int count, time_t now)
+/*
+ * Sum of the buckets for the seconds now - depth ... now
+ */
+static unsigned int
+avgstat_sum(avgstat_t *as, int depth, time_t now)
 {
   avgstat_entry_t *ase;
+  int i, clk, r = 0;
 
-  pthread_mutex_lock(&as->as_mutex);
-  ase = TAILQ_FIRST(&as->as_queue);
-  if(ase != NULL && ase->ase_clock == now) {
-    ase->ase_count += count;
-  } else {
-    ase = malloc(sizeof(avgstat_entry_t));
-    TAILQ_INSERT_HEAD(&as->as_queue, ase, ase_link);
-    ase->ase_clock = now;
-    ase->ase_count = count;
-  }
+  if(depth >= AVGSTAT_SLOTS)
+    depth = AVGSTAT_SLOTS - 1;
 
-  avgstat_expire(as, now);
-  pthread_mutex_unlock(&as->as_mutex);
+  for(i = 0; i <= depth; i++) {
+    ase = &as->as_ring[(now - i) & (AVGSTAT_SLOTS - 1)];
+    clk = ase->ase_clock;
+    if(clk == now - i)
+      r += ase->ase_count;
+  }
+  return r;
 }
 
 
 unsigned int
 avgstat_read_and_expire(avgstat_t *as, time_t now)
 {
-  avgstat_entry_t *ase;
-  int r = 0;
-
-  pthread_mutex_lock(&as->as_mutex);
-
-  avgstat_expire(as, now);
-
-  TAILQ_FOREACH(ase, &as->as_queue, ase_link)
-    r += ase->ase_count;
-
-  pthread_mutex_unlock(&as->as_mutex);
-  return r;
+  if(as->as_depth <= 0)
+    return 0;
+  return avgstat_sum(as, as->as_depth - 1, now);
 }
 
 unsigned int
 avgstat_read(avgstat_t *as, int depth, time_t now)
 {
-  avgstat_entry_t *ase;
-  int r = 0;
-
-  pthread_mutex_lock(&as->as_mutex);
-
-  TAILQ_FOREACH(ase, &as->as_queue, ase_link) {
-    if(ase->ase_clock < now - depth)
-      break;
-    r += ase->ase_count;
-  }
-  pthread_mutex_unlock(&as->as_mutex);
-  return r;
+  return avgstat_sum(as, depth, now);
 }
-
@@ -19,27 +19,27 @@
 #ifndef AVG_H
 #define AVG_H
 
-#include <pthread.h>
-#include "queue.h"
+#include <time.h>
 
 /*
- * avg stat queue
+ * avg stat ring
+ *
+ * One bucket per second, indexed by (clock % AVGSTAT_SLOTS). Buckets are
+ * updated using atomic ops only, so no locking is required.
  */
 
-TAILQ_HEAD(avgstat_entry_queue, avgstat_entry);
+#define AVGSTAT_SLOTS 16  /* must be a power of 2 and > max depth */
+
+typedef struct avgstat_entry {
+  volatile int ase_clock;
+  volatile int ase_count;
+} avgstat_entry_t;
 
 typedef struct avgstat {
-  pthread_mutex_t as_mutex;
-  struct avgstat_entry_queue as_queue;
+  avgstat_entry_t as_ring[AVGSTAT_SLOTS];
   int as_depth;  /* in seconds */
 } avgstat_t;
 
-typedef struct avgstat_entry {
-  TAILQ_ENTRY(avgstat_entry) ase_link;
-  int ase_clock;
-  int ase_count;
-} avgstat_entry_t;
-
 void avgstat_init(avgstat_t *as, int maxdepth);
 void avgstat_add(avgstat_t *as, int count, time_t now);
 void avgstat_flush(avgstat_t *as);
@@ -22,9 +22,11 @@
 #include <stdint.h>
 
 #include "queue.h"
+#include "htsmsg.h"
 
 struct service;
 struct elementary_stream;
+struct tvhcsa;
 
 /**
  * Descrambler superclass
@@ -43,6 +45,8 @@ typedef struct th_descrambler {
 
   void (*td_stop)(struct th_descrambler *d);
 
+  struct tvhcsa *td_csa;  /* for statistics */
+
 } th_descrambler_t;
 
 
@@ -76,8 +80,30 @@ typedef enum {
 
 LIST_HEAD(caid_list, caid);
 
+/**
+ * ECM cache, shared by all clients (filled by the cwc servers, capmt
+ * only looks keys up as oscam's replies can't be tied to an ECM)
+ *
+ * Keyed by CAID/provider/ECM CRC, so services (or tuners) carrying the
+ * same ECM need only one card server request per crypto period
+ */
+typedef enum {
+  DESCRAMBLER_ECM_MISS,      /* unknown */
+  DESCRAMBLER_ECM_PENDING,   /* request in progress (by another client) */
+  DESCRAMBLER_ECM_RESOLVED   /* control words returned in cw */
+} descrambler_ecm_state_t;
+
+descrambler_ecm_state_t descrambler_ecm_lookup
+  ( uint16_t caid, uint32_t providerid, const uint8_t *ecm, int len,
+    uint8_t *cw, int request );
+void descrambler_ecm_resolve
+  ( uint16_t caid, uint32_t providerid, const uint8_t *ecm, int len,
+    const uint8_t *cw );
+
 void descrambler_init          ( void );
 void descrambler_service_start ( struct service *t );
+void descrambler_service_status( struct service *t, htsmsg_t *m );
+htsmsg_t *descrambler_status   ( void );
 const char *descrambler_caid2name(uint16_t caid);
 uint16_t descrambler_name2caid(const char *str);
 card_type_t detect_card_type(const uint16_t caid);
@@ -743,6 +743,7 @@ capmt_table_input(struct th_descrambler *td, struct service *s,
   mpegts_service_t *t = (mpegts_service_t*)s;
   linuxdvb_frontend_t *lfe;
   int total_caids = 0, current_caid = 0;
+  uint8_t cw[16], invalid[8] = { 0 };
 
   /* Validate */
   if (!idnode_is_instance(&s->s_id, &mpegts_service_class))
@@ -811,6 +812,22 @@ capmt_table_input(struct th_descrambler *td, struct service *s,
           memcpy(cce->cce_ecm, data, len);
           cce->cce_ecmsize = len;
 
+          /* key already known (from another client, oscam replies can't
+             be matched to an ECM so they're not cached) */
+          if (descrambler_ecm_lookup(caid, cce->cce_providerid, data, len,
+                                     cw, 0) == DESCRAMBLER_ECM_RESOLVED) {
+            if (memcmp(cw, invalid, 8))
+              tvhcsa_set_key_even(&ct->ct_csa, cw);
+            if (memcmp(cw + 8, invalid, 8))
+              tvhcsa_set_key_odd(&ct->ct_csa, cw + 8);
+            if (ct->ct_keystate != CT_RESOLVED)
+              tvhlog(LOG_DEBUG, "capmt",
+                     "Obtained key for service \"%s\" from cache",
+                     t->s_dvb_svcname);
+            ct->ct_keystate = CT_RESOLVED;
+            break;
+          }
+
           if (capmt->capmt_oscam == 2)
             capmt_enumerate_services(capmt, st->es_pid, 0);
           else
@@ -1058,7 +1075,7 @@ capmt_service_start(service_t *s)
 
     /* create new capmt service */
     ct              = calloc(1, sizeof(capmt_service_t));
-    tvhcsa_init(&ct->ct_csa);
+    tvhcsa_init(&ct->ct_csa, t);
     ct->ct_capmt    = capmt;
     ct->ct_service  = t;
     ct->ct_seq      = capmt->capmt_seq++;
@@ -1089,6 +1106,7 @@ capmt_service_start(service_t *s)
     td->td_stop       = capmt_service_destroy;
     td->td_table      = capmt_table_input;
     td->td_descramble = capmt_descramble;
+    td->td_csa        = &ct->ct_csa;
     LIST_INSERT_HEAD(&t->s_descramblers, td, td_service_link);
 
     LIST_INSERT_HEAD(&capmt->capmt_services, ct, ct_link);
@@ -99,7 +99,10 @@ typedef struct ecm_section {
   uint16_t es_seq;
   char es_nok;
   char es_pending;
+  char es_waiting;  // request sent by someone else (ECM cache)
   int64_t es_time;  // time request was sent
+  uint16_t es_caid;
+  uint32_t es_providerid;
   size_t es_ecmsize;
   uint8_t es_ecm[4070];
 
@@ -825,6 +828,54 @@ forbid:
 }
 
 
+/**
+ * Pass a reply on to sections (of any server) waiting for the same ECM
+ *
+ * Sections of the replying service are skipped, handling their reply
+ * could free the ecm pids (and es) still in use by the caller. They
+ * get the key from the cache when the ECM is repeated.
+ *
+ * cwc_mutex is held, the stream mutex of each waiting service is taken
+ * here (cwc_table_input() changes the sections with it held)
+ */
+static void
+cwc_ecm_waiters(cwc_service_t *from, ecm_section_t *es,
+                uint8_t *msg, int len, int seq)
+{
+  cwc_t *cwc;
+  cwc_service_t *ct;
+  mpegts_service_t *t;
+  ecm_pid_t *ep;
+  ecm_section_t *es2;
+  int i;
+
+  TAILQ_FOREACH(cwc, &cwcs, cwc_link) {
+    LIST_FOREACH(ct, &cwc->cwc_services, cs_link) {
+      if(ct == from)
+        continue;
+      t = ct->cs_service;
+      pthread_mutex_lock(&t->s_stream_mutex);
+      LIST_FOREACH(ep, &ct->cs_pids, ep_link) {
+        for(i = 0; i <= ep->ep_last_section; i++) {
+          es2 = ep->ep_sections[i];
+          if(es2 == NULL || es2 == es || !es2->es_waiting)
+            continue;
+          if(es2->es_caid != es->es_caid ||
+             es2->es_providerid != es->es_providerid ||
+             es2->es_ecmsize != es->es_ecmsize ||
+             memcmp(es2->es_ecm, es->es_ecm, es->es_ecmsize))
+            continue;
+          es2->es_waiting = 0;
+          handle_ecm_reply(ct, es2, msg, len, seq);
+          goto next; /* ecm pids may have been removed */
+        }
+      }
+next:
+      pthread_mutex_unlock(&t->s_stream_mutex);
+    }
+  }
+}
+
 /**
  * Handle running reply
  * cwc_mutex is held
@@ -851,7 +902,12 @@ cwc_running_reply(cwc_t *cwc, uint8_t msgtype, uint8_t *msg, int len)
           for(i = 0; i <= ep->ep_last_section; i++) {
             es = ep->ep_sections[i];
             if(es != NULL) {
-              if(es->es_seq == seq && es->es_pending) {
+              if(es->es_seq == seq && es->es_pending && !es->es_waiting) {
+                descrambler_ecm_resolve(es->es_caid, es->es_providerid,
+                                        es->es_ecm, es->es_ecmsize,
+                                        len < 19 ? NULL : msg + 3);
+                if(len >= 19)
+                  cwc_ecm_waiters(ct, es, msg, len, seq);
                 handle_ecm_reply(ct, es, msg, len, seq);
                 return 0;
               }
@@ -1593,6 +1649,50 @@ cwc_emm_viaccess(cwc_t *cwc, struct cs_card_data *pcard, uint8_t *data, int mlen
     }
 }
 
+/**
+ * Remember the ECM being resolved for a section
+ */
+static void
+cwc_ecm_set(ecm_section_t *es, int channel, int section, caid_t *c,
+            const uint8_t *data, int len)
+{
+  es->es_channel    = channel;
+  es->es_section    = section;
+  es->es_pending    = 1;
+  es->es_waiting    = 0;
+  es->es_caid       = c->caid;
+  es->es_providerid = c->providerid;
+  es->es_time       = getmonoclock();
+  memcpy(es->es_ecm, data, len);
+  es->es_ecmsize    = len;
+}
+
+/**
+ * ECM answered from the cache, handled as if the server replied
+ *
+ * t->s_stream_mutex is held, cwc_mutex is only tried (it's taken before
+ * the stream mutex elsewhere), returns -1 if it's busy and the ECM
+ * should be sent to the server instead
+ */
+static int
+cwc_ecm_cached(cwc_service_t *ct, ecm_section_t *es, int channel,
+               int section, caid_t *c, const uint8_t *data, int len,
+               const uint8_t *cw)
+{
+  uint8_t msg[19];
+
+  if(pthread_mutex_trylock(&cwc_mutex))
+    return -1;
+  cwc_ecm_set(es, channel, section, c, data, len);
+  tvhlog(LOG_DEBUG, "cwc", "ECM (PID %d) section=%d for service \"%s\" "
+         "resolved from cache", channel, section, ct->cs_service->s_dvb_svcname);
+  memset(msg, 0, 3);
+  memcpy(msg + 3, cw, 16);
+  handle_ecm_reply(ct, es, msg, sizeof(msg), es->es_seq);
+  pthread_mutex_unlock(&cwc_mutex);
+  return 0;
+}
+
 /**
  * t->s_streaming_mutex is held
  */
@@ -1610,6 +1710,7 @@ cwc_table_input(struct th_descrambler *td, service_t *s,
   ecm_section_t *es;
   char chaninfo[32];
   caid_t *c;
+  uint8_t cw[16];
 
   if (ct->cs_keystate == CS_IDLE)
     return;
@@ -1702,27 +1803,45 @@ cwc_table_input(struct th_descrambler *td, service_t *s,
       if (es->es_nok > 2)
         break; /* too many NOK responses in a row */
       
-      if(es->es_ecmsize == len && !memcmp(es->es_ecm, data, len))
+      if(es->es_ecmsize == len && !memcmp(es->es_ecm, data, len) &&
+         !es->es_waiting)
         break; /* key already sent */
       
-      if(cwc->cwc_fd == -1) {
-        // New key, but we are not connected (anymore), can not descramble
-        ct->cs_keystate = CS_UNKNOWN;
-        break;
-      }
-      es->es_channel = channel;
-      es->es_section = section;
-      es->es_pending = 1;
-      
-      memcpy(es->es_ecm, data, len);
-      es->es_ecmsize = len;
-      
-      
       if(ct->cs_channel >= 0 && channel != -1 &&
          ct->cs_channel != channel) {
         tvhlog(LOG_DEBUG, "cwc", "Filtering ECM (PID %d)", channel);
         return;
       }
+
+      /* Already known (or being requested) by another service/server */
+      switch(descrambler_ecm_lookup(c->caid, c->providerid, data, len, cw,
+                                    cwc->cwc_fd != -1)) {
+        case DESCRAMBLER_ECM_RESOLVED:
+          if(!cwc_ecm_cached(ct, es, channel, section, c, data, len, cw))
+            return;
+          break;
+        case DESCRAMBLER_ECM_PENDING:
+          if(!es->es_waiting || es->es_ecmsize != len ||
+             memcmp(es->es_ecm, data, len)) {
+            tvhlog(LOG_DEBUG, "cwc",
+                   "Waiting for ECM%s section=%d/%d, for service \"%s\"",
+                   chaninfo, section, ep->ep_last_section, t->s_dvb_svcname);
+            cwc_ecm_set(es, channel, section, c, data, len);
+            es->es_waiting = 1;
+          }
+          return;
+        default:
+          break;
+      }
+
+      if(cwc->cwc_fd == -1) {
+        // New key, but we are not connected (anymore), can not descramble
+        ct->cs_keystate = CS_UNKNOWN;
+        es->es_waiting  = 0;
+        es->es_ecmsize  = 0;
+        break;
+      }
+      cwc_ecm_set(es, channel, section, c, data, len);
       
       es->es_seq = cwc_send_msg(cwc, data, len, sid, 1, c->caid, c->providerid);
       
@@ -2026,7 +2145,7 @@ cwc_service_start(service_t *t)
     if (ct) continue;
 
     ct                   = calloc(1, sizeof(cwc_service_t));
-    tvhcsa_init(&ct->cs_csa);
+    tvhcsa_init(&ct->cs_csa, (mpegts_service_t*)t);
     ct->cs_cwc           = cwc;
     ct->cs_service       = (mpegts_service_t*)t;
     ct->cs_channel       = -1;
@@ -2036,6 +2155,7 @@ cwc_service_start(service_t *t)
     td->td_stop       = cwc_service_destroy;
     td->td_table      = cwc_table_input;
     td->td_descramble = cwc_descramble;
+    td->td_csa        = &ct->cs_csa;
     LIST_INSERT_HEAD(&t->s_descramblers, td, td_service_link);
 
     LIST_INSERT_HEAD(&cwc->cwc_services, ct, cs_link);
@@ -20,6 +20,7 @@
 #include "cwc.h"
 #include "capmt.h"
 #include "ffdecsa/FFdecsa.h"
+#include "tvhcsa.h"
 #include "service.h"
 
 static struct strtab caidnametab[] = {
@@ -103,15 +104,150 @@ static struct strtab caidnametab[] = {
   { "Verimatrix",       0x5601 },
 };
 
+/**
+ * ECM cache
+ *
+ * A direct mapped table, a colliding ECM simply replaces the old entry.
+ * Pending entries expire so a lost request is retried by someone else.
+ * The ECM itself is kept, the CRC only selects the slot and rejects
+ * most mismatches quickly.
+ */
+#define DESCRAMBLER_ECM_CACHE_SIZE   512
+#define DESCRAMBLER_ECM_PENDING_TIME (5  * 1000000LL)
+#define DESCRAMBLER_ECM_RESOLVE_TIME (20 * 1000000LL)
+
+typedef struct descrambler_ecm {
+  descrambler_ecm_state_t de_state;
+  uint16_t de_caid;
+  uint32_t de_providerid;
+  uint32_t de_crc;
+  int      de_len;
+  int      de_size;
+  uint8_t *de_ecm;
+  int64_t  de_time;
+  uint8_t  de_cw[16];
+} descrambler_ecm_t;
+
+static pthread_mutex_t   descrambler_ecm_mutex;
+static descrambler_ecm_t descrambler_ecms[DESCRAMBLER_ECM_CACHE_SIZE];
+static struct {
+  uint32_t hits, coalesced, misses;
+} descrambler_ecm_stats;
+
+static descrambler_ecm_t *
+descrambler_ecm_find
+  ( uint16_t caid, uint32_t providerid, const uint8_t *ecm, int len,
+    uint32_t *crc )
+{
+  *crc = tvh_crc32(ecm, len, 0xffffffff);
+  return &descrambler_ecms[(*crc ^ caid ^ providerid) &
+                           (DESCRAMBLER_ECM_CACHE_SIZE - 1)];
+}
+
+static int
+descrambler_ecm_match
+  ( descrambler_ecm_t *de, uint16_t caid, uint32_t providerid,
+    const uint8_t *ecm, int len, uint32_t crc )
+{
+  return de->de_caid == caid && de->de_providerid == providerid &&
+         de->de_crc == crc && de->de_len == len &&
+         !memcmp(de->de_ecm, ecm, len);
+}
+
+static void
+descrambler_ecm_set
+  ( descrambler_ecm_t *de, descrambler_ecm_state_t state, uint16_t caid,
+    uint32_t providerid, const uint8_t *ecm, int len, uint32_t crc,
+    int64_t now )
+{
+  if (de->de_size < len) {
+    free(de->de_ecm);
+    de->de_ecm  = malloc(len);
+    de->de_size = len;
+  }
+  memcpy(de->de_ecm, ecm, len);
+  de->de_state      = state;
+  de->de_caid       = caid;
+  de->de_providerid = providerid;
+  de->de_crc        = crc;
+  de->de_len        = len;
+  de->de_time       = now;
+}
+
+/**
+ * Find an ECM, if request is set and it's unknown it's marked as pending
+ * (the caller is expected to send it and call descrambler_ecm_resolve())
+ */
+descrambler_ecm_state_t
+descrambler_ecm_lookup
+  ( uint16_t caid, uint32_t providerid, const uint8_t *ecm, int len,
+    uint8_t *cw, int request )
+{
+  descrambler_ecm_t *de;
+  descrambler_ecm_state_t r = DESCRAMBLER_ECM_MISS;
+  int64_t now = getmonoclock();
+  uint32_t crc;
+
+  pthread_mutex_lock(&descrambler_ecm_mutex);
+  de = descrambler_ecm_find(caid, providerid, ecm, len, &crc);
+  if (de->de_state != DESCRAMBLER_ECM_MISS &&
+      descrambler_ecm_match(de, caid, providerid, ecm, len, crc)) {
+    if (de->de_state == DESCRAMBLER_ECM_PENDING &&
+        now - de->de_time < DESCRAMBLER_ECM_PENDING_TIME) {
+      descrambler_ecm_stats.coalesced++;
+      r = DESCRAMBLER_ECM_PENDING;
+    } else if (de->de_state == DESCRAMBLER_ECM_RESOLVED &&
+               now - de->de_time < DESCRAMBLER_ECM_RESOLVE_TIME) {
+      descrambler_ecm_stats.hits++;
+      memcpy(cw, de->de_cw, sizeof(de->de_cw));
+      r = DESCRAMBLER_ECM_RESOLVED;
+    }
+  }
+  if (r == DESCRAMBLER_ECM_MISS) {
+    descrambler_ecm_stats.misses++;
+    if (request)
+      descrambler_ecm_set(de, DESCRAMBLER_ECM_PENDING, caid, providerid,
+                          ecm, len, crc, now);
+  }
+  pthread_mutex_unlock(&descrambler_ecm_mutex);
+  return r;
+}
+
+/**
+ * Store the control words for an ECM, cw is NULL if the request failed
+ * (the entry is removed, so other clients can try their luck)
+ */
+void
+descrambler_ecm_resolve
+  ( uint16_t caid, uint32_t providerid, const uint8_t *ecm, int len,
+    const uint8_t *cw )
+{
+  descrambler_ecm_t *de;
+  uint32_t crc;
+
+  pthread_mutex_lock(&descrambler_ecm_mutex);
+  de = descrambler_ecm_find(caid, providerid, ecm, len, &crc);
+  if (cw) {
+    descrambler_ecm_set(de, DESCRAMBLER_ECM_RESOLVED, caid, providerid,
+                        ecm, len, crc, getmonoclock());
+    memcpy(de->de_cw, cw, sizeof(de->de_cw));
+  } else if (descrambler_ecm_match(de, caid, providerid, ecm, len, crc)) {
+    de->de_state      = DESCRAMBLER_ECM_MISS;
+  }
+  pthread_mutex_unlock(&descrambler_ecm_mutex);
+}
+
 void
 descrambler_init ( void )
 {
+  pthread_mutex_init(&descrambler_ecm_mutex, NULL);
 #if ENABLE_CWC
   cwc_init();
   capmt_init();
 #if !ENABLE_DVBCSA
   ffdecsa_init();
 #endif
+  tvhcsa_pool_init();
 #endif
 }
 
@@ -124,6 +260,57 @@ descrambler_service_start ( service_t *t )
 #endif
 }
 
+/**
+ * Add descrambling statistics (of the active descrambler) to a message
+ */
+void
+descrambler_service_status ( service_t *t, htsmsg_t *m )
+{
+#if ENABLE_CWC
+  th_descrambler_t *td;
+  uint32_t rate, latency, latency_max, cluster;
+  const char *policy;
+
+  pthread_mutex_lock(&t->s_stream_mutex);
+  LIST_FOREACH(td, &t->s_descramblers, td_service_link) {
+    if (!td->td_csa)
+      continue;
+    tvhcsa_get_stats(td->td_csa, &rate, &latency, &latency_max,
+                     &cluster, &policy);
+    if (!rate)
+      continue;
+    htsmsg_add_u32(m, "descramble", rate);
+    htsmsg_add_u32(m, "descramble_latency", latency);
+    htsmsg_add_u32(m, "descramble_latency_max", latency_max);
+    htsmsg_add_u32(m, "descramble_cluster", cluster);
+    htsmsg_add_str(m, "descramble_policy", policy);
+    break;
+  }
+  pthread_mutex_unlock(&t->s_stream_mutex);
+#endif
+}
+
+/**
+ * CSA implementation in use, ECM cache statistics
+ */
+htsmsg_t *
+descrambler_status ( void )
+{
+  htsmsg_t *m;
+#if ENABLE_CWC && !ENABLE_DVBCSA
+  m = ffdecsa_status();
+#else
+  m = htsmsg_create_map();
+  htsmsg_add_str(m, "backend", ENABLE_CWC ? "libdvbcsa" : "");
+#endif
+  pthread_mutex_lock(&descrambler_ecm_mutex);
+  htsmsg_add_u32(m, "ecm_hits",      descrambler_ecm_stats.hits);
+  htsmsg_add_u32(m, "ecm_coalesced", descrambler_ecm_stats.coalesced);
+  htsmsg_add_u32(m, "ecm_misses",    descrambler_ecm_stats.misses);
+  pthread_mutex_unlock(&descrambler_ecm_mutex);
+  return m;
+}
+
 // TODO: might actually put const char* into caid_t
 const char *
 descrambler_caid2name(uint16_t caid)
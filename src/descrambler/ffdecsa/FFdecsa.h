@@ -61,4 +61,7 @@ int decrypt_packets(void *keys, unsigned char **cluster);
 
 void ffdecsa_init(void);
 
+struct htsmsg;
+struct htsmsg *ffdecsa_status(void);
+
 #endif
@@ -67,8 +67,37 @@ MAKEFUNCS(64mmx);
 MAKEFUNCS(128sse2);
 #endif
 
+#ifdef CONFIG_AVX2
+MAKEFUNCS(256avx2);
+#endif
+
 static csafuncs_t current;
 
+/*
+ * Backends (supported by the CPU), with measured speed
+ */
+typedef struct csabackend {
+  const char *name;
+  csafuncs_t *funcs;
+  int         supported;
+  uint32_t    pps;        /* packets per second */
+} csabackend_t;
+
+static csabackend_t backends[] = {
+  { "32bit",        &funcs_32int,   1 },
+#ifdef CONFIG_MMX
+  { "MMX 64bit",    &funcs_64mmx,   0 },
+#endif
+#ifdef CONFIG_SSE2
+  { "SSE2 128bit",  &funcs_128sse2, 0 },
+#endif
+#ifdef CONFIG_AVX2
+  { "AVX2 256bit",  &funcs_256avx2, 0 },
+#endif
+};
+
+static csabackend_t *backend_current;
+
 
 
 
@@ -128,16 +157,24 @@ typedef int x86_reg;
 
 
 
-void
-ffdecsa_init(void)
+static csabackend_t *
+ffdecsa_backend_find(csafuncs_t *f)
 {
-  current = funcs_32int;
-
+  int i;
+  for (i = 0; i < ARRAY_SIZE(backends); i++)
+    if (backends[i].funcs == f)
+      return &backends[i];
+  return NULL;
+}
 
+static void
+ffdecsa_cpu_detect(void)
+{
 #if defined(__i386__) || defined(__x86_64__)
 
   int eax, ebx, ecx, edx;
   int max_std_level, std_caps=0;
+  csabackend_t *b;
   
 #if defined(__i386__)
 
@@ -171,27 +208,121 @@ ffdecsa_init(void)
       cpuid(1, eax, ebx, ecx, std_caps);
 
 #ifdef CONFIG_SSE2
-      if (std_caps & (1<<26)) {
-	current = funcs_128sse2;
-	tvhlog(LOG_INFO, "CSA", "Using SSE2 128bit parallel descrambling");
-	return;
-      }
+      if ((std_caps & (1<<26)) && (b = ffdecsa_backend_find(&funcs_128sse2)))
+        b->supported = 1;
 #endif
 
 #ifdef CONFIG_MMX
-      if (std_caps & (1<<23)) {
-	current = funcs_64mmx;
-	tvhlog(LOG_INFO, "CSA", "Using MMX 64bit parallel descrambling");
-	return;
-      }
+      if ((std_caps & (1<<23)) && (b = ffdecsa_backend_find(&funcs_64mmx)))
+        b->supported = 1;
 #endif
     }
 #if defined(__i386__)
   }
 #endif
+
+#ifdef CONFIG_AVX2
+  /* Note: this also checks the OS saves the AVX state */
+  if (__builtin_cpu_supports("avx2") &&
+      (b = ffdecsa_backend_find(&funcs_256avx2)))
+    b->supported = 1;
+#endif
 #endif
+}
+
+/*
+ * Measure backend speed (packets per second) on synthetic clusters
+ */
+#define FFDECSA_BENCH_USEC 50000
+
+static uint32_t
+ffdecsa_benchmark(csafuncs_t *f)
+{
+  static const unsigned char cw[8] = { 0x11, 0x22, 0x33, 0x66,
+                                       0x44, 0x55, 0x66, 0xff };
+  int i, n = f->get_suggested_cluster_size();
+  unsigned char *buf, *vec[3];
+  int64_t start, now;
+  uint64_t pkts = 0;
+  void *keys;
+
+  buf  = malloc(n * 188);
+  keys = f->get_key_struct();
+  f->set_even_control_word(keys, cw);
+  f->set_odd_control_word(keys, cw);
+  for (i = 0; i < n * 188; i++)
+    buf[i] = i * 7;
+
+  start = now = getmonoclock();
+  while (now - start < FFDECSA_BENCH_USEC) {
+    for (i = 0; i < n; i++) {
+      buf[i * 188 + 0] = 0x47;
+      buf[i * 188 + 3] = 0x90; /* scrambled (even), payload only */
+    }
+    vec[0] = buf;
+    vec[1] = buf + n * 188;
+    vec[2] = NULL;
+    while (f->decrypt_packets(keys, vec) > 0 && vec[0]);
+    pkts += n;
+    now = getmonoclock();
+  }
 
-  tvhlog(LOG_INFO, "CSA", "Using 32bit parallel descrambling");
+  f->free_key_struct(keys);
+  free(buf);
+  return now > start ? (pkts * 1000000) / (now - start) : 0;
+}
+
+/*
+ * Pick the fastest backend the CPU supports
+ */
+void
+ffdecsa_init(void)
+{
+  int i;
+  csabackend_t *b;
+
+  ffdecsa_cpu_detect();
+
+  backend_current = &backends[0];
+  for (i = 0; i < ARRAY_SIZE(backends); i++) {
+    b = &backends[i];
+    if (!b->supported)
+      continue;
+    b->pps = ffdecsa_benchmark(b->funcs);
+    tvhlog(LOG_DEBUG, "CSA", "%s parallel descrambling: %u packets/s",
+           b->name, b->pps);
+    if (b->pps > backend_current->pps)
+      backend_current = b;
+  }
+
+  current = *backend_current->funcs;
+  tvhlog(LOG_INFO, "CSA", "Using %s parallel descrambling (%u packets/s)",
+         backend_current->name, backend_current->pps);
+}
+
+/*
+ * Status (chosen backend and measured speeds)
+ */
+htsmsg_t *
+ffdecsa_status(void)
+{
+  int i;
+  htsmsg_t *m = htsmsg_create_map(), *l = htsmsg_create_list(), *e;
+
+  htsmsg_add_str(m, "backend", backend_current ? backend_current->name : "");
+  htsmsg_add_u32(m, "parallelism", current.get_internal_parallelism ?
+                                   current.get_internal_parallelism() : 0);
+  htsmsg_add_u32(m, "pps", backend_current ? backend_current->pps : 0);
+  for (i = 0; i < ARRAY_SIZE(backends); i++) {
+    if (!backends[i].supported)
+      continue;
+    e = htsmsg_create_map();
+    htsmsg_add_str(e, "name", backends[i].name);
+    htsmsg_add_u32(e, "pps", backends[i].pps);
+    htsmsg_add_msg(l, NULL, e);
+  }
+  htsmsg_add_msg(m, "backends", l);
+  return m;
 }
 
 
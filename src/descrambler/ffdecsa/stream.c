@@ -432,6 +432,153 @@ static inline void trasp64_128_88cw(unsigned char *data){
   }
 #undef halfrow
 }
+
+//64-256----------------------------------------------------------
+static inline void trasp64_256_88ccw(unsigned char *data){
+/* 64 rows of 256 bits transposition (bytes transp. - 8x8 rotate counterclockwise)*/
+#define qrow ((unsigned long long int *)data)
+  int i,j,k;
+  for(j=0;j<64;j+=64){
+    unsigned long long int t,b;
+    for(i=0;i<32;i++){
+      for(k=0;k<4;k++){
+        t=qrow[4*(j+i)+k];
+        b=qrow[4*(j+32+i)+k];
+        qrow[4*(j+i)+k]   = (t&0x00000000ffffffffULL)      | ((b                      )<<32);
+        qrow[4*(j+32+i)+k]=((t                      )>>32) |  (b&0xffffffff00000000ULL);
+      }
+    }
+  }
+  for(j=0;j<64;j+=32){
+    unsigned long long int t,b;
+    for(i=0;i<16;i++){
+      for(k=0;k<4;k++){
+        t=qrow[4*(j+i)+k];
+        b=qrow[4*(j+16+i)+k];
+        qrow[4*(j+i)+k]   = (t&0x0000ffff0000ffffULL)      | ((b&0x0000ffff0000ffffULL)<<16);
+        qrow[4*(j+16+i)+k]=((t&0xffff0000ffff0000ULL)>>16) |  (b&0xffff0000ffff0000ULL);
+      }
+    }
+  }
+  for(j=0;j<64;j+=16){
+    unsigned long long int t,b;
+    for(i=0;i<8;i++){
+      for(k=0;k<4;k++){
+        t=qrow[4*(j+i)+k];
+        b=qrow[4*(j+8+i)+k];
+        qrow[4*(j+i)+k]   = (t&0x00ff00ff00ff00ffULL)     | ((b&0x00ff00ff00ff00ffULL)<<8);
+        qrow[4*(j+8+i)+k]=((t&0xff00ff00ff00ff00ULL)>>8) |  (b&0xff00ff00ff00ff00ULL);
+      }
+    }
+  }
+  for(j=0;j<64;j+=8){
+    unsigned long long int t,b;
+    for(i=0;i<4;i++){
+      for(k=0;k<4;k++){
+        t=qrow[4*(j+i)+k];
+        b=qrow[4*(j+4+i)+k];
+        qrow[4*(j+i)+k]   =((t&0x0f0f0f0f0f0f0f0fULL)<<4) |  (b&0x0f0f0f0f0f0f0f0fULL);
+        qrow[4*(j+4+i)+k]= (t&0xf0f0f0f0f0f0f0f0ULL)     | ((b&0xf0f0f0f0f0f0f0f0ULL)>>4);
+      }
+    }
+  }
+  for(j=0;j<64;j+=4){
+    unsigned long long int t,b;
+    for(i=0;i<2;i++){
+      for(k=0;k<4;k++){
+        t=qrow[4*(j+i)+k];
+        b=qrow[4*(j+2+i)+k];
+        qrow[4*(j+i)+k]   =((t&0x3333333333333333ULL)<<2) |  (b&0x3333333333333333ULL);
+        qrow[4*(j+2+i)+k]= (t&0xccccccccccccccccULL)     | ((b&0xccccccccccccccccULL)>>2);
+      }
+    }
+  }
+  for(j=0;j<64;j+=2){
+    unsigned long long int t,b;
+    for(i=0;i<1;i++){
+      for(k=0;k<4;k++){
+        t=qrow[4*(j+i)+k];
+        b=qrow[4*(j+1+i)+k];
+        qrow[4*(j+i)+k]   =((t&0x5555555555555555ULL)<<1) |  (b&0x5555555555555555ULL);
+        qrow[4*(j+1+i)+k]= (t&0xaaaaaaaaaaaaaaaaULL)     | ((b&0xaaaaaaaaaaaaaaaaULL)>>1);
+      }
+    }
+  }
+#undef qrow
+}
+
+static inline void trasp64_256_88cw(unsigned char *data){
+/* 64 rows of 256 bits transposition (bytes transp. - 8x8 rotate clockwise)*/
+#define qrow ((unsigned long long int *)data)
+  int i,j,k;
+  for(j=0;j<64;j+=64){
+    unsigned long long int t,b;
+    for(i=0;i<32;i++){
+      for(k=0;k<4;k++){
+        t=qrow[4*(j+i)+k];
+        b=qrow[4*(j+32+i)+k];
+        qrow[4*(j+i)+k]   = (t&0x00000000ffffffffULL)      | ((b                      )<<32);
+        qrow[4*(j+32+i)+k]=((t                      )>>32) |  (b&0xffffffff00000000ULL);
+      }
+    }
+  }
+  for(j=0;j<64;j+=32){
+    unsigned long long int t,b;
+    for(i=0;i<16;i++){
+      for(k=0;k<4;k++){
+        t=qrow[4*(j+i)+k];
+        b=qrow[4*(j+16+i)+k];
+        qrow[4*(j+i)+k]   = (t&0x0000ffff0000ffffULL)      | ((b&0x0000ffff0000ffffULL)<<16);
+        qrow[4*(j+16+i)+k]=((t&0xffff0000ffff0000ULL)>>16) |  (b&0xffff0000ffff0000ULL);
+      }
+    }
+  }
+  for(j=0;j<64;j+=16){
+    unsigned long long int t,b;
+    for(i=0;i<8;i++){
+      for(k=0;k<4;k++){
+        t=qrow[4*(j+i)+k];
+        b=qrow[4*(j+8+i)+k];
+        qrow[4*(j+i)+k]   = (t&0x00ff00ff00ff00ffULL)     | ((b&0x00ff00ff00ff00ffULL)<<8);
+        qrow[4*(j+8+i)+k]=((t&0xff00ff00ff00ff00ULL)>>8) |  (b&0xff00ff00ff00ff00ULL);
+      }
+    }
+  }
+  for(j=0;j<64;j+=8){
+    unsigned long long int t,b;
+    for(i=0;i<4;i++){
+      for(k=0;k<4;k++){
+        t=qrow[4*(j+i)+k];
+        b=qrow[4*(j+4+i)+k];
+        qrow[4*(j+i)+k]   =((t&0xf0f0f0f0f0f0f0f0ULL)>>4) |  (b&0xf0f0f0f0f0f0f0f0ULL);
+        qrow[4*(j+4+i)+k]= (t&0x0f0f0f0f0f0f0f0fULL)     | ((b&0x0f0f0f0f0f0f0f0fULL)<<4);
+      }
+    }
+  }
+  for(j=0;j<64;j+=4){
+    unsigned long long int t,b;
+    for(i=0;i<2;i++){
+      for(k=0;k<4;k++){
+        t=qrow[4*(j+i)+k];
+        b=qrow[4*(j+2+i)+k];
+        qrow[4*(j+i)+k]   =((t&0xccccccccccccccccULL)>>2) |  (b&0xccccccccccccccccULL);
+        qrow[4*(j+2+i)+k]= (t&0x3333333333333333ULL)     | ((b&0x3333333333333333ULL)<<2);
+      }
+    }
+  }
+  for(j=0;j<64;j+=2){
+    unsigned long long int t,b;
+    for(i=0;i<1;i++){
+      for(k=0;k<4;k++){
+        t=qrow[4*(j+i)+k];
+        b=qrow[4*(j+1+i)+k];
+        qrow[4*(j+i)+k]   =((t&0xaaaaaaaaaaaaaaaaULL)>>1) |  (b&0xaaaaaaaaaaaaaaaaULL);
+        qrow[4*(j+1+i)+k]= (t&0x5555555555555555ULL)     | ((b&0x5555555555555555ULL)<<1);
+      }
+    }
+  }
+#undef qrow
+}
 #endif
 
 
@@ -489,6 +636,9 @@ trasp64_64_88ccw(sb);
 #if GROUP_PARALLELISM==128
 trasp64_128_88ccw(sb);
 #endif
+#if GROUP_PARALLELISM==256
+trasp64_256_88ccw(sb);
+#endif
 DBG(dump_mem("stream_postrot",sb,GROUP_PARALLELISM*8,BYPG));
 
 for(j=0;j<64;j++){
@@ -888,6 +1038,9 @@ trasp64_64_88cw(cb);
 #if GROUP_PARALLELISM==128
 trasp64_128_88cw(cb);
 #endif
+#if GROUP_PARALLELISM==256
+trasp64_256_88cw(cb);
+#endif
 
 for(j=0;j<64;j++){
   DBG(fprintf(stderr,"postcall postrot cb[%2i]=",j));
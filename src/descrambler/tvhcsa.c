@@ -19,163 +19,531 @@
 #include "tvhcsa.h"
 #include "input/mpegts.h"
 #include "input/mpegts/tsdemux.h"
+#include "mempool.h"
+#include "atomic.h"
 
 #include <stdlib.h>
 #include <unistd.h>
 #include <assert.h>
 
-void
-tvhcsa_descramble
-  ( tvhcsa_t *csa, struct mpegts_service *s, struct elementary_stream *st,
-    const uint8_t *tsb, int cw_update_pending )
+/*
+ * Descrambling is done by a pool of worker threads
+ *
+ * The input thread fills a cluster (job) per service, when full it's
+ * queued (along with a copy of the current control words) for the
+ * workers. Each service has a context holding its jobs in the order
+ * they were queued, as jobs complete they're passed on to
+ * ts_recv_packet2() in that order.
+ *
+ * The context is refcounted (service descrambler + queued jobs), as the
+ * descrambler can be stopped while jobs are in progress.
+ *
+ * Waiting for a full cluster on a low bitrate service (radio etc.) would
+ * hold packets for seconds, so a cluster is also queued once its first
+ * packet is TVHCSA_DEADLINE ms old (in PCR time). High bitrate services
+ * fill the cluster well within that and keep full SIMD throughput.
+ * As that's only checked when a packet arrives, a flush thread also
+ * queues clusters that are older than that in wall clock time, so a
+ * stalled service doesn't sit on its last packets.
+ */
+
+#define TVHCSA_THREADS_MAX 8
+#define TVHCSA_DEADLINE    50 /* ms */
+#define TVHCSA_PCR_MASK    0x1ffffffffLL
+
+typedef struct tvhcsa_ctx
+{
+  int                       cc_refcount;
+  int                       cc_dead;    /* s_stream_mutex */
+  struct mpegts_service    *cc_service;
+  tvhcsa_t                 *cc_csa;     /* s_stream_mutex, unless dead */
+  LIST_ENTRY(tvhcsa_ctx)    cc_link;    /* tvhcsa_ctxs */
+  TAILQ_HEAD(,tvhcsa_job)   cc_jobs;    /* s_stream_mutex */
+
+  /* Statistics (s_stream_mutex) */
+  avgstat_t                 cc_rate;
+  int64_t                   cc_latency; /* usec, moving average */
+  int64_t                   cc_latency_max;
+  int                       cc_fill;    /* packets/cluster * 16, moving avg */
+  int                       cc_partial; /* deadline flushes, 0-256 */
+} tvhcsa_ctx_t;
+
+typedef struct tvhcsa_job
+{
+  TAILQ_ENTRY(tvhcsa_job)   cj_link;     /* tvhcsa_queue */
+  TAILQ_ENTRY(tvhcsa_job)   cj_ctx_link; /* cc_jobs */
+  tvhcsa_ctx_t             *cj_ctx;
+  int64_t                   cj_time;
+  int                       cj_fill;
+  int                       cj_done;
+  int                       cj_key_id;
+  int                       cj_cw_set;
+  uint8_t                   cj_cw[16];
+  uint8_t                   cj_data[0];
+} tvhcsa_job_t;
+
+static pthread_mutex_t        tvhcsa_mutex;
+static pthread_cond_t         tvhcsa_cond;
+static pthread_cond_t         tvhcsa_flush_cond;
+static TAILQ_HEAD(,tvhcsa_job) tvhcsa_queue;
+static LIST_HEAD(,tvhcsa_ctx) tvhcsa_ctxs;
+static mempool_t             *tvhcsa_job_pool;
+static int                    tvhcsa_cluster_size;
+static int                    tvhcsa_key_ids;
+
+static void
+tvhcsa_ctx_unref ( tvhcsa_ctx_t *cc )
+{
+  if (atomic_add(&cc->cc_refcount, -1) == 1) {
+    service_unref((service_t*)cc->cc_service);
+    free(cc);
+  }
+}
+
+/* **************************************************************************
+ * Worker
+ * *************************************************************************/
+
+typedef struct tvhcsa_worker
+{
+  int       cw_key_id;
+#if ENABLE_DVBCSA
+  struct dvbcsa_bs_batch_s *cw_batch_even;
+  struct dvbcsa_bs_batch_s *cw_batch_odd;
+  struct dvbcsa_bs_key_s   *cw_key_even;
+  struct dvbcsa_bs_key_s   *cw_key_odd;
+#else
+  void     *cw_keys;
+#endif
+} tvhcsa_worker_t;
+
+/*
+ * Decrypt a cluster in place
+ */
+static void
+tvhcsa_decrypt ( tvhcsa_worker_t *w, tvhcsa_job_t *cj )
 {
 #if ENABLE_DVBCSA
   uint8_t *pkt;
-  int xc0;
-  int ev_od;
-  int len;
-  int offset;
-  int n;
-  int i;
-  const uint8_t *t0;
+  int xc0, ev_od, len, offset, n, i;
+  int fill_even = 0, fill_odd = 0;
 
-  pkt = csa->csa_tsbcluster + csa->csa_fill * 188;
-  memcpy(pkt, tsb, 188);
-  csa->csa_fill++;
+  /* Keys */
+  if (w->cw_key_id != cj->cj_key_id) {
+    if (cj->cj_cw_set & 1)
+      dvbcsa_bs_key_set(cj->cj_cw, w->cw_key_even);
+    if (cj->cj_cw_set & 2)
+      dvbcsa_bs_key_set(cj->cj_cw + 8, w->cw_key_odd);
+    w->cw_key_id = cj->cj_key_id;
+  }
 
-  do { // handle this packet
+  /* Build batches */
+  for (i = 0; i < cj->cj_fill; i++) {
+    pkt = cj->cj_data + i * 188;
     xc0 = pkt[3] & 0xc0;
-    if(xc0 == 0x00) { // clear
-      break;
+    if (xc0 == 0x00 || xc0 == 0x40) // clear / reserved
+      continue;
+    ev_od = (xc0 & 0x40) >> 6; // 0 even, 1 odd
+    pkt[3] &= 0x3f;  // consider it decrypted now
+    if (pkt[3] & 0x20) { // incomplete packet
+      offset = 4 + pkt[4] + 1;
+      len = 188 - offset;
+      n = len >> 3;
+      if (n == 0) // decrypted==encrypted!
+        continue;
+    } else {
+      len = 184;
+      offset = 4;
     }
-    if(xc0 == 0x40) { // reserved
-      break;
+    if (ev_od == 0) {
+      w->cw_batch_even[fill_even].data = pkt + offset;
+      w->cw_batch_even[fill_even].len = len;
+      fill_even++;
+    } else {
+      w->cw_batch_odd[fill_odd].data = pkt + offset;
+      w->cw_batch_odd[fill_odd].len = len;
+      fill_odd++;
     }
-    if(xc0 == 0x80 || xc0 == 0xc0) { // encrypted
-      ev_od = (xc0 & 0x40) >> 6; // 0 even, 1 odd
-      pkt[3] &= 0x3f;  // consider it decrypted now
-      if(pkt[3] & 0x20) { // incomplete packet
-        offset = 4 + pkt[4] + 1;
-        len = 188 - offset;
-        n = len >> 3;
-        // FIXME: //residue = len - (n << 3);
-        if(n == 0) { // decrypted==encrypted!
-          break; // this doesn't need more processing
-        }
-      } else {
-        len = 184;
-        offset = 4;
-        // FIXME: //n = 23;
-        // FIXME: //residue = 0;
-      }
-      if(ev_od == 0) {
-        csa->csa_tsbbatch_even[csa->csa_fill_even].data = pkt + offset;
-        csa->csa_tsbbatch_even[csa->csa_fill_even].len = len;
-        csa->csa_fill_even++;
-      } else {
-        csa->csa_tsbbatch_odd[csa->csa_fill_odd].data = pkt + offset;
-        csa->csa_tsbbatch_odd[csa->csa_fill_odd].len = len;
-        csa->csa_fill_odd++;
+  }
+
+  if (fill_even) {
+    w->cw_batch_even[fill_even].data = NULL;
+    dvbcsa_bs_decrypt(w->cw_key_even, w->cw_batch_even, 184);
+  }
+  if (fill_odd) {
+    w->cw_batch_odd[fill_odd].data = NULL;
+    dvbcsa_bs_decrypt(w->cw_key_odd, w->cw_batch_odd, 184);
+  }
+#else
+  int r;
+  unsigned char *vec[3];
+
+  /* Keys */
+  if (w->cw_key_id != cj->cj_key_id) {
+    if (cj->cj_cw_set & 1)
+      set_even_control_word(w->cw_keys, cj->cj_cw);
+    if (cj->cj_cw_set & 2)
+      set_odd_control_word(w->cw_keys, cj->cj_cw + 8);
+    w->cw_key_id = cj->cj_key_id;
+  }
+
+  /* Note: FFdecsa stops on a parity change, so keep going until done
+   *       (the range is removed, vec[0] = NULL, once it's complete) */
+  vec[0] = cj->cj_data;
+  vec[1] = cj->cj_data + cj->cj_fill * 188;
+  vec[2] = NULL;
+  while (vec[0]) {
+    r = decrypt_packets(w->cw_keys, vec);
+    if (r <= 0)
+      break;
+  }
+#endif
+}
+
+/*
+ * Pass completed clusters on (in order)
+ *
+ * s_stream_mutex must be held
+ */
+static void
+tvhcsa_complete ( tvhcsa_ctx_t *cc, tvhcsa_job_t *cj )
+{
+  tvhcsa_job_t *next;
+  const uint8_t *tsb;
+  int64_t lat;
+  int i;
+
+  cj->cj_done = 1;
+
+  /* Stopped - drop this and any other completed clusters */
+  if (cc->cc_dead) {
+    for (cj = TAILQ_FIRST(&cc->cc_jobs); cj; cj = next) {
+      next = TAILQ_NEXT(cj, cj_ctx_link);
+      if (cj->cj_done) {
+        TAILQ_REMOVE(&cc->cc_jobs, cj, cj_ctx_link);
+        mempool_free(tvhcsa_job_pool, cj);
       }
     }
-  } while(0);
-
-  if(csa->csa_fill != csa->csa_cluster_size)
     return;
+  }
+
+  while ((cj = TAILQ_FIRST(&cc->cc_jobs)) != NULL && cj->cj_done) {
+    TAILQ_REMOVE(&cc->cc_jobs, cj, cj_ctx_link);
+
+    tsb = cj->cj_data;
+    for (i = 0; i < cj->cj_fill; i++, tsb += 188)
+      ts_recv_packet2(cc->cc_service, tsb);
 
-  if(csa->csa_fill_even) {
-    csa->csa_tsbbatch_even[csa->csa_fill_even].data = NULL;
-    dvbcsa_bs_decrypt(csa->csa_key_even, csa->csa_tsbbatch_even, 184);
-    csa->csa_fill_even = 0;
+    /* Stats */
+    lat = getmonoclock() - cj->cj_time;
+    cc->cc_latency = (cc->cc_latency * 7 + lat) / 8;
+    if (lat > cc->cc_latency_max)
+      cc->cc_latency_max = lat;
+    avgstat_add(&cc->cc_rate, cj->cj_fill, dispatch_clock);
+
+    mempool_free(tvhcsa_job_pool, cj);
   }
-  if(csa->csa_fill_odd) {
-    csa->csa_tsbbatch_odd[csa->csa_fill_odd].data = NULL;
-    dvbcsa_bs_decrypt(csa->csa_key_odd, csa->csa_tsbbatch_odd, 184);
-    csa->csa_fill_odd = 0;
+}
+
+static void *
+tvhcsa_thread ( void *aux )
+{
+  tvhcsa_worker_t w;
+  tvhcsa_job_t *cj;
+  tvhcsa_ctx_t *cc;
+  service_t *t;
+
+  memset(&w, 0, sizeof(w));
+#if ENABLE_DVBCSA
+  w.cw_batch_even = malloc((tvhcsa_cluster_size + 1) *
+                           sizeof(struct dvbcsa_bs_batch_s));
+  w.cw_batch_odd  = malloc((tvhcsa_cluster_size + 1) *
+                           sizeof(struct dvbcsa_bs_batch_s));
+  w.cw_key_even   = dvbcsa_bs_key_alloc();
+  w.cw_key_odd    = dvbcsa_bs_key_alloc();
+#else
+  w.cw_keys       = get_key_struct();
+#endif
+
+  while (1) {
+
+    /* Get next cluster */
+    pthread_mutex_lock(&tvhcsa_mutex);
+    while (!(cj = TAILQ_FIRST(&tvhcsa_queue)))
+      pthread_cond_wait(&tvhcsa_cond, &tvhcsa_mutex);
+    TAILQ_REMOVE(&tvhcsa_queue, cj, cj_link);
+    pthread_mutex_unlock(&tvhcsa_mutex);
+
+    /* Decrypt (unlocked, dead is re-checked on completion) */
+    cc = cj->cj_ctx;
+    if (!cc->cc_dead)
+      tvhcsa_decrypt(&w, cj);
+
+    /* Deliver */
+    t = (service_t*)cc->cc_service;
+    pthread_mutex_lock(&t->s_stream_mutex);
+    tvhcsa_complete(cc, cj);
+    pthread_mutex_unlock(&t->s_stream_mutex);
+
+    tvhcsa_ctx_unref(cc);
   }
+  return NULL;
+}
+
+/* **************************************************************************
+ * Service interface
+ * *************************************************************************/
+
+static void
+tvhcsa_set_key ( tvhcsa_t *csa, const uint8_t *cw, int odd )
+{
+  memcpy(csa->csa_cw + (odd ? 8 : 0), cw, 8);
+  csa->csa_cw_set |= odd ? 2 : 1;
+  csa->csa_key_id  = atomic_add(&tvhcsa_key_ids, 1) + 1;
+}
+
+void
+tvhcsa_set_key_even ( tvhcsa_t *csa, const uint8_t *cw )
+{
+  tvhcsa_set_key(csa, cw, 0);
+}
+
+void
+tvhcsa_set_key_odd ( tvhcsa_t *csa, const uint8_t *cw )
+{
+  tvhcsa_set_key(csa, cw, 1);
+}
 
-  t0 = csa->csa_tsbcluster;
+/*
+ * Check whether the current cluster is past its deadline
+ */
+static int
+tvhcsa_expired ( tvhcsa_t *csa, struct mpegts_service *s )
+{
+  int64_t d;
 
-  for(i = 0; i < csa->csa_fill; i++) {
-	  ts_recv_packet2(s, t0);
-	  t0 += 188;
+  if (csa->csa_start_pcr != PTS_UNSET && s->s_pcr_last != PTS_UNSET) {
+    d = (s->s_pcr_last - csa->csa_start_pcr) & TVHCSA_PCR_MASK;
+    return d >= TVHCSA_DEADLINE * 90;
   }
+  return getmonoclock() - csa->csa_start >= TVHCSA_DEADLINE * 1000;
+}
+
+/*
+ * Queue the current cluster for the workers
+ *
+ * s_stream_mutex must be held
+ */
+static void
+tvhcsa_queue_job ( tvhcsa_t *csa, int partial )
+{
+  tvhcsa_job_t *cj = csa->csa_job;
+  tvhcsa_ctx_t *cc = csa->csa_ctx;
+
+  /* Policy stats */
+  cc->cc_fill   += cj->cj_fill * 2 - cc->cc_fill / 8;
+  cc->cc_partial = (cc->cc_partial * 7 + (partial ? 256 : 0)) / 8;
+
+  /* Queue */
+  cj->cj_ctx    = cc;
+  cj->cj_time   = getmonoclock();
+  cj->cj_done   = 0;
+  cj->cj_key_id = csa->csa_key_id;
+  cj->cj_cw_set = csa->csa_cw_set;
+  memcpy(cj->cj_cw, csa->csa_cw, sizeof(cj->cj_cw));
+  atomic_add(&cj->cj_ctx->cc_refcount, 1);
+  TAILQ_INSERT_TAIL(&cj->cj_ctx->cc_jobs, cj, cj_ctx_link);
+
+  pthread_mutex_lock(&tvhcsa_mutex);
+  TAILQ_INSERT_TAIL(&tvhcsa_queue, cj, cj_link);
+  pthread_cond_signal(&tvhcsa_cond);
+  pthread_mutex_unlock(&tvhcsa_mutex);
+
+  csa->csa_job  = NULL;
   csa->csa_fill = 0;
+}
 
-#else
-  int r;
-  unsigned char *vec[3];
+/*
+ * Queue a packet for descrambling, cw_update_pending means the keys
+ * change after this packet so the cluster is queued now (the job takes
+ * a copy of the current keys)
+ *
+ * s_stream_mutex must be held
+ */
+void
+tvhcsa_descramble
+  ( tvhcsa_t *csa, struct mpegts_service *s, struct elementary_stream *st,
+    const uint8_t *tsb, int cw_update_pending )
+{
+  tvhcsa_job_t *cj = csa->csa_job;
+  int partial;
 
-  memcpy(csa->csa_tsbcluster + csa->csa_fill * 188, tsb, 188);
-  csa->csa_fill++;
+  if (!cj) {
+    cj = csa->csa_job = mempool_alloc(tvhcsa_job_pool);
+    cj->cj_fill = 0;
+    csa->csa_start_pcr = s->s_pcr_last;
+    csa->csa_start     = getmonoclock();
+  }
+
+  memcpy(cj->cj_data + cj->cj_fill * 188, tsb, 188);
+  csa->csa_fill = ++cj->cj_fill;
 
-  if(csa->csa_fill != csa->csa_cluster_size)
+  partial = cj->cj_fill != csa->csa_cluster_size;
+  if (partial && !cw_update_pending && !tvhcsa_expired(csa, s))
     return;
 
-  while(1) {
+  tvhcsa_queue_job(csa, partial);
+}
 
-    vec[0] = csa->csa_tsbcluster;
-    vec[1] = csa->csa_tsbcluster + csa->csa_fill * 188;
-    vec[2] = NULL;
-    
-    r = decrypt_packets(csa->csa_keys, vec);
-    if(r > 0) {
-      int i;
-      const uint8_t *t0 = csa->csa_tsbcluster;
+/*
+ * Queue partial clusters of services that have gone quiet
+ */
+static void *
+tvhcsa_flush_thread ( void *aux )
+{
+  tvhcsa_ctx_t *cc, **ccs = NULL;
+  struct timespec ts;
+  service_t *t;
+  int i, num, alloc = 0;
+  int64_t now;
 
-      for(i = 0; i < r; i++) {
-	      ts_recv_packet2(s, t0);
-	      t0 += 188;
-      }
+  pthread_mutex_lock(&tvhcsa_mutex);
+  while (1) {
 
-      r = csa->csa_fill - r;
-      assert(r >= 0);
+    /* Wait a deadline (or for a service to start) */
+    while (LIST_EMPTY(&tvhcsa_ctxs))
+      pthread_cond_wait(&tvhcsa_flush_cond, &tvhcsa_mutex);
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_nsec += TVHCSA_DEADLINE * 1000000LL;
+    ts.tv_sec  += ts.tv_nsec / 1000000000;
+    ts.tv_nsec %= 1000000000;
+    pthread_cond_timedwait(&tvhcsa_flush_cond, &tvhcsa_mutex, &ts);
 
-      if(r > 0)
-	      memmove(csa->csa_tsbcluster, t0, r * 188);
-      csa->csa_fill = r;
+    /* Reference the live contexts */
+    num = 0;
+    LIST_FOREACH(cc, &tvhcsa_ctxs, cc_link) {
+      if (num == alloc) {
+        alloc = MAX(16, alloc * 2);
+        ccs   = realloc(ccs, alloc * sizeof(*ccs));
+      }
+      atomic_add(&cc->cc_refcount, 1);
+      ccs[num++] = cc;
+    }
+    pthread_mutex_unlock(&tvhcsa_mutex);
 
-      if(cw_update_pending && r > 0)
-	      continue;
-    } else {
-      csa->csa_fill = 0;
+    /* Flush (s_stream_mutex is taken before tvhcsa_mutex) */
+    now = getmonoclock();
+    for (i = 0; i < num; i++) {
+      cc = ccs[i];
+      t  = (service_t*)cc->cc_service;
+      pthread_mutex_lock(&t->s_stream_mutex);
+      if (!cc->cc_dead && cc->cc_csa->csa_job &&
+          now - cc->cc_csa->csa_start >= TVHCSA_DEADLINE * 1000)
+        tvhcsa_queue_job(cc->cc_csa, 1);
+      pthread_mutex_unlock(&t->s_stream_mutex);
+      tvhcsa_ctx_unref(cc);
     }
-    break;
+
+    pthread_mutex_lock(&tvhcsa_mutex);
   }
-#endif
+  return NULL;
 }
 
+/*
+ * Statistics: packets/s, average and max cluster latency (usec),
+ * average cluster fill and the flush policy currently in effect
+ * ("throughput" - full clusters, "latency" - mostly deadline flushes)
+ *
+ * s_stream_mutex must be held
+ */
 void
-tvhcsa_init ( tvhcsa_t *csa )
+tvhcsa_get_stats
+  ( tvhcsa_t *csa, uint32_t *rate, uint32_t *latency, uint32_t *latency_max,
+    uint32_t *cluster, const char **policy )
 {
-#if ENABLE_DVBCSA
-  csa->csa_cluster_size  = dvbcsa_bs_batch_size();
-#else
-  csa->csa_cluster_size  = get_suggested_cluster_size();
-#endif
-  csa->csa_tsbcluster    = malloc(csa->csa_cluster_size * 188);
-#if ENABLE_DVBCSA
-  csa->csa_tsbbatch_even = malloc((csa->csa_cluster_size + 1) *
-                                   sizeof(struct dvbcsa_bs_batch_s));
-  csa->csa_tsbbatch_odd  = malloc((csa->csa_cluster_size + 1) *
-                                   sizeof(struct dvbcsa_bs_batch_s));
-  csa->csa_key_even      = dvbcsa_bs_key_alloc();
-  csa->csa_key_odd       = dvbcsa_bs_key_alloc();
-#else
-  csa->csa_keys          = get_key_struct();
-#endif
+  tvhcsa_ctx_t *cc = csa->csa_ctx;
+
+  *rate        = avgstat_read_and_expire(&cc->cc_rate, dispatch_clock) / 10;
+  *latency     = cc->cc_latency;
+  *latency_max = cc->cc_latency_max;
+  *cluster     = cc->cc_fill / 16;
+  *policy      = cc->cc_partial > 128 ? "latency" : "throughput";
 }
 
+void
+tvhcsa_init ( tvhcsa_t *csa, struct mpegts_service *s )
+{
+  tvhcsa_ctx_t *cc;
+
+  memset(csa, 0, sizeof(*csa));
+  csa->csa_cluster_size = tvhcsa_cluster_size;
+
+  cc = calloc(1, sizeof(tvhcsa_ctx_t));
+  cc->cc_refcount = 1;
+  cc->cc_service  = s;
+  cc->cc_csa      = csa;
+  TAILQ_INIT(&cc->cc_jobs);
+  avgstat_init(&cc->cc_rate, 10);
+  service_ref((service_t*)s);
+  csa->csa_ctx    = cc;
+
+  pthread_mutex_lock(&tvhcsa_mutex);
+  LIST_INSERT_HEAD(&tvhcsa_ctxs, cc, cc_link);
+  pthread_cond_signal(&tvhcsa_flush_cond);
+  pthread_mutex_unlock(&tvhcsa_mutex);
+}
+
+/*
+ * s_stream_mutex must be held
+ */
 void
 tvhcsa_destroy ( tvhcsa_t *csa )
 {
+  /* Any clusters still in progress are dropped by the workers */
+  pthread_mutex_lock(&tvhcsa_mutex);
+  LIST_REMOVE(csa->csa_ctx, cc_link);
+  pthread_mutex_unlock(&tvhcsa_mutex);
+  csa->csa_ctx->cc_dead = 1;
+  csa->csa_ctx->cc_csa  = NULL;
+  tvhcsa_ctx_unref(csa->csa_ctx);
+  csa->csa_ctx = NULL;
+
+  if (csa->csa_job)
+    mempool_free(tvhcsa_job_pool, csa->csa_job);
+  csa->csa_job  = NULL;
+  csa->csa_fill = 0;
+}
+
+/*
+ * Start the workers
+ */
+void
+tvhcsa_pool_init ( void )
+{
+  int i, num;
+  pthread_t tid;
+
 #if ENABLE_DVBCSA
-  dvbcsa_bs_key_free(csa->csa_key_odd);
-  dvbcsa_bs_key_free(csa->csa_key_even);
-  free(csa->csa_tsbbatch_odd);
-  free(csa->csa_tsbbatch_even);
+  tvhcsa_cluster_size = dvbcsa_bs_batch_size();
 #else
-  free_key_struct(csa->csa_keys);
+  tvhcsa_cluster_size = get_suggested_cluster_size();
 #endif
-  free(csa->csa_tsbcluster);
+
+  pthread_mutex_init(&tvhcsa_mutex, NULL);
+  pthread_cond_init(&tvhcsa_cond, NULL);
+  pthread_cond_init(&tvhcsa_flush_cond, NULL);
+  TAILQ_INIT(&tvhcsa_queue);
+  LIST_INIT(&tvhcsa_ctxs);
+  tvhcsa_job_pool = mempool_create("csa cluster",
+                                   sizeof(tvhcsa_job_t) +
+                                   tvhcsa_cluster_size * 188, 32);
+
+  num = sysconf(_SC_NPROCESSORS_ONLN);
+  num = MAX(1, MIN(num, TVHCSA_THREADS_MAX));
+  for (i = 0; i < num; i++)
+    tvhthread_create(&tid, NULL, tvhcsa_thread, NULL, 1);
+  tvhthread_create(&tid, NULL, tvhcsa_flush_thread, NULL, 1);
+
+  tvhlog(LOG_INFO, "csa", "%d descrambling threads, cluster size %d",
+         num, tvhcsa_cluster_size);
 }
@@ -31,54 +31,52 @@ struct elementary_stream;
 #include "ffdecsa/FFdecsa.h"
 #endif
 
+struct tvhcsa_job;
+struct tvhcsa_ctx;
+
 typedef struct tvhcsa
 {
 
   /**
    * CSA
+   *
+   * Packets are gathered into clusters here (on the input thread), the
+   * actual decryption is done by the worker pool, see tvhcsa.c
+   *
+   * A cluster is queued when full, or partially filled once it's
+   * older than the deadline (PCR time, wall clock if there's no PCR)
    */
   int      csa_cluster_size;
-  uint8_t *csa_tsbcluster;
   int      csa_fill;
+  int64_t  csa_start_pcr;
+  int64_t  csa_start;
+  struct tvhcsa_job *csa_job;
+  struct tvhcsa_ctx *csa_ctx;
 
-#if ENABLE_DVBCSA
-  struct dvbcsa_bs_batch_s *csa_tsbbatch_even;
-  struct dvbcsa_bs_batch_s *csa_tsbbatch_odd;
-  int csa_fill_even;
-  int csa_fill_odd;
-
-  struct dvbcsa_bs_key_s *csa_key_even;
-  struct dvbcsa_bs_key_s *csa_key_odd;
-#else
-  void *csa_keys;
-#endif
+  /**
+   * Control words, copied to each cluster when queued
+   */
+  uint8_t  csa_cw[16];
+  int      csa_cw_set;   /* bit 0 - even, bit 1 - odd */
+  int      csa_key_id;   /* unique id, changes on every key update */
   
 } tvhcsa_t;
 
-#if ENABLE_DVBCSA
-
-#define tvhcsa_set_key_even(csa, cw)\
-  dvbcsa_bs_key_set(cw, (csa)->csa_key_even)
-
-#define tvhcsa_set_key_odd(csa, cw)\
-  dvbcsa_bs_key_set(cw, (csa)->csa_key_odd)
-
-#else
-
-#define tvhcsa_set_key_even(csa, cw)\
-  set_even_control_word((csa)->csa_keys, cw)
-
-#define tvhcsa_set_key_odd(csa, cw)\
-  set_odd_control_word((csa)->csa_keys, cw)
-
-#endif
+void tvhcsa_set_key_even ( tvhcsa_t *csa, const uint8_t *cw );
+void tvhcsa_set_key_odd  ( tvhcsa_t *csa, const uint8_t *cw );
 
 void
 tvhcsa_descramble
   ( tvhcsa_t *csa, struct mpegts_service *s, struct elementary_stream *st,
     const uint8_t *tsb, int cw_update_pending );
 
-void tvhcsa_init    ( tvhcsa_t *csa );
+void tvhcsa_init    ( tvhcsa_t *csa, struct mpegts_service *s );
 void tvhcsa_destroy ( tvhcsa_t *csa );
 
+void tvhcsa_get_stats
+  ( tvhcsa_t *csa, uint32_t *rate, uint32_t *latency, uint32_t *latency_max,
+    uint32_t *cluster, const char **policy );
+
+void tvhcsa_pool_init ( void );
+
 #endif /* __TVH_CSA_H__ */
@@ -414,18 +414,19 @@ dvr_thread(void *aux)
   dvr_config_t *cfg = dvr_config_find_by_name_default(de->de_config_name);
   streaming_queue_t *sq = &de->de_sq;
   streaming_message_t *sm;
+  struct streaming_message_queue batch;
   th_pkt_t *pkt;
   int run = 1;
   int started = 0;
   int comm_skip = (cfg->dvr_flags & DVR_SKIP_COMMERCIALS);
   int commercial = COMMERCIAL_UNKNOWN;
 
-  pthread_mutex_lock(&sq->sq_mutex);
+  TAILQ_INIT(&batch);
 
   while(run) {
-    sm = TAILQ_FIRST(&sq->sq_queue);
+    sm = TAILQ_FIRST(&batch);
     if(sm == NULL) {
-      pthread_cond_wait(&sq->sq_cond, &sq->sq_mutex);
+      streaming_queue_dequeue_all(sq, &batch, NULL);
       continue;
     }
 
@@ -439,9 +440,7 @@ dvr_thread(void *aux)
         atomic_add(&de->de_s->ths_bytes_out, pktbuf_len(pb));
     }
 
-    TAILQ_REMOVE(&sq->sq_queue, sm, sm_link);
-
-    pthread_mutex_unlock(&sq->sq_mutex);
+    TAILQ_REMOVE(&batch, sm, sm_link);
 
     switch(sm->sm_type) {
 
@@ -577,9 +576,8 @@ dvr_thread(void *aux)
     }
 
     streaming_msg_free(sm);
-    pthread_mutex_lock(&sq->sq_mutex);
   }
-  pthread_mutex_unlock(&sq->sq_mutex);
+  streaming_queue_clear(&batch);
 
   if(de->de_mux)
     dvr_thread_epilog(de);
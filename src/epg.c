@@ -48,6 +48,7 @@ epg_object_tree_t epg_serieslinks;
 epg_object_list_t epg_objects[EPG_HASH_WIDTH];
 epg_object_list_t epg_object_unref;
 epg_object_list_t epg_object_updated;
+epg_object_tree_t epg_object_changes;
 
 /* Global counter */
 static uint32_t _epg_object_idx    = 0;
@@ -61,6 +62,14 @@ static int _uri_cmp ( const void *a, const void *b )
   return strcmp(((epg_object_t*)a)->uri, ((epg_object_t*)b)->uri);
 }
 
+static int _update_cmp ( const void *a, const void *b )
+{
+  const epg_object_t *x = a, *y = b;
+  if (x->updated != y->updated) return x->updated < y->updated ? -1 : 1;
+  if (x->id != y->id) return x->id < y->id ? -1 : 1;
+  return 0;
+}
+
 static int _ebc_start_cmp ( const void *a, const void *b )
 {
   return ((epg_broadcast_t*)a)->start - ((epg_broadcast_t*)b)->start;
@@ -131,6 +140,7 @@ static void _epg_object_destroy
   if (eo->uri) free(eo->uri);
   if (tree) RB_REMOVE(tree, eo, uri_link);
   if (eo->_updated) LIST_REMOVE(eo, up_link);
+  if (eo->_indexed) RB_REMOVE(&epg_object_changes, eo, ut_link);
   LIST_REMOVE(eo, id_link);
 }
 
@@ -153,6 +163,12 @@ static void _epg_object_putref ( void *o )
   if (!eo->refcount) eo->destroy(eo);
 }
 
+static void _epg_object_index ( epg_object_t *eo )
+{
+  eo->_indexed =
+    RB_INSERT_SORTED(&epg_object_changes, eo, ut_link, _update_cmp) == NULL;
+}
+
 static void _epg_object_set_updated ( void *o )
 {
   epg_object_t *eo = o;
@@ -160,7 +176,12 @@ static void _epg_object_set_updated ( void *o )
     tvhtrace("epg", "eo [%p, %u, %d, %s] updated",
              eo, eo->id, eo->type, eo->uri);
     eo->_updated = 1;
-    eo->updated  = dispatch_clock;
+    if (eo->_indexed) {
+      RB_REMOVE(&epg_object_changes, eo, ut_link);
+      eo->updated = dispatch_clock;
+      _epg_object_index(eo);
+    } else
+      eo->updated = dispatch_clock;
     LIST_INSERT_HEAD(&epg_object_updated, eo, up_link);
   }
 }
@@ -175,6 +196,7 @@ static void _epg_object_create ( void *o )
   tvhtrace("epg", "eo [%p, %u, %d, %s] created",
            eo, eo->id, eo->type, eo->uri);
   _epg_object_set_updated(eo);
+  _epg_object_index(eo);
   LIST_INSERT_HEAD(&epg_object_unref, eo, un_link);
   LIST_INSERT_HEAD(&epg_objects[eo->id & EPG_HASH_MASK], eo, id_link);
 }
@@ -218,6 +240,19 @@ epg_object_t *epg_object_find_by_id ( uint32_t id, epg_object_type_t type )
   return NULL;
 }
 
+epg_object_t *epg_object_find_by_update ( time_t updated, uint32_t id )
+{
+  epg_object_t skel;
+  skel.updated = updated;
+  skel.id      = id;
+  return RB_FIND_GT(&epg_object_changes, &skel, ut_link, _update_cmp);
+}
+
+epg_object_t *epg_object_get_next_update ( epg_object_t *eo )
+{
+  return RB_NEXT(eo, ut_link);
+}
+
 static htsmsg_t * _epg_object_serialize ( void *o )
 {
   epg_object_t *eo = o;
@@ -1589,6 +1624,13 @@ epg_broadcast_t *epg_broadcast_find_by_id ( uint32_t id, channel_t *ch )
   return (epg_broadcast_t*)epg_object_find_by_id(id, EPG_BROADCAST);
 }
 
+epg_broadcast_t *epg_broadcast_find_after ( channel_t *ch, time_t start )
+{
+  epg_broadcast_t skel;
+  skel.start = start;
+  return RB_FIND_GT(&ch->ch_epg_schedule, &skel, sched_link, _ebc_start_cmp);
+}
+
 epg_broadcast_t *epg_broadcast_find_by_eid ( channel_t *ch, uint16_t eid )
 {
   epg_broadcast_t *e;
@@ -1730,6 +1772,22 @@ epg_broadcast_t *epg_broadcast_get_next ( epg_broadcast_t *broadcast )
   return RB_NEXT(broadcast, sched_link);
 }
 
+epg_object_t *epg_broadcast_get_last_update ( epg_broadcast_t *b )
+{
+  epg_object_t *r = (epg_object_t*)b, *o[4] = { NULL };
+  int i;
+  if ( !b ) return NULL;
+  o[0] = (epg_object_t*)b->serieslink;
+  if ( b->episode ) {
+    o[1] = (epg_object_t*)b->episode;
+    o[2] = (epg_object_t*)b->episode->brand;
+    o[3] = (epg_object_t*)b->episode->season;
+  }
+  for (i = 0; i < 4; i++)
+    if (o[i] && _update_cmp(o[i], r) > 0) r = o[i];
+  return r;
+}
+
 epg_episode_t *epg_broadcast_get_episode
   ( epg_broadcast_t *ebc, int create, int *save )
 {
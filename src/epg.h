@@ -106,6 +106,7 @@ struct epg_object
   LIST_ENTRY(epg_object)  id_link;    ///< Global (ID) link
   LIST_ENTRY(epg_object)  un_link;    ///< Global unref'd link
   LIST_ENTRY(epg_object)  up_link;    ///< Global updated link
+  RB_ENTRY(epg_object)    ut_link;    ///< Global update time link
  
   epg_object_type_t       type;       ///< Specific object type
   uint32_t                id;         ///< Internal ID
@@ -114,6 +115,7 @@ struct epg_object
   time_t                  updated;    ///< Last time object was changed
 
   int                     _updated;   ///< Flag to indicate updated
+  int                     _indexed;   ///< Flag to indicate in ut_link
   int                     refcount;   ///< Reference counting
   // Note: could use LIST_ENTRY field to determine this!
 
@@ -127,6 +129,10 @@ struct epg_object
 
 /* Get an object by ID (special case usage) */
 epg_object_t *epg_object_find_by_id  ( uint32_t id, epg_object_type_t type );
+
+/* Objects in order of last change, first one changed after (updated, id) */
+epg_object_t *epg_object_find_by_update  ( time_t updated, uint32_t id );
+epg_object_t *epg_object_get_next_update ( epg_object_t *eo );
 htsmsg_t     *epg_object_serialize   ( epg_object_t *eo );
 epg_object_t *epg_object_deserialize ( htsmsg_t *msg, int create, int *save );
 
@@ -451,6 +457,7 @@ epg_broadcast_t *epg_broadcast_find_by_time
     uint16_t eid, int create, int *save );
 epg_broadcast_t *epg_broadcast_find_by_eid ( struct channel *ch, uint16_t eid );
 epg_broadcast_t *epg_broadcast_find_by_id  ( uint32_t id, struct channel *ch );
+epg_broadcast_t *epg_broadcast_find_after  ( struct channel *ch, time_t start );
 
 /* Mutators */
 int epg_broadcast_set_episode
@@ -503,6 +510,7 @@ int epg_broadcast_set_serieslink
 
 /* Accessors */
 epg_broadcast_t *epg_broadcast_get_next    ( epg_broadcast_t *b );
+epg_object_t    *epg_broadcast_get_last_update ( epg_broadcast_t *b );
 epg_episode_t   *epg_broadcast_get_episode 
   ( epg_broadcast_t *b, int create, int *save );
 const char *epg_broadcast_get_title 
@@ -557,6 +565,7 @@ void epg_query(epg_query_result_t *eqr, const char *channel, const char *tag,
 
 void epg_init    (void);
 void epg_save    (void*);
+void epg_done    (void);
 void epg_updated (void);
 
 /* ************************************************************************
@@ -17,6 +17,8 @@
  */
 
 #include <string.h>
+#include <limits.h>
+#include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -30,7 +32,10 @@
 #include "epg.h"
 #include "epggrab.h"
 
-#define EPG_DB_VERSION 2
+#define EPG_DB_VERSION 3
+#define EPG_DB_CHUNK   512  /* Max records per index entry (v3) */
+#define EPG_DB_WORKERS 4    /* Max decode threads */
+#define EPG_DB_AHEAD   32   /* Max chunks decoded ahead of processing */
 
 extern epg_object_tree_t epg_brands;
 extern epg_object_tree_t epg_seasons;
@@ -98,19 +103,17 @@ static void _epgdb_v1_process ( htsmsg_t *c, epggrab_stats_t *stats )
 #endif
 
 /*
- * Process v2 data
+ * Process a record from the given section
  */
-static void _epgdb_v2_process ( htsmsg_t *m, epggrab_stats_t *stats )
+static void _epgdb_process
+  ( const char *sect, htsmsg_t *m, epggrab_stats_t *stats )
 {
   int save = 0;
-  const char *s;
-  static char *sect;
 
-  /* New section */
-  if ( (s = htsmsg_get_str(m, "__section__")) ) {
-    if (sect) free(sect);
-    sect = strdup(s);
-  
+  /* No section */
+  if ( !sect ) {
+    tvhlog(LOG_DEBUG, "epgdb", "malformed database, record without section");
+
   /* Brand */
   } else if ( !strcmp(sect, "brands") ) {
     if (epg_brand_deserialize(m, 1, &save)) stats->brands.total++;
@@ -138,6 +141,246 @@ static void _epgdb_v2_process ( htsmsg_t *m, epggrab_stats_t *stats )
   }
 }
 
+/*
+ * Process v2 data
+ */
+static void _epgdb_v2_process ( htsmsg_t *m, epggrab_stats_t *stats )
+{
+  const char *s;
+  static char *sect;
+
+  /* New section */
+  if ( (s = htsmsg_get_str(m, "__section__")) ) {
+    if (sect) free(sect);
+    sect = strdup(s);
+  } else {
+    _epgdb_process(sect, m, stats);
+  }
+}
+
+static void _epgdb_v2_load
+  ( const uint8_t *rp, size_t remain, epggrab_stats_t *stats )
+{
+  while ( remain > 4 ) {
+
+    /* Get message length */
+    int msglen = (rp[0] << 24) | (rp[1] << 16) | (rp[2] << 8) | rp[3];
+    remain    -= 4;
+    rp        += 4;
+
+    /* Safety check */
+    if (msglen > remain) {
+      tvhlog(LOG_ERR, "epgdb", "corruption detected, some/all data lost");
+      break;
+    }
+    
+    /* Extract message */
+    htsmsg_t *m = htsmsg_binary_deserialize(rp, msglen, NULL);
+
+    /* Next */
+    rp     += msglen;
+    remain -= msglen;
+
+    /* Skip */
+    if (!m) continue;
+
+    /* Process */
+    _epgdb_v2_process(m, stats);
+
+    /* Cleanup */
+    htsmsg_destroy(m);
+  }
+}
+
+/*
+ * v3 is v2 followed by an index of record chunks, the chunks are decoded
+ * by worker threads while this thread creates the objects in file order
+ */
+typedef struct epgdb_chunk {
+  const char    *sect;
+  const uint8_t *data;
+  size_t         len;
+  uint32_t       count;
+  htsmsg_t     **msgs;
+  int            done;
+  int            corrupt;
+} epgdb_chunk_t;
+
+typedef struct epgdb_loader {
+  pthread_mutex_t lock;
+  pthread_cond_t  cond;
+  epgdb_chunk_t  *chunks;
+  int             count;
+  int             next;      /* Next chunk to decode */
+  int             consumed;  /* Chunks processed */
+} epgdb_loader_t;
+
+static void _epgdb_v3_decode ( epgdb_chunk_t *c )
+{
+  const uint8_t *rp = c->data;
+  size_t remain = c->len, msglen;
+  uint32_t i;
+
+  if (!(c->msgs = calloc(c->count ?: 1, sizeof(htsmsg_t *)))) {
+    c->count   = 0;
+    c->corrupt = 1;
+    return;
+  }
+  for (i = 0; i < c->count && remain > 4; i++) {
+    msglen  = (rp[0] << 24) | (rp[1] << 16) | (rp[2] << 8) | rp[3];
+    remain -= 4;
+    rp     += 4;
+    if (msglen > remain)
+      break;
+    c->msgs[i] = htsmsg_binary_deserialize(rp, msglen, NULL);
+    rp     += msglen;
+    remain -= msglen;
+  }
+  c->corrupt = i < c->count || remain;
+}
+
+static void *_epgdb_v3_thread ( void *p )
+{
+  epgdb_loader_t *l = p;
+  epgdb_chunk_t *c;
+
+  pthread_mutex_lock(&l->lock);
+  while (l->next < l->count) {
+    if (l->next >= l->consumed + EPG_DB_AHEAD) {
+      pthread_cond_wait(&l->cond, &l->lock);
+      continue;
+    }
+    c = &l->chunks[l->next++];
+    pthread_mutex_unlock(&l->lock);
+    _epgdb_v3_decode(c);
+    pthread_mutex_lock(&l->lock);
+    c->done = 1;
+    pthread_cond_broadcast(&l->cond);
+  }
+  pthread_mutex_unlock(&l->lock);
+  return NULL;
+}
+
+/*
+ * Read the index from the end of the file, returns the number of chunks
+ * or -1 if the index is unusable
+ */
+static int _epgdb_v3_index
+  ( const uint8_t *mem, size_t size, htsmsg_t **idx, epgdb_chunk_t **ret )
+{
+  const uint8_t *tp = mem + size - 4;
+  size_t len, end;
+  htsmsg_t *l, *m;
+  htsmsg_field_t *f;
+  epgdb_chunk_t *c;
+  int64_t s64, len64;
+  int n = 0;
+
+  if (size < 8) return -1;
+  len = (tp[0] << 24) | (tp[1] << 16) | (tp[2] << 8) | tp[3];
+  if (len < 4 || len > size - 4) return -1;
+  end = size - 4 - len;
+  if (!(*idx = htsmsg_binary_deserialize(mem + end + 4, len - 4, NULL)))
+    return -1;
+  if (!(l = htsmsg_get_list(*idx, "chunks"))) return -1;
+
+  HTSMSG_FOREACH(f, l) n++;
+  *ret = c = calloc(n ?: 1, sizeof(epgdb_chunk_t));
+  HTSMSG_FOREACH(f, l) {
+    if (!(m = htsmsg_field_get_map(f)) ||
+        !(c->sect = htsmsg_get_str(m, "section")) ||
+        htsmsg_get_s64(m, "offset", &s64) ||
+        htsmsg_get_u32(m, "count", &c->count) ||
+        s64 < 0 || s64 > end ||
+        (c > *ret && mem + s64 < c[-1].data))
+      return -1;
+    c->data = mem + s64;
+    /* Older files have no size, the chunk runs up to the next one */
+    if (htsmsg_get_s64(m, "size", &len64))
+      len64 = 0;
+    else if (len64 <= 0 || s64 + len64 > end)
+      return -1;
+    c->len = len64;
+    c++;
+  }
+
+  /* Each record takes at least its 4 byte length and some data */
+  for (c = *ret; c < *ret + n; c++) {
+    if (!c->len)
+      c->len = (c + 1 < *ret + n ? c[1].data : mem + end) - c->data;
+    else if (c + 1 < *ret + n && c->data + c->len > c[1].data)
+      return -1;
+    if (c->count > c->len / 5)
+      return -1;
+  }
+  return n;
+}
+
+static int _epgdb_v3_load
+  ( const uint8_t *mem, size_t size, epggrab_stats_t *stats )
+{
+  epgdb_loader_t l;
+  epgdb_chunk_t *c = NULL;
+  htsmsg_t *idx = NULL;
+  pthread_t tids[EPG_DB_WORKERS];
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  int i, workers = MAX(1, MIN(EPG_DB_WORKERS, cpus));
+  uint32_t j;
+  int ret = 0;
+
+  /* Without a usable index the records (and section markers) are read
+     in sequence, like v2, up to the index if it can be located */
+  if ((l.count = _epgdb_v3_index(mem, size, &idx, &c)) < 0) {
+    tvhlog(LOG_ERR, "epgdb", "index corrupted, sequential load");
+    if (idx) htsmsg_destroy(idx);
+    free(c);
+    if (size >= 8) {
+      const uint8_t *tp = mem + size - 4;
+      size_t len = (tp[0] << 24) | (tp[1] << 16) | (tp[2] << 8) | tp[3];
+      if (len >= 4 && len <= size - 4)
+        size -= len + 4;
+    }
+    _epgdb_v2_load(mem, size, stats);
+    return 0;
+  }
+  pthread_mutex_init(&l.lock, NULL);
+  pthread_cond_init(&l.cond, NULL);
+  l.chunks   = c;
+  l.next     = 0;
+  l.consumed = 0;
+  for (i = 0; i < workers; i++)
+    tvhthread_create(&tids[i], NULL, _epgdb_v3_thread, &l, 0);
+
+  /* Create objects in file order so references resolve */
+  for (i = 0; i < l.count; i++) {
+    pthread_mutex_lock(&l.lock);
+    while (!c[i].done)
+      pthread_cond_wait(&l.cond, &l.lock);
+    pthread_mutex_unlock(&l.lock);
+
+    for (j = 0; j < c[i].count; j++)
+      if (c[i].msgs[j]) {
+        _epgdb_process(c[i].sect, c[i].msgs[j], stats);
+        htsmsg_destroy(c[i].msgs[j]);
+      }
+    free(c[i].msgs);
+    ret |= c[i].corrupt;
+
+    pthread_mutex_lock(&l.lock);
+    l.consumed = i + 1;
+    pthread_cond_broadcast(&l.cond);
+    pthread_mutex_unlock(&l.lock);
+  }
+
+  for (i = 0; i < workers; i++)
+    pthread_join(tids[i], NULL);
+  pthread_cond_destroy(&l.cond);
+  pthread_mutex_destroy(&l.lock);
+  htsmsg_destroy(idx);
+  free(c);
+  return ret ? -1 : 0;
+}
+
 /*
  * Load data
  */
@@ -145,8 +388,7 @@ void epg_init ( void )
 {
   int fd = -1;
   struct stat st;
-  size_t remain;
-  uint8_t *mem, *rp;
+  uint8_t *mem;
   epggrab_stats_t stats;
   int ver = EPG_DB_VERSION;
 
@@ -172,8 +414,7 @@ void epg_init ( void )
     tvhlog(LOG_DEBUG, "epgdb", "database is empty");
     return;
   }
-  remain   = st.st_size;
-  rp = mem = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  mem = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
   if ( mem == MAP_FAILED ) {
     tvhlog(LOG_ERR, "epgdb", "failed to mmap database");
     return;
@@ -181,40 +422,16 @@ void epg_init ( void )
 
   /* Process */
   memset(&stats, 0, sizeof(stats));
-  while ( remain > 4 ) {
-
-    /* Get message length */
-    int msglen = (rp[0] << 24) | (rp[1] << 16) | (rp[2] << 8) | rp[3];
-    remain    -= 4;
-    rp        += 4;
-
-    /* Safety check */
-    if (msglen > remain) {
-      tvhlog(LOG_ERR, "epgdb", "corruption detected, some/all data lost");
+  switch (ver) {
+    case 3:
+      if (_epgdb_v3_load(mem, st.st_size, &stats))
+        tvhlog(LOG_ERR, "epgdb", "corruption detected, some/all data lost");
+      break;
+    case 2:
+      _epgdb_v2_load(mem, st.st_size, &stats);
+      break;
+    default:
       break;
-    }
-    
-    /* Extract message */
-    htsmsg_t *m = htsmsg_binary_deserialize(rp, msglen, NULL);
-
-    /* Next */
-    rp     += msglen;
-    remain -= msglen;
-
-    /* Skip */
-    if (!m) continue;
-
-    /* Process */
-    switch (ver) {
-      case 2:
-        _epgdb_v2_process(m, &stats);
-        break;
-      default:
-        break;
-    }
-
-    /* Cleanup */
-    htsmsg_destroy(m);
   }
 
   /* Stats */
@@ -234,84 +451,285 @@ void epg_init ( void )
  * Save
  * *************************************************************************/
 
-static int _epg_write ( int fd, htsmsg_t *m )
+#define EPG_SAVE_BUFSIZE (256 * 1024)
+
+/*
+ * The snapshot is taken under global_lock, serialization and disk I/O
+ * are done by the save thread
+ */
+static pthread_t       epgdb_save_tid;
+static pthread_mutex_t epgdb_save_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  epgdb_save_cond  = PTHREAD_COND_INITIALIZER;
+static htsmsg_t       *epgdb_save_pending;
+static int             epgdb_save_run;
+
+static void _epg_snapshot_sect ( htsmsg_t *snap, const char *sect )
+{
+  htsmsg_t *m = htsmsg_create_map();
+  htsmsg_add_str(m, "__section__", sect);
+  htsmsg_add_msg(snap, NULL, m);
+}
+
+static void _epg_snapshot ( htsmsg_t *snap, htsmsg_t *m )
+{
+  if (m) htsmsg_add_msg(snap, NULL, m);
+}
+
+typedef struct epgdb_writer {
+  int      fd;
+  uint8_t *buf;
+  size_t   len;           /* Bytes buffered */
+  size_t   off;           /* File offset, including the buffer */
+} epgdb_writer_t;
+
+static int _epg_write_data ( epgdb_writer_t *w, const void *data, size_t len )
+{
+  int ret = 0;
+
+  if (w->len + len > EPG_SAVE_BUFSIZE) {
+    ret    = tvh_write(w->fd, w->buf, w->len);
+    w->len = 0;
+  }
+  if (!ret && len > EPG_SAVE_BUFSIZE) {
+    ret = tvh_write(w->fd, data, len);
+  } else if (!ret) {
+    memcpy(w->buf + w->len, data, len);
+    w->len += len;
+  }
+  w->off += len;
+  return ret;
+}
+
+static int _epg_write ( epgdb_writer_t *w, htsmsg_t *m )
 {
-  int ret = 1;
   size_t msglen;
   void *msgdata;
-  if (m) {
-    int r = htsmsg_binary_serialize(m, &msgdata, &msglen, 0x10000);
-    htsmsg_destroy(m);
-    if (!r) {
-      ret = tvh_write(fd, msgdata, msglen);
-      free(msgdata);
+  int ret;
+
+  if (htsmsg_binary_serialize(m, &msgdata, &msglen, 0x10000))
+    return 1;
+  ret = _epg_write_data(w, msgdata, msglen);
+  free(msgdata);
+  return ret;
+}
+
+/*
+ * Close the current chunk and add it to the index
+ */
+static void _epg_write_chunk
+  ( htsmsg_t *idx, const char *sect, size_t off, size_t end, uint32_t count )
+{
+  htsmsg_t *m;
+
+  if (!count) return;
+  m = htsmsg_create_map();
+  htsmsg_add_str(m, "section", sect);
+  htsmsg_add_s64(m, "offset", off);
+  htsmsg_add_s64(m, "size", end - off);
+  htsmsg_add_u32(m, "count", count);
+  htsmsg_add_msg(idx, NULL, m);
+}
+
+/*
+ * Write the index record, followed by its length so the loader can
+ * find it from the end of the file. Its size grows with the database,
+ * so it isn't held to the record size limit
+ */
+static int _epg_write_index ( epgdb_writer_t *w, htsmsg_t *idx )
+{
+  htsmsg_t *m = htsmsg_create_map();
+  size_t off = w->off, msglen;
+  void *msgdata;
+  uint8_t len[4];
+  int ret;
+
+  htsmsg_add_msg(m, "chunks", idx);
+  ret = htsmsg_binary_serialize(m, &msgdata, &msglen, INT_MAX);
+  htsmsg_destroy(m);
+  if (ret) return 1;
+  ret = _epg_write_data(w, msgdata, msglen);
+  free(msgdata);
+  if (ret) return ret;
+  off = w->off - off;
+  len[0] = off >> 24;
+  len[1] = off >> 16;
+  len[2] = off >> 8;
+  len[3] = off;
+  return _epg_write_data(w, len, 4);
+}
+
+/*
+ * Write the snapshot to a temporary file and move it into place
+ */
+static void _epg_save_snapshot ( htsmsg_t *snap )
+{
+  int ret = 0;
+  char path[256], tmppath[sizeof(path) + 4], sect[32] = "";
+  htsmsg_field_t *f;
+  htsmsg_t *m, *idx;
+  const char *s;
+  epgdb_writer_t w;
+  size_t chunk_off = 0;
+  uint32_t chunk_count = 0;
+  int64_t start = getmonoclock();
+
+  if (hts_settings_buildpath(path, sizeof(path), "epgdb.v%d", EPG_DB_VERSION)) {
+    htsmsg_destroy(snap);
+    return;
+  }
+  snprintf(tmppath, sizeof(tmppath), "%s.tmp", path);
+  if (hts_settings_makedirs(tmppath) ||
+      (w.fd = tvh_open(tmppath, O_CREAT | O_TRUNC | O_WRONLY, 0700)) < 0) {
+    tvhlog(LOG_ERR, "epgdb", "failed to store epg to disk");
+    htsmsg_destroy(snap);
+    return;
+  }
+
+  w.buf = malloc(EPG_SAVE_BUFSIZE);
+  w.len = w.off = 0;
+  idx   = htsmsg_create_list();
+
+  /* Records are split into chunks per section that the loader decodes
+     independently, the section markers are kept between them for a
+     sequential load. Free as we go, the snapshot can be large */
+  while ((f = TAILQ_FIRST(&snap->hm_fields))) {
+    m = htsmsg_field_get_map(f);
+    if ((s = htsmsg_get_str(m, "__section__"))) {
+      _epg_write_chunk(idx, sect, chunk_off, w.off, chunk_count);
+      snprintf(sect, sizeof(sect), "%s", s);
+      chunk_count = 0;
+      if (!ret)
+        ret = _epg_write(&w, m);
+    } else if (!ret) {
+      if (chunk_count == EPG_DB_CHUNK) {
+        _epg_write_chunk(idx, sect, chunk_off, w.off, chunk_count);
+        chunk_count = 0;
+      }
+      if (!chunk_count)
+        chunk_off = w.off;
+      ret = _epg_write(&w, m);
+      chunk_count++;
     }
-  } else {
-    ret = 0;
+    htsmsg_field_destroy(snap, f);
   }
-  if(ret) {
+  htsmsg_destroy(snap);
+  _epg_write_chunk(idx, sect, chunk_off, w.off, chunk_count);
+  if (!ret)
+    ret = _epg_write_index(&w, idx);
+  else
+    htsmsg_destroy(idx);
+  if (!ret && w.len)
+    ret = tvh_write(w.fd, w.buf, w.len);
+  free(w.buf);
+  if (!ret)
+    ret = fsync(w.fd);
+  close(w.fd);
+
+  if (ret || rename(tmppath, path)) {
     tvhlog(LOG_ERR, "epgdb", "failed to store epg to disk");
-    close(fd);
-    hts_settings_remove("epgdb.v%d", EPG_DB_VERSION);
+    unlink(tmppath);
+    return;
   }
-  return ret;
+  tvhlog(LOG_DEBUG, "epgdb", "written in %"PRId64"ms",
+         (getmonoclock() - start) / 1000);
 }
 
-static int _epg_write_sect ( int fd, const char *sect )
+static void *_epg_save_thread ( void *p )
 {
-  htsmsg_t *m = htsmsg_create_map();
-  htsmsg_add_str(m, "__section__", sect);
-  return _epg_write(fd, m);
+  htsmsg_t *snap;
+
+  pthread_mutex_lock(&epgdb_save_mutex);
+  while (epgdb_save_run || epgdb_save_pending) {
+    if (!(snap = epgdb_save_pending)) {
+      pthread_cond_wait(&epgdb_save_cond, &epgdb_save_mutex);
+      continue;
+    }
+    epgdb_save_pending = NULL;
+    pthread_mutex_unlock(&epgdb_save_mutex);
+    _epg_save_snapshot(snap);
+    pthread_mutex_lock(&epgdb_save_mutex);
+  }
+  pthread_mutex_unlock(&epgdb_save_mutex);
+  return NULL;
 }
 
 void epg_save ( void *p )
 {
-  int fd;
+  htsmsg_t *snap;
   epg_object_t *eo;
   epg_broadcast_t *ebc;
   channel_t *ch;
   epggrab_stats_t stats;
+  int64_t start = getmonoclock();
   extern gtimer_t epggrab_save_timer;
 
   if (epggrab_epgdb_periodicsave)
     gtimer_arm(&epggrab_save_timer, epg_save, NULL, epggrab_epgdb_periodicsave);
   
-  fd = hts_settings_open_file(1, "epgdb.v%d", EPG_DB_VERSION);
+  snap = htsmsg_create_list();
 
   memset(&stats, 0, sizeof(stats));
-  if ( _epg_write_sect(fd, "brands") ) return;
+  _epg_snapshot_sect(snap, "brands");
   RB_FOREACH(eo,  &epg_brands, uri_link) {
-    if (_epg_write(fd, epg_brand_serialize((epg_brand_t*)eo))) return;
+    _epg_snapshot(snap, epg_brand_serialize((epg_brand_t*)eo));
     stats.brands.total++;
   }
-  if ( _epg_write_sect(fd, "seasons") ) return;
+  _epg_snapshot_sect(snap, "seasons");
   RB_FOREACH(eo,  &epg_seasons, uri_link) {
-    if (_epg_write(fd, epg_season_serialize((epg_season_t*)eo))) return;
+    _epg_snapshot(snap, epg_season_serialize((epg_season_t*)eo));
     stats.seasons.total++;
   }
-  if ( _epg_write_sect(fd, "episodes") ) return;
+  _epg_snapshot_sect(snap, "episodes");
   RB_FOREACH(eo,  &epg_episodes, uri_link) {
-    if (_epg_write(fd, epg_episode_serialize((epg_episode_t*)eo))) return;
+    _epg_snapshot(snap, epg_episode_serialize((epg_episode_t*)eo));
     stats.episodes.total++;
   }
-  if ( _epg_write_sect(fd, "serieslinks") ) return;
+  _epg_snapshot_sect(snap, "serieslinks");
   RB_FOREACH(eo, &epg_serieslinks, uri_link) {
-    if (_epg_write(fd, epg_serieslink_serialize((epg_serieslink_t*)eo)))
-      return;
+    _epg_snapshot(snap, epg_serieslink_serialize((epg_serieslink_t*)eo));
     stats.seasons.total++;
   }
-  if ( _epg_write_sect(fd, "broadcasts") ) return;
+  _epg_snapshot_sect(snap, "broadcasts");
   CHANNEL_FOREACH(ch) {
     RB_FOREACH(ebc, &ch->ch_epg_schedule, sched_link) {
-      if (_epg_write(fd, epg_broadcast_serialize(ebc))) return;
+      _epg_snapshot(snap, epg_broadcast_serialize(ebc));
       stats.broadcasts.total++;
     }
   }
 
+  /* Hand over, a snapshot not yet written is superseded */
+  pthread_mutex_lock(&epgdb_save_mutex);
+  if (!epgdb_save_run) {
+    epgdb_save_run = 1;
+    tvhthread_create(&epgdb_save_tid, NULL, _epg_save_thread, NULL, 0);
+  }
+  if (epgdb_save_pending)
+    htsmsg_destroy(epgdb_save_pending);
+  epgdb_save_pending = snap;
+  pthread_cond_signal(&epgdb_save_cond);
+  pthread_mutex_unlock(&epgdb_save_mutex);
+
   /* Stats */
-  tvhlog(LOG_INFO, "epgdb", "saved");
+  tvhlog(LOG_INFO, "epgdb", "saved (%"PRId64"ms under lock)",
+         (getmonoclock() - start) / 1000);
   tvhlog(LOG_INFO, "epgdb", "  brands     %d", stats.brands.total);
   tvhlog(LOG_INFO, "epgdb", "  seasons    %d", stats.seasons.total);
   tvhlog(LOG_INFO, "epgdb", "  episodes   %d", stats.episodes.total);
   tvhlog(LOG_INFO, "epgdb", "  broadcasts %d", stats.broadcasts.total);
 }
+
+/*
+ * Wait for the last snapshot to reach the disk
+ */
+void epg_done ( void )
+{
+  pthread_mutex_lock(&epgdb_save_mutex);
+  if (!epgdb_save_run) {
+    pthread_mutex_unlock(&epgdb_save_mutex);
+    return;
+  }
+  epgdb_save_run = 0;
+  pthread_cond_signal(&epgdb_save_cond);
+  pthread_mutex_unlock(&epgdb_save_mutex);
+  pthread_join(epgdb_save_tid, NULL);
+}
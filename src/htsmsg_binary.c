@@ -179,11 +179,49 @@ htsmsg_binary_count(htsmsg_t *msg)
 }
 
 
+/*
+ * Binary fields to be referenced by an iovec rather than copied
+ */
+typedef struct htsmsg_binary_iov {
+  struct iovec *iov;
+  int           cnt;
+  int           max;
+  uint8_t      *seg;   /* Start of the pending (copied) segment */
+} htsmsg_binary_iov_t;
+
+static inline int
+htsmsg_binary_iov_ref(htsmsg_binary_iov_t *hbi, size_t len)
+{
+  /* Two entries, and keep one for the final segment */
+  return hbi && len >= HTSMSG_BINARY_IOV_MIN && hbi->cnt + 3 <= hbi->max;
+}
+
+/*
+ * Number of bytes that will be referenced (simulates the write)
+ */
+static size_t
+htsmsg_binary_count_ref(htsmsg_t *msg, htsmsg_binary_iov_t *hbi)
+{
+  htsmsg_field_t *f;
+  size_t len = 0;
+
+  TAILQ_FOREACH(f, &msg->hm_fields, hmf_link) {
+    if(f->hmf_type == HMF_MAP || f->hmf_type == HMF_LIST) {
+      len += htsmsg_binary_count_ref(&f->hmf_msg, hbi);
+    } else if(f->hmf_type == HMF_BIN &&
+              htsmsg_binary_iov_ref(hbi, f->hmf_binsize)) {
+      hbi->cnt += 2;
+      len += f->hmf_binsize;
+    }
+  }
+  return len;
+}
+
 /*
  *
  */
-static void
-htsmsg_binary_write(htsmsg_t *msg, uint8_t *ptr)
+static uint8_t *
+htsmsg_binary_write(htsmsg_t *msg, uint8_t *ptr, htsmsg_binary_iov_t *hbi)
 {
   htsmsg_field_t *f;
   uint64_t u64;
@@ -234,14 +272,22 @@ htsmsg_binary_write(htsmsg_t *msg, uint8_t *ptr)
     switch(f->hmf_type) {
     case HMF_MAP:
     case HMF_LIST:
-      htsmsg_binary_write(&f->hmf_msg, ptr);
-      break;
+      ptr = htsmsg_binary_write(&f->hmf_msg, ptr, hbi);
+      continue;
 
     case HMF_STR:
       memcpy(ptr, f->hmf_str, l);
       break;
 
     case HMF_BIN:
+      if(htsmsg_binary_iov_ref(hbi, l)) {
+        hbi->iov[hbi->cnt].iov_base   = hbi->seg;
+        hbi->iov[hbi->cnt++].iov_len  = ptr - hbi->seg;
+        hbi->iov[hbi->cnt].iov_base   = (void *)f->hmf_bin;
+        hbi->iov[hbi->cnt++].iov_len  = l;
+        hbi->seg = ptr;
+        continue;
+      }
       memcpy(ptr, f->hmf_bin, l);
       break;
 
@@ -255,6 +301,7 @@ htsmsg_binary_write(htsmsg_t *msg, uint8_t *ptr)
     }
     ptr += l;
   }
+  return ptr;
 }
 
 
@@ -278,8 +325,51 @@ htsmsg_binary_serialize(htsmsg_t *msg, void **datap, size_t *lenp, int maxlen)
   data[2] = len >> 8;
   data[3] = len;
 
-  htsmsg_binary_write(msg, data + 4);
+  htsmsg_binary_write(msg, data + 4, NULL);
   *datap = data;
   *lenp  = len + 4;
   return 0;
 }
+
+
+/*
+ *
+ */
+int
+htsmsg_binary_serialize_iov(htsmsg_t *msg, void **datap,
+                            struct iovec *iov, int *iovcnt,
+                            size_t *lenp, int maxlen)
+{
+  htsmsg_binary_iov_t hbi = { .iov = iov, .cnt = 0, .max = *iovcnt };
+  size_t len, ref;
+  uint8_t *data, *end;
+
+  if(hbi.max < 1)
+    return -1;
+
+  len = htsmsg_binary_count(msg);
+  if(len + 4 > maxlen)
+    return -1;
+
+  ref = htsmsg_binary_count_ref(msg, &hbi);
+  hbi.cnt = 0;
+
+  data = malloc(len + 4 - ref);
+
+  data[0] = len >> 24;
+  data[1] = len >> 16;
+  data[2] = len >> 8;
+  data[3] = len;
+
+  hbi.seg = data;
+  end = htsmsg_binary_write(msg, data + 4, &hbi);
+  if(end > hbi.seg) {
+    iov[hbi.cnt].iov_base  = hbi.seg;
+    iov[hbi.cnt++].iov_len = end - hbi.seg;
+  }
+  *datap  = data;
+  *iovcnt = hbi.cnt;
+  if(lenp)
+    *lenp = len + 4;
+  return 0;
+}
@@ -19,6 +19,7 @@
 #ifndef HTSMSG_BINARY_H_
 #define HTSMSG_BINARY_H_
 
+#include <sys/uio.h>
 #include "htsmsg.h"
 
 /**
@@ -30,4 +31,18 @@ htsmsg_t *htsmsg_binary_deserialize(const void *data, size_t len,
 int htsmsg_binary_serialize(htsmsg_t *msg, void **datap, size_t *lenp,
 			    int maxlen);
 
+/**
+ * htsmsg_binary_serialize_iov
+ *
+ * As htsmsg_binary_serialize, but binary fields of at least
+ * HTSMSG_BINARY_IOV_MIN bytes are referenced in place by the iovec
+ * (max *iovcnt entries, on return the number used) rather than copied.
+ * *datap holds everything else and is to be freed once written.
+ */
+#define HTSMSG_BINARY_IOV_MIN 1024
+
+int htsmsg_binary_serialize_iov(htsmsg_t *msg, void **datap,
+                                struct iovec *iov, int *iovcnt,
+                                size_t *lenp, int maxlen);
+
 #endif /* HTSMSG_BINARY_H_ */
@@ -71,6 +71,12 @@ static void *htsp_server, *htsp_server_2;
 
 #define HTSP_PRIV_MASK (ACCESS_STREAMING)
 
+#define HTSP_WRITE_BATCH 16 // Max messages per writev()
+#define HTSP_WRITE_IOV   64 // Max iovec entries per writev()
+
+#define HTSP_SYNC_LOW    32 // Generate more initial sync below this queue
+#define HTSP_SYNC_CHUNK  64 // Initial sync messages per step
+
 extern char *dvr_storage;
 
 LIST_HEAD(htsp_connection_list, htsp_connection);
@@ -99,6 +105,9 @@ typedef struct htsp_msg {
 			   hm_msg can contain messages that points
 			   to packet payload so to avoid copy we
 			   keep a reference here */
+
+  int64_t hm_dts;       /* DTS of muxpkt (PTS_UNSET otherwise), for
+                           the queue delay */
 } htsp_msg_t;
 
 
@@ -112,6 +121,9 @@ typedef struct htsp_msg_q {
   int hmq_strict_prio;      /* Serve this queue 'til it's empty */
   int hmq_length;
   int hmq_payload;          /* Bytes of streaming payload that's enqueued */
+  int hmq_dts_count;        /* Messages with a DTS enqueued */
+  int64_t hmq_dts_head;     /* DTS of the oldest one enqueued */
+  int64_t hmq_dts_tail;     /* DTS of the last one enqueued */
 } htsp_msg_q_t;
 
 /**
@@ -137,6 +149,19 @@ typedef struct htsp_connection {
   int htsp_async_mode;
   LIST_ENTRY(htsp_connection) htsp_async_link;
 
+  /**
+   * Initial EPG sync, generated by the writer as the control queue
+   * drains (set with both global_lock and htsp_out_mutex held)
+   */
+  int htsp_sync;
+  int64_t htsp_sync_max_time;
+  int64_t htsp_sync_last_update;  /* != 0: walk EPG changes, else schedules */
+  uint32_t *htsp_sync_channels;   /* Channel ids at start, sorted */
+  int htsp_sync_channels_count;
+  int htsp_sync_channel;          /* Schedule cursor (channel index) */
+  time_t htsp_sync_time;          /* Cursor: last start or update time */
+  uint32_t htsp_sync_id;          /* Cursor: last object id (changes) */
+
   /**
    * Writer thread
    */
@@ -288,6 +313,7 @@ htsp_init_queue(htsp_msg_q_t *hmq, int strict_prio)
 {
   TAILQ_INIT(&hmq->hmq_q);
   hmq->hmq_length = 0;
+  hmq->hmq_dts_count = 0;
   hmq->hmq_strict_prio = strict_prio;
 }
 
@@ -312,6 +338,7 @@ htsp_flush_queue(htsp_connection_t *htsp, htsp_msg_q_t *hmq)
   // reset
   hmq->hmq_length = 0;
   hmq->hmq_payload = 0;
+  hmq->hmq_dts_count = 0;
   pthread_mutex_unlock(&htsp->htsp_out_mutex);
 }
 
@@ -348,7 +375,7 @@ htsp_subscription_destroy(htsp_connection_t *htsp, htsp_subscription_t *hs)
  */
 static void
 htsp_send(htsp_connection_t *htsp, htsmsg_t *m, pktbuf_t *pb,
-	  htsp_msg_q_t *hmq, int payloadsize)
+	  htsp_msg_q_t *hmq, int payloadsize, int64_t dts)
 {
   htsp_msg_t *hm = malloc(sizeof(htsp_msg_t));
 
@@ -357,6 +384,7 @@ htsp_send(htsp_connection_t *htsp, htsmsg_t *m, pktbuf_t *pb,
   if(pb != NULL)
     pktbuf_ref_inc(pb);
   hm->hm_payloadsize = payloadsize;
+  hm->hm_dts = dts;
   
   pthread_mutex_lock(&htsp->htsp_out_mutex);
 
@@ -374,6 +402,11 @@ htsp_send(htsp_connection_t *htsp, htsmsg_t *m, pktbuf_t *pb,
 
   hmq->hmq_length++;
   hmq->hmq_payload += payloadsize;
+  if(dts != PTS_UNSET) {
+    if(!hmq->hmq_dts_count++)
+      hmq->hmq_dts_head = dts;
+    hmq->hmq_dts_tail = dts;
+  }
   pthread_cond_signal(&htsp->htsp_out_cond);
   pthread_mutex_unlock(&htsp->htsp_out_mutex);
 }
@@ -384,7 +417,18 @@ htsp_send(htsp_connection_t *htsp, htsmsg_t *m, pktbuf_t *pb,
 static void
 htsp_send_message(htsp_connection_t *htsp, htsmsg_t *m, htsp_msg_q_t *hmq)
 {
-  htsp_send(htsp, m, NULL, hmq ?: &htsp->htsp_hmq_ctrl, 0);
+  htsp_send(htsp, m, NULL, hmq ?: &htsp->htsp_hmq_ctrl, 0, PTS_UNSET);
+}
+
+/**
+ * Delay (DTS span) of the queue (out mutex held)
+ */
+static int64_t
+htsp_queue_delay(htsp_msg_q_t *hmq)
+{
+  if(!hmq->hmq_dts_count)
+    return 0;
+  return MAX(0, hmq->hmq_dts_tail - hmq->hmq_dts_head);
 }
 
 /** 
@@ -862,6 +906,220 @@ htsp_method_getSysTime(htsp_connection_t *htsp, htsmsg_t *in)
   return out;
 }
 
+/* **************************************************************************
+ * Initial EPG sync
+ * *************************************************************************/
+
+static int
+htsp_sync_channel_cmp(const void *a, const void *b)
+{
+  uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+  return x < y ? -1 : (x > y);
+}
+
+/**
+ * Start initial EPG sync (global_lock held)
+ */
+static void
+htsp_sync_start(htsp_connection_t *htsp, int64_t lastUpdate, int64_t maxTime)
+{
+  channel_t *ch;
+  int n = 0;
+
+  htsp->htsp_sync_max_time    = maxTime;
+  htsp->htsp_sync_last_update = lastUpdate;
+  if (lastUpdate) {
+    htsp->htsp_sync_time = lastUpdate;
+    htsp->htsp_sync_id   = UINT32_MAX;
+  } else {
+    CHANNEL_FOREACH(ch)
+      n++;
+    htsp->htsp_sync_channels = malloc(MAX(n, 1) * sizeof(uint32_t));
+    n = 0;
+    CHANNEL_FOREACH(ch)
+      htsp->htsp_sync_channels[n++] = channel_get_id(ch);
+    qsort(htsp->htsp_sync_channels, n, sizeof(uint32_t), htsp_sync_channel_cmp);
+    htsp->htsp_sync_channels_count = n;
+    htsp->htsp_sync_channel = 0;
+    htsp->htsp_sync_time    = 0;
+  }
+
+  pthread_mutex_lock(&htsp->htsp_out_mutex);
+  htsp->htsp_sync = 1;
+  pthread_cond_signal(&htsp->htsp_out_cond);
+  pthread_mutex_unlock(&htsp->htsp_out_mutex);
+}
+
+/**
+ * Stop initial EPG sync (global_lock held)
+ */
+static void
+htsp_sync_stop(htsp_connection_t *htsp)
+{
+  pthread_mutex_lock(&htsp->htsp_out_mutex);
+  htsp->htsp_sync = 0;
+  pthread_mutex_unlock(&htsp->htsp_out_mutex);
+  free(htsp->htsp_sync_channels);
+  htsp->htsp_sync_channels = NULL;
+}
+
+/**
+ * Check if the sync has still to send the event, so async
+ * updates for it can be skipped (global_lock held)
+ */
+static int
+htsp_sync_pending(htsp_connection_t *htsp, epg_broadcast_t *ebc)
+{
+  epg_object_t *eo;
+  uint32_t id, *p;
+  int i;
+
+  if (!htsp->htsp_sync)
+    return 0;
+
+  if (htsp->htsp_sync_last_update) {
+    eo = epg_broadcast_get_last_update(ebc);
+    return eo->updated > htsp->htsp_sync_time ||
+           (eo->updated == htsp->htsp_sync_time && eo->id > htsp->htsp_sync_id);
+  }
+
+  if (!ebc->channel)
+    return 0;
+  id = channel_get_id(ebc->channel);
+  p = bsearch(&id, htsp->htsp_sync_channels, htsp->htsp_sync_channels_count,
+              sizeof(uint32_t), htsp_sync_channel_cmp);
+  if (!p)
+    return 0;
+  i = p - htsp->htsp_sync_channels;
+  return i > htsp->htsp_sync_channel ||
+         (i == htsp->htsp_sync_channel && ebc->start > htsp->htsp_sync_time);
+}
+
+/**
+ * Send the next schedule events, returns number of messages
+ */
+static int
+htsp_sync_schedules(htsp_connection_t *htsp)
+{
+  channel_t *ch;
+  epg_broadcast_t *ebc;
+  int n = 0;
+
+  while (n < HTSP_SYNC_CHUNK &&
+         htsp->htsp_sync_channel < htsp->htsp_sync_channels_count) {
+    ch  = channel_find_by_id(htsp->htsp_sync_channels[htsp->htsp_sync_channel]);
+    ebc = ch ? epg_broadcast_find_after(ch, htsp->htsp_sync_time) : NULL;
+    for ( ; ebc && n < HTSP_SYNC_CHUNK; ebc = epg_broadcast_get_next(ebc)) {
+      if (htsp->htsp_sync_max_time && ebc->start > htsp->htsp_sync_max_time) {
+        ebc = NULL;
+        break;
+      }
+      htsp_send_message(htsp, htsp_build_event(ebc, "eventAdd",
+                                               htsp->htsp_language, 0, htsp),
+                        NULL);
+      htsp->htsp_sync_time = ebc->start;
+      n++;
+    }
+    if (!ebc) {
+      htsp->htsp_sync_channel++;
+      htsp->htsp_sync_time = 0;
+    }
+  }
+  return n;
+}
+
+/**
+ * Send the event if this is its last change
+ */
+static int
+htsp_sync_change(htsp_connection_t *htsp, epg_broadcast_t *ebc,
+                 epg_object_t *eo)
+{
+  if (!ebc->channel || epg_broadcast_get_last_update(ebc) != eo)
+    return 0;
+  if (htsp->htsp_sync_max_time && ebc->start > htsp->htsp_sync_max_time)
+    return 0;
+  htsp_send_message(htsp, htsp_build_event(ebc, "eventAdd",
+                                           htsp->htsp_language, 0, htsp),
+                    NULL);
+  return 1;
+}
+
+/**
+ * Send the events of the next changes, returns number of messages
+ * or -1 when done
+ */
+static int
+htsp_sync_changes(htsp_connection_t *htsp)
+{
+  epg_object_t *eo;
+  epg_episode_t *ee;
+  epg_broadcast_t *ebc;
+  int n = 0;
+
+  eo = epg_object_find_by_update(htsp->htsp_sync_time, htsp->htsp_sync_id);
+  for ( ; eo && n < HTSP_SYNC_CHUNK; eo = epg_object_get_next_update(eo)) {
+    switch (eo->type) {
+    case EPG_BROADCAST:
+      n += htsp_sync_change(htsp, (epg_broadcast_t*)eo, eo);
+      break;
+    case EPG_EPISODE:
+      LIST_FOREACH(ebc, &((epg_episode_t*)eo)->broadcasts, ep_link)
+        n += htsp_sync_change(htsp, ebc, eo);
+      break;
+    case EPG_SEASON:
+      LIST_FOREACH(ee, &((epg_season_t*)eo)->episodes, slink)
+        LIST_FOREACH(ebc, &ee->broadcasts, ep_link)
+          n += htsp_sync_change(htsp, ebc, eo);
+      break;
+    case EPG_BRAND:
+      LIST_FOREACH(ee, &((epg_brand_t*)eo)->episodes, blink)
+        LIST_FOREACH(ebc, &ee->broadcasts, ep_link)
+          n += htsp_sync_change(htsp, ebc, eo);
+      break;
+    case EPG_SERIESLINK:
+      LIST_FOREACH(ebc, &((epg_serieslink_t*)eo)->broadcasts, sl_link)
+        n += htsp_sync_change(htsp, ebc, eo);
+      break;
+    default:
+      break;
+    }
+    htsp->htsp_sync_time = eo->updated;
+    htsp->htsp_sync_id   = eo->id;
+  }
+  return eo ? n : -1;
+}
+
+/**
+ * Writer: generate the next part of the initial sync
+ * (htsp_out_mutex held, released meanwhile)
+ */
+static void
+htsp_sync_step(htsp_connection_t *htsp)
+{
+  htsmsg_t *m;
+  int done;
+
+  pthread_mutex_unlock(&htsp->htsp_out_mutex);
+  pthread_mutex_lock(&global_lock);
+
+  if (htsp->htsp_sync) {
+    if (htsp->htsp_sync_last_update)
+      done = htsp_sync_changes(htsp) < 0;
+    else
+      done = htsp_sync_schedules(htsp) == 0;
+    if (done) {
+      htsp_sync_stop(htsp);
+      m = htsmsg_create_map();
+      htsmsg_add_str(m, "method", "initialSyncCompleted");
+      htsp_send_message(htsp, m, NULL);
+    }
+  }
+
+  pthread_mutex_unlock(&global_lock);
+  pthread_mutex_lock(&htsp->htsp_out_mutex);
+}
+
 /**
  * Switch the HTSP connection into async mode
  */
@@ -876,7 +1134,6 @@ htsp_method_async(htsp_connection_t *htsp, htsmsg_t *in)
   int64_t lastUpdate = 0;
   int64_t epgMaxTime = 0;
   const char *lang;
-  epg_broadcast_t *ebc;
 
   /* Get optional flags */
   htsmsg_get_u32(in, "epg", &epg);
@@ -913,14 +1170,13 @@ htsp_method_async(htsp_connection_t *htsp, htsmsg_t *in)
   LIST_FOREACH(de, &dvrentries, de_global_link)
     htsp_send_message(htsp, htsp_build_dvrentry(de, "dvrEntryAdd"), NULL);
 
-  /* Send EPG updates */
+  /* Insert in list so it will get all updates */
+  LIST_INSERT_HEAD(&htsp_async_connections, htsp, htsp_async_link);
+
+  /* Send EPG updates (the writer does it as the socket drains) */
   if (epg) {
-    CHANNEL_FOREACH(ch)
-      RB_FOREACH(ebc, &ch->ch_epg_schedule, sched_link) {
-        if (epgMaxTime && ebc->start > epgMaxTime) break;
-        htsmsg_t *e = htsp_build_event(ebc, "eventAdd", lang, lastUpdate, htsp);
-        if (e) htsp_send_message(htsp, e, NULL);
-      }
+    htsp_sync_start(htsp, lastUpdate, epgMaxTime);
+    return NULL;
   }
 
   /* Notify that initial sync has been completed */
@@ -928,9 +1184,6 @@ htsp_method_async(htsp_connection_t *htsp, htsmsg_t *in)
   htsmsg_add_str(m, "method", "initialSyncCompleted");
   htsp_send_message(htsp, m, NULL);
 
-  /* Insert in list so it will get all updates */
-  LIST_INSERT_HEAD(&htsp_async_connections, htsp, htsp_async_link);
-
   return NULL;
 }
 
@@ -1425,21 +1678,11 @@ htsp_method_subscribe(htsp_connection_t *htsp, htsmsg_t *in)
 
   streaming_target_t *st = &hs->hs_input;
 
-#if ENABLE_TIMESHIFT
-  if (timeshiftPeriod != 0) {
-    if (timeshiftPeriod == ~0)
-      tvhlog(LOG_DEBUG, "htsp", "using timeshift buffer (unlimited)");
-    else
-      tvhlog(LOG_DEBUG, "htsp", "using timeshift buffer (%u mins)", timeshiftPeriod / 60);
-    st = hs->hs_tshift = timeshift_create(st, timeshiftPeriod);
-    normts = 1;
-  }
-#endif
-
 #if ENABLE_LIBAV
-  if (transcoding_enabled) {
-    transcoder_props_t props;
+  transcoder_props_t props;
+  int transcode = 0;
 
+  if (transcoding_enabled) {
     props.tp_vcodec = streaming_component_txt2type(htsmsg_get_str(in, "videoCodec"));
     props.tp_acodec = streaming_component_txt2type(htsmsg_get_str(in, "audioCodec"));
     props.tp_scodec = streaming_component_txt2type(htsmsg_get_str(in, "subtitleCodec"));
@@ -1451,13 +1694,34 @@ htsp_method_subscribe(htsp_connection_t *htsp, htsmsg_t *in)
     if ((str = htsmsg_get_str(in, "language")))
       strncpy(props.tp_language, str, 3);
 
-    if(props.tp_vcodec != SCT_UNKNOWN ||
-       props.tp_acodec != SCT_UNKNOWN ||
-       props.tp_scodec != SCT_UNKNOWN) {
-      st = hs->hs_transcoder = transcoder_create(st);
-      transcoder_set_properties(st, &props);
-      normts = 1;
-    }
+    transcode = props.tp_vcodec != SCT_UNKNOWN ||
+                props.tp_acodec != SCT_UNKNOWN ||
+                props.tp_scodec != SCT_UNKNOWN;
+  }
+#endif
+
+#if ENABLE_TIMESHIFT
+  if (timeshiftPeriod != 0) {
+    void *key = ch;
+    if (timeshiftPeriod == ~0)
+      tvhlog(LOG_DEBUG, "htsp", "using timeshift buffer (unlimited)");
+    else
+      tvhlog(LOG_DEBUG, "htsp", "using timeshift buffer (%u mins)", timeshiftPeriod / 60);
+#if ENABLE_LIBAV
+    /* The transcoder feeds the buffer, so it can't be shared */
+    if (transcode)
+      key = NULL;
+#endif
+    st = hs->hs_tshift = timeshift_create(st, timeshiftPeriod, key);
+    normts = 1;
+  }
+#endif
+
+#if ENABLE_LIBAV
+  if (transcode) {
+    st = hs->hs_transcoder = transcoder_create(st);
+    transcoder_set_properties(st, &props);
+    normts = 1;
   }
 #endif
 
@@ -2046,14 +2310,21 @@ htsp_write_scheduler(void *aux)
 {
   htsp_connection_t *htsp = aux;
   htsp_msg_q_t *hmq;
-  htsp_msg_t *hm;
-  void *dptr;
-  size_t dlen;
+  htsp_msg_t *hm, *nhm, *hms[HTSP_WRITE_BATCH];
+  void *dptr[HTSP_WRITE_BATCH];
+  struct iovec iov[HTSP_WRITE_IOV];
+  int i, n, c, iovcnt, r;
 
   pthread_mutex_lock(&htsp->htsp_out_mutex);
 
   while(1) {
 
+    if(htsp->htsp_sync && htsp->htsp_writer_run &&
+       htsp->htsp_hmq_ctrl.hmq_length < HTSP_SYNC_LOW) {
+      htsp_sync_step(htsp);
+      continue;
+    }
+
     if((hmq = TAILQ_FIRST(&htsp->htsp_active_output_queues)) == NULL) {
       /* No active queues at all */
       if(!htsp->htsp_writer_run)
@@ -2064,37 +2335,64 @@ htsp_write_scheduler(void *aux)
       continue;
     }
 
-    hm = TAILQ_FIRST(&hmq->hmq_q);
-    TAILQ_REMOVE(&hmq->hmq_q, hm, hm_link);
-    hmq->hmq_length--;
-    hmq->hmq_payload -= hm->hm_payloadsize;
+    /* Take a batch of messages (same order as one at a time) */
+    n = 0;
+    do {
+      hm = TAILQ_FIRST(&hmq->hmq_q);
+      TAILQ_REMOVE(&hmq->hmq_q, hm, hm_link);
+      hmq->hmq_length--;
+      hmq->hmq_payload -= hm->hm_payloadsize;
+      if(hm->hm_dts != PTS_UNSET && --hmq->hmq_dts_count) {
+        /* The next message normally has the oldest DTS left, if it
+           hasn't one this one's DTS stands until the next dequeue */
+        nhm = TAILQ_FIRST(&hmq->hmq_q);
+        if(nhm->hm_dts != PTS_UNSET)
+          hmq->hmq_dts_head = nhm->hm_dts;
+      }
 
-    TAILQ_REMOVE(&htsp->htsp_active_output_queues, hmq, hmq_link);
-    if(hmq->hmq_length) {
-      /* Still messages to be sent, put back in active queues */
-      if(hmq->hmq_strict_prio) {
-	      TAILQ_INSERT_HEAD(&htsp->htsp_active_output_queues, hmq, hmq_link);
-      } else {
-        TAILQ_INSERT_TAIL(&htsp->htsp_active_output_queues, hmq, hmq_link);
+      TAILQ_REMOVE(&htsp->htsp_active_output_queues, hmq, hmq_link);
+      if(hmq->hmq_length) {
+        /* Still messages to be sent, put back in active queues */
+        if(hmq->hmq_strict_prio) {
+	        TAILQ_INSERT_HEAD(&htsp->htsp_active_output_queues, hmq, hmq_link);
+        } else {
+          TAILQ_INSERT_TAIL(&htsp->htsp_active_output_queues, hmq, hmq_link);
+        }
       }
-    }
+      hms[n++] = hm;
+    } while(n < HTSP_WRITE_BATCH &&
+            (hmq = TAILQ_FIRST(&htsp->htsp_active_output_queues)) != NULL);
 
     pthread_mutex_unlock(&htsp->htsp_out_mutex);
 
-    if (htsmsg_binary_serialize(hm->hm_msg, &dptr, &dlen, INT32_MAX) != 0) {
-      tvhlog(LOG_WARNING, "htsp", "%s: failed to serialize data",
-             htsp->htsp_logname);
+    /* Serialize, payloads are referenced (hm_pb) rather than copied */
+    iovcnt = 0;
+    for(i = 0; i < n; i++) {
+      c = HTSP_WRITE_IOV - iovcnt - (n - i - 1);
+      if (htsmsg_binary_serialize_iov(hms[i]->hm_msg, &dptr[i],
+                                      iov + iovcnt, &c, NULL, INT32_MAX)) {
+        tvhlog(LOG_WARNING, "htsp", "%s: failed to serialize data",
+               htsp->htsp_logname);
+        dptr[i] = NULL;
+        c = 0;
+      }
+      iovcnt += c;
     }
 
-    htsp_msg_destroy(hm);
+    r = tvh_writev(htsp->htsp_fd, iov, iovcnt);
 
-    if (tvh_write(htsp->htsp_fd, dptr, dlen)) {
+    for(i = 0; i < n; i++) {
+      htsp_msg_destroy(hms[i]);
+      free(dptr[i]);
+    }
+
+    if (r) {
       tvhlog(LOG_INFO, "htsp", "%s: Write error -- %s",
              htsp->htsp_logname, strerror(errno));
+      pthread_mutex_lock(&htsp->htsp_out_mutex);
       break;
     }
 
-    free(dptr);
     pthread_mutex_lock(&htsp->htsp_out_mutex);
   }
   // Shutdown socket to make receive thread terminate entire HTSP connection
@@ -2164,6 +2462,7 @@ htsp_serve(int fd, void **opaque, struct sockaddr_storage *source,
 
   if(htsp.htsp_async_mode)
     LIST_REMOVE(&htsp, htsp_async_link);
+  htsp_sync_stop(&htsp);
 
   LIST_REMOVE(&htsp, htsp_link);
 
@@ -2387,6 +2686,7 @@ htsp_event_add(epg_broadcast_t *ebc)
   htsmsg_t *m;
   LIST_FOREACH(htsp, &htsp_async_connections, htsp_async_link) {
     if (!(htsp->htsp_async_mode & HTSP_ASYNC_EPG)) continue;
+    if (htsp_sync_pending(htsp, ebc)) continue;
     m = htsp_build_event(ebc, "eventAdd", htsp->htsp_language, 0, htsp);
     htsp_send_message(htsp, m, NULL);
   }
@@ -2402,6 +2702,7 @@ htsp_event_update(epg_broadcast_t *ebc)
   htsmsg_t *m;
   LIST_FOREACH(htsp, &htsp_async_connections, htsp_async_link) {
     if (!(htsp->htsp_async_mode & HTSP_ASYNC_EPG)) continue;
+    if (htsp_sync_pending(htsp, ebc)) continue;
     m = htsp_build_event(ebc, "eventUpdate", htsp->htsp_language, 0, htsp);
     htsp_send_message(htsp, m, NULL);
   }
@@ -2432,9 +2733,8 @@ static void
 htsp_stream_deliver(htsp_subscription_t *hs, th_pkt_t *pkt)
 {
   htsmsg_t *m;
-  htsp_msg_t *hm;
   htsp_connection_t *htsp = hs->hs_htsp;
-  int64_t ts;
+  int64_t dts = PTS_UNSET, delay;
   int qlen = hs->hs_q.hmq_payload;
 
   if(!htsp_is_stream_enabled(hs, pkt->pkt_componentindex)) {
@@ -2468,7 +2768,7 @@ htsp_stream_deliver(htsp_subscription_t *hs, th_pkt_t *pkt)
   }
 
   if(pkt->pkt_dts != PTS_UNSET) {
-    int64_t dts = hs->hs_90khz ? pkt->pkt_dts : ts_rescale(pkt->pkt_dts, 1000000);
+    dts = hs->hs_90khz ? pkt->pkt_dts : ts_rescale(pkt->pkt_dts, 1000000);
     htsmsg_add_s64(m, "dts", dts);
   }
 
@@ -2483,7 +2783,8 @@ htsp_stream_deliver(htsp_subscription_t *hs, th_pkt_t *pkt)
    */
   htsmsg_add_binptr(m, "payload", pktbuf_ptr(pkt->pkt_payload),
 		    pktbuf_len(pkt->pkt_payload));
-  htsp_send(htsp, m, pkt->pkt_payload, &hs->hs_q, pktbuf_len(pkt->pkt_payload));
+  htsp_send(htsp, m, pkt->pkt_payload, &hs->hs_q, pktbuf_len(pkt->pkt_payload),
+            dts);
   atomic_add(&hs->hs_s->ths_bytes_out, pktbuf_len(pkt->pkt_payload));
 
   if(hs->hs_last_report != dispatch_clock) {
@@ -2503,36 +2804,23 @@ htsp_stream_deliver(htsp_subscription_t *hs, th_pkt_t *pkt)
      */
     
     pthread_mutex_lock(&htsp->htsp_out_mutex);
-
-    int64_t min_dts = PTS_UNSET;
-    int64_t max_dts = PTS_UNSET;
-    TAILQ_FOREACH(hm, &hs->hs_q.hmq_q, hm_link) {
-      if(!hm->hm_msg)
-	continue;
-      if(htsmsg_get_s64(hm->hm_msg, "dts", &ts))
-	continue;
-      if(ts == PTS_UNSET)
-	continue;
-  
-      if(min_dts == PTS_UNSET)
-	min_dts = ts;
-      else
-	min_dts = MIN(ts, min_dts);
-
-      if(max_dts == PTS_UNSET)
-	max_dts = ts;
-      else
-	max_dts = MAX(ts, max_dts);
-    }
-
-    htsmsg_add_s64(m, "delay", max_dts - min_dts);
-
+    delay = htsp_queue_delay(&hs->hs_q);
     pthread_mutex_unlock(&htsp->htsp_out_mutex);
 
+    htsmsg_add_s64(m, "delay", delay);
+
     htsmsg_add_u32(m, "Bdrops", hs->hs_dropstats[PKT_B_FRAME]);
     htsmsg_add_u32(m, "Pdrops", hs->hs_dropstats[PKT_P_FRAME]);
     htsmsg_add_u32(m, "Idrops", hs->hs_dropstats[PKT_I_FRAME]);
 
+    /* Also for the status API */
+    hs->hs_s->ths_queue_packets = hs->hs_q.hmq_length;
+    hs->hs_s->ths_queue_bytes   = hs->hs_q.hmq_payload;
+    hs->hs_s->ths_queue_delay   = hs->hs_90khz ? ts_rescale(delay, 1000000) : delay;
+    hs->hs_s->ths_queue_drops   = hs->hs_dropstats[PKT_B_FRAME] +
+                                  hs->hs_dropstats[PKT_P_FRAME] +
+                                  hs->hs_dropstats[PKT_I_FRAME];
+
     /* We use a special queue for queue status message so they're not
        blocked by anything else */
     htsp_send_message(hs->hs_htsp, m, &hs->hs_htsp->htsp_hmq_qstatus);
@@ -2607,7 +2895,7 @@ htsp_subscription_start(htsp_subscription_t *hs, const streaming_start_t *ss)
  
   htsmsg_add_str(m, "method", "subscriptionStart");
   htsmsg_add_u32(m, "subscriptionId", hs->hs_sid);
-  htsp_send(hs->hs_htsp, m, NULL, &hs->hs_q, 0);
+  htsp_send(hs->hs_htsp, m, NULL, &hs->hs_q, 0, PTS_UNSET);
 }
 
 /**
@@ -2624,7 +2912,7 @@ htsp_subscription_stop(htsp_subscription_t *hs, const char *err)
   if(err != NULL)
     htsmsg_add_str(m, "status", err);
 
-  htsp_send(hs->hs_htsp, m, NULL, &hs->hs_q, 0);
+  htsp_send(hs->hs_htsp, m, NULL, &hs->hs_q, 0, PTS_UNSET);
 }
 
 /**
@@ -2640,7 +2928,7 @@ htsp_subscription_status(htsp_subscription_t *hs, const char *err)
   if(err != NULL)
     htsmsg_add_str(m, "status", err);
 
-  htsp_send(hs->hs_htsp, m, NULL, &hs->hs_q, 0);
+  htsp_send(hs->hs_htsp, m, NULL, &hs->hs_q, 0, PTS_UNSET);
 }
 
 /**
@@ -2688,7 +2976,7 @@ htsp_subscription_speed(htsp_subscription_t *hs, int speed)
   htsmsg_add_str(m, "method", "subscriptionSpeed");
   htsmsg_add_u32(m, "subscriptionId", hs->hs_sid);
   htsmsg_add_u32(m, "speed", speed);
-  htsp_send(hs->hs_htsp, m, NULL, &hs->hs_q, 0);
+  htsp_send(hs->hs_htsp, m, NULL, &hs->hs_q, 0, PTS_UNSET);
 }
 
 /**
@@ -2714,7 +3002,7 @@ htsp_subscription_skip(htsp_subscription_t *hs, streaming_skip_t *skip)
     htsmsg_add_s64(m, "time", hs->hs_90khz ? skip->time : ts_rescale(skip->time, 1000000));
   else if (skip->type == SMT_SKIP_ABS_SIZE || skip->type == SMT_SKIP_REL_SIZE)
     htsmsg_add_s64(m, "size", skip->size);
-  htsp_send(hs->hs_htsp, m, NULL, &hs->hs_q, 0);
+  htsp_send(hs->hs_htsp, m, NULL, &hs->hs_q, 0, PTS_UNSET);
 }
 
 /**
@@ -2733,7 +3021,7 @@ htsp_subscription_timeshift_status(htsp_subscription_t *hs, timeshift_status_t *
     htsmsg_add_s64(m, "start", hs->hs_90khz ? status->pts_start : ts_rescale(status->pts_start, 1000000)) ;
   if (status->pts_end != PTS_UNSET)
     htsmsg_add_s64(m, "end", hs->hs_90khz ? status->pts_end : ts_rescale(status->pts_end, 1000000)) ;
-  htsp_send(hs->hs_htsp, m, NULL, &hs->hs_q, 0);
+  htsp_send(hs->hs_htsp, m, NULL, &hs->hs_q, 0, PTS_UNSET);
 }
 #endif
 
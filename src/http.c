@@ -28,6 +28,7 @@
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
+#include <sys/uio.h>
 
 #include "tvheadend.h"
 #include "tcp.h"
@@ -130,6 +131,7 @@ http_rc2str(int code)
   case HTTP_STATUS_UNAUTHORIZED:    return "Unauthorized";
   case HTTP_STATUS_BAD_REQUEST:     return "Bad request";
   case HTTP_STATUS_FOUND:           return "Found";
+  case HTTP_STATUS_NOT_MODIFIED:    return "Not Modified";
   default:
     return "Unknown returncode";
     break;
@@ -146,34 +148,31 @@ static const char *cachemonths[12] = {
 };
 
 /**
- * Transmit a HTTP reply
+ * Format the HTTP reply header, without the terminating empty line
  */
-void
-http_send_header(http_connection_t *hc, int rc, const char *content, 
-		 int64_t contentlen,
-		 const char *encoding, const char *location, 
-		 int maxage, const char *range,
-		 const char *disposition)
+static void
+http_build_header(htsbuf_queue_t *hdrs, http_connection_t *hc, int rc,
+		  const char *content, int64_t contentlen,
+		  const char *encoding, const char *location, 
+		  int maxage, const char *range,
+		  const char *disposition)
 {
   struct tm tm0, *tm;
-  htsbuf_queue_t hdrs;
   time_t t;
 
-  htsbuf_queue_init(&hdrs, 0);
-
-  htsbuf_qprintf(&hdrs, "%s %d %s\r\n", 
+  htsbuf_qprintf(hdrs, "%s %d %s\r\n", 
 		 val2str(hc->hc_version, HTTP_versiontab),
 		 rc, http_rc2str(rc));
 
-  htsbuf_qprintf(&hdrs, "Server: HTS/tvheadend\r\n");
+  htsbuf_qprintf(hdrs, "Server: HTS/tvheadend\r\n");
 
   if(maxage == 0) {
-    htsbuf_qprintf(&hdrs, "Cache-Control: no-cache\r\n");
+    htsbuf_qprintf(hdrs, "Cache-Control: no-cache\r\n");
   } else {
     time(&t);
 
     tm = gmtime_r(&t, &tm0);
-    htsbuf_qprintf(&hdrs, 
+    htsbuf_qprintf(hdrs, 
                 "Last-Modified: %s, %d %s %02d %02d:%02d:%02d GMT\r\n",
                 cachedays[tm->tm_wday], tm->tm_mday, 
                 cachemonths[tm->tm_mon], tm->tm_year + 1900,
@@ -182,47 +181,103 @@ http_send_header(http_connection_t *hc, int rc, const char *content,
     t += maxage;
 
     tm = gmtime_r(&t, &tm0);
-    htsbuf_qprintf(&hdrs, 
+    htsbuf_qprintf(hdrs, 
 		"Expires: %s, %d %s %02d %02d:%02d:%02d GMT\r\n",
 		cachedays[tm->tm_wday],	tm->tm_mday,
                 cachemonths[tm->tm_mon], tm->tm_year + 1900,
 		tm->tm_hour, tm->tm_min, tm->tm_sec);
       
-    htsbuf_qprintf(&hdrs, "Cache-Control: max-age=%d\r\n", maxage);
+    htsbuf_qprintf(hdrs, "Cache-Control: max-age=%d\r\n", maxage);
   }
 
   if(rc == HTTP_STATUS_UNAUTHORIZED)
-    htsbuf_qprintf(&hdrs, "WWW-Authenticate: Basic realm=\"tvheadend\"\r\n");
+    htsbuf_qprintf(hdrs, "WWW-Authenticate: Basic realm=\"tvheadend\"\r\n");
 
-  htsbuf_qprintf(&hdrs, "Connection: %s\r\n", 
+  htsbuf_qprintf(hdrs, "Connection: %s\r\n", 
 	      hc->hc_keep_alive ? "Keep-Alive" : "Close");
 
   if(encoding != NULL)
-    htsbuf_qprintf(&hdrs, "Content-Encoding: %s\r\n", encoding);
+    htsbuf_qprintf(hdrs, "Content-Encoding: %s\r\n", encoding);
 
   if(location != NULL)
-    htsbuf_qprintf(&hdrs, "Location: %s\r\n", location);
+    htsbuf_qprintf(hdrs, "Location: %s\r\n", location);
 
   if(content != NULL)
-    htsbuf_qprintf(&hdrs, "Content-Type: %s\r\n", content);
+    htsbuf_qprintf(hdrs, "Content-Type: %s\r\n", content);
 
   if(contentlen > 0)
-    htsbuf_qprintf(&hdrs, "Content-Length: %"PRId64"\r\n", contentlen);
+    htsbuf_qprintf(hdrs, "Content-Length: %"PRId64"\r\n", contentlen);
 
   if(range) {
-    htsbuf_qprintf(&hdrs, "Accept-Ranges: %s\r\n", "bytes");
-    htsbuf_qprintf(&hdrs, "Content-Range: %s\r\n", range);
+    htsbuf_qprintf(hdrs, "Accept-Ranges: %s\r\n", "bytes");
+    htsbuf_qprintf(hdrs, "Content-Range: %s\r\n", range);
   }
 
   if(disposition != NULL)
-    htsbuf_qprintf(&hdrs, "Content-Disposition: %s\r\n", disposition);
+    htsbuf_qprintf(hdrs, "Content-Disposition: %s\r\n", disposition);
   
+}
+
+
+/**
+ * Transmit a HTTP reply
+ */
+void
+http_send_header(http_connection_t *hc, int rc, const char *content, 
+		 int64_t contentlen,
+		 const char *encoding, const char *location, 
+		 int maxage, const char *range,
+		 const char *disposition)
+{
+  htsbuf_queue_t hdrs;
+
+  htsbuf_queue_init(&hdrs, 0);
+
+  http_build_header(&hdrs, hc, rc, content, contentlen, encoding, location,
+		    maxage, range, disposition);
   htsbuf_qprintf(&hdrs, "\r\n");
 
   tcp_write_queue(hc->hc_fd, &hdrs);
 }
 
 
+/**
+ * Transmit a complete reply for an in-memory entity that may be available
+ * in several encodings. Answers 304 if the client already holds it,
+ * otherwise the header and body go out in a single writev()
+ */
+void
+http_send_entity(http_connection_t *hc, const char *content,
+		 const char *encoding, const char *etag, int maxage,
+		 const void *data, size_t len)
+{
+  htsbuf_queue_t hdrs;
+  struct iovec iov[2];
+  const char *inm = http_arg_get(&hc->hc_args, "If-None-Match");
+  int rc = HTTP_STATUS_OK;
+
+  if(inm != NULL && (!strcmp(inm, "*") || strstr(inm, etag))) {
+    rc = HTTP_STATUS_NOT_MODIFIED;
+    content = encoding = NULL;
+    len = 0;
+  }
+
+  htsbuf_queue_init(&hdrs, 0);
+
+  http_build_header(&hdrs, hc, rc, content, len, encoding, NULL,
+		    maxage, NULL, NULL);
+  htsbuf_qprintf(&hdrs, "ETag: %s\r\nVary: Accept-Encoding\r\n\r\n", etag);
+
+  iov[0].iov_len  = hdrs.hq_size;
+  iov[0].iov_base = alloca(hdrs.hq_size);
+  htsbuf_read(&hdrs, iov[0].iov_base, hdrs.hq_size);
+  iov[1].iov_base = (void *)data;
+  iov[1].iov_len  = len;
+
+  tvh_writev(hc->hc_fd, iov, len && !hc->hc_no_output ? 2 : 1);
+}
+
+
 
 /**
  * Transmit a HTTP reply
@@ -350,6 +405,66 @@ http_exec(http_connection_t *hc, http_path_t *hp, char *remain)
   if(err == -1)
      return 1;
 
+  if(err == HTTP_SUSPEND)
+    return HTTP_SUSPEND;
+
+  if(err)
+    http_error(hc, err);
+  return 0;
+}
+
+/**
+ * Finish the request later, resume() is called from a worker thread
+ * once http_resume() is called and replies like the path callback.
+ * The path callback returns HTTP_SUSPEND after calling this.
+ */
+void
+http_suspend(http_connection_t *hc,
+             int (*resume)(http_connection_t *hc, void *opaque),
+             void *opaque)
+{
+  hc->hc_resume = resume;
+  hc->hc_resume_opaque = opaque;
+}
+
+/**
+ * Resume a suspended request (may be called before the path callback
+ * has returned)
+ */
+void
+http_resume(http_connection_t *hc)
+{
+  tcp_server_resume(hc->hc_tcp);
+}
+
+/**
+ * The reply takes long (e.g. a stream), its thread doesn't count against
+ * the worker limit until the path callback returns
+ */
+void
+http_release(http_connection_t *hc)
+{
+  tcp_server_release(hc->hc_tcp);
+}
+
+/**
+ * Run the resume callback of a suspended request
+ */
+static int
+http_exec_resume(http_connection_t *hc)
+{
+  int (*resume)(http_connection_t *hc, void *opaque) = hc->hc_resume;
+  int err;
+
+  hc->hc_resume = NULL;
+  err = resume(hc, hc->hc_resume_opaque);
+
+  if(err == -1)
+     return 1;
+
+  if(err == HTTP_SUSPEND)
+    return HTTP_SUSPEND;
+
   if(err)
     http_error(hc, err);
   return 0;
@@ -384,17 +499,17 @@ http_cmd_get(http_connection_t *hc)
 
 
 /**
- * Initial processing of HTTP POST
+ * Set up for the HTTP POST body, starting with whatever followed the
+ * header
  *
  * Return non-zero if we should disconnect
  */
 static int
-http_cmd_post(http_connection_t *hc, htsbuf_queue_t *spill)
+http_post_start(http_connection_t *hc)
 {
-  http_path_t *hp;
-  char *remain, *args, *v;
+  char *v;
+  size_t n;
 
-  /* Set keep-alive status */
   v = http_arg_get(&hc->hc_args, "Content-Length");
   if(v == NULL) {
     /* No content length in POST, make us disconnect */
@@ -414,8 +529,48 @@ http_cmd_post(http_connection_t *hc, htsbuf_queue_t *spill)
   hc->hc_post_data = malloc(hc->hc_post_len + 1);
   hc->hc_post_data[hc->hc_post_len] = 0;
 
-  if(tcp_read_data(hc->hc_fd, hc->hc_post_data, hc->hc_post_len, spill) < 0)
-    return -1;
+  n = MIN(hc->hc_post_len, hc->hc_rbuf_len - hc->hc_rbuf_off);
+  memcpy(hc->hc_post_data, hc->hc_rbuf + hc->hc_rbuf_off, n);
+  hc->hc_rbuf_off += n;
+  hc->hc_post_off  = n;
+  return 0;
+}
+
+
+/**
+ * Read the rest of the request body, only what's already available
+ *
+ * Returns 1 if the body is incomplete (call again when the socket is
+ * readable), -1 on errors
+ */
+static int
+http_read_data(http_connection_t *hc)
+{
+  ssize_t r;
+
+  while(hc->hc_post_off < hc->hc_post_len) {
+    r = recv(hc->hc_fd, hc->hc_post_data + hc->hc_post_off,
+             hc->hc_post_len - hc->hc_post_off, MSG_DONTWAIT);
+    if(r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+      return 1;
+    if(r < 1)
+      return -1;
+    hc->hc_post_off += r;
+  }
+  return 0;
+}
+
+
+/**
+ * Processing of HTTP POST, the body has been read
+ *
+ * Return non-zero if we should disconnect
+ */
+static int
+http_cmd_post(http_connection_t *hc)
+{
+  http_path_t *hp;
+  char *remain, *args, *v;
 
  /* Parse content-type */
   v = http_arg_get(&hc->hc_args, "Content-Type");
@@ -444,7 +599,7 @@ http_cmd_post(http_connection_t *hc, htsbuf_queue_t *spill)
  * Process a HTTP request
  */
 static int
-http_process_request(http_connection_t *hc, htsbuf_queue_t *spill)
+http_process_request(http_connection_t *hc)
 {
   switch(hc->hc_cmd) {
   default:
@@ -456,7 +611,7 @@ http_process_request(http_connection_t *hc, htsbuf_queue_t *spill)
     hc->hc_no_output = 1;
     return http_cmd_get(hc);
   case HTTP_CMD_POST:
-    return http_cmd_post(hc, spill);
+    return http_cmd_post(hc);
   }
 }
 
@@ -465,7 +620,7 @@ http_process_request(http_connection_t *hc, htsbuf_queue_t *spill)
  * clean up
  */
 static int
-process_request(http_connection_t *hc, htsbuf_queue_t *spill)
+process_request(http_connection_t *hc)
 {
   char *v, *argv[2];
   int n, rval = -1;
@@ -519,7 +674,7 @@ process_request(http_connection_t *hc, htsbuf_queue_t *spill)
 
   case HTTP_VERSION_1_0:
   case HTTP_VERSION_1_1:
-    rval = http_process_request(hc, spill);
+    rval = http_process_request(hc);
     break;
   }
   free(hc->hc_representative);
@@ -574,33 +729,6 @@ http_arg_set(struct http_arg_list *list, char *key, char *val)
 }
 
 
-/*
- * Split a string in components delimited by 'delimiter'
- */
-int
-http_tokenize(char *buf, char **vec, int vecsize, int delimiter)
-{
-  int n = 0;
-
-  while(1) {
-    while((*buf > 0 && *buf < 33) || *buf == delimiter)
-      buf++;
-    if(*buf == 0)
-      break;
-    vec[n++] = buf;
-    if(n == vecsize)
-      break;
-    while(*buf > 32 && *buf != delimiter)
-      buf++;
-    if(*buf == 0)
-      break;
-    *buf = 0;
-    buf++;
-  }
-  return n;
-}
-
-
 /**
  * Add a callback for a given "virtual path" on our HTTP server
  */
@@ -707,61 +835,83 @@ http_parse_get_args(http_connection_t *hc, char *args)
 }
 
 /**
+ * Parse the request line and header read by http_read_header()
  *
+ * Return non-zero if we should disconnect
  */
-static void
-http_serve_requests(http_connection_t *hc, htsbuf_queue_t *spill)
+static int
+http_parse_request(http_connection_t *hc)
 {
-  char *argv[3], *c, *cmdline = NULL, *hdrline = NULL;
-  int n;
+  char *argv[3];
 
-  htsbuf_queue_init(&hc->hc_reply, 0);
-
-  do {
-    hc->hc_no_output  = 0;
-
-    if (cmdline) free(cmdline);
-
-    if ((cmdline = tcp_read_line(hc->hc_fd, spill)) == NULL)
-      goto error;
-
-    if((n = http_tokenize(cmdline, argv, 3, -1)) != 3)
-      goto error;
-    
-    if((hc->hc_cmd = str2val(argv[0], HTTP_cmdtab)) == -1)
-      goto error;
-
-    hc->hc_url = argv[1];
-    if((hc->hc_version = str2val(argv[2], HTTP_versiontab)) == -1)
-      goto error;
+  if(http_parse_header(hc, argv))
+    return -1;
 
-    /* parse header */
-    while(1) {
-      if (hdrline) free(hdrline);
+  if((hc->hc_cmd = str2val(argv[0], HTTP_cmdtab)) == -1)
+    return -1;
 
-      if ((hdrline = tcp_read_line(hc->hc_fd, spill)) == NULL)
-        goto error;
+  hc->hc_url = argv[1];
+  if((hc->hc_version = str2val(argv[2], HTTP_versiontab)) == -1)
+    return -1;
 
-      if(!*hdrline)
-	      break; /* header complete */
+  return 0;
+}
 
-      if((n = http_tokenize(hdrline, argv, 2, -1)) < 2)
-	      continue;
+/**
+ * Serve requests until the connection has to wait, hc_state tells
+ * where to continue on the next call
+ */
+static int
+http_serve_requests(http_connection_t *hc)
+{
+  int n;
 
-      if((c = strrchr(argv[0], ':')) == NULL)
-	      goto error;
+  while(1) {
+    switch(hc->hc_state) {
+    case HTTP_CON_WAIT_REQUEST:
+      hc->hc_no_output = 0;
+      hc->hc_state = HTTP_CON_READ_HEADER;
+      /* fall through */
+    case HTTP_CON_READ_HEADER:
+      if((n = http_read_header(hc)) > 0)
+        return TCP_SERVER_PARK;
+      if(n || http_parse_request(hc))
+        return TCP_SERVER_CLOSE;
+      if(hc->hc_cmd == HTTP_CMD_POST) {
+        if(http_post_start(hc))
+          return TCP_SERVER_CLOSE;
+        hc->hc_state = HTTP_CON_POST_DATA;
+        continue;
+      }
+      n = process_request(hc);
+      break;
+    case HTTP_CON_POST_DATA:
+      if((n = http_read_data(hc)) > 0)
+        return TCP_SERVER_PARK;
+      if(n)
+        return TCP_SERVER_CLOSE;
+      n = process_request(hc);
+      break;
+    case HTTP_CON_SUSPENDED:
+      n = http_exec_resume(hc);
+      break;
+    default:
+      return TCP_SERVER_CLOSE;
+    }
 
-      *c = 0;
-      http_arg_set(&hc->hc_args, argv[0], argv[1]);
+    if(n == HTTP_SUSPEND) {
+      hc->hc_state = HTTP_CON_SUSPENDED;
+      return TCP_SERVER_SUSPEND;
     }
+    if(n)
+      return TCP_SERVER_CLOSE;
 
-    if(process_request(hc, spill))
-      break;
+    hc->hc_state = HTTP_CON_WAIT_REQUEST;
 
     free(hc->hc_post_data);
     hc->hc_post_data = NULL;
 
-    http_arg_flush(&hc->hc_args);
+    TAILQ_INIT(&hc->hc_args);
     http_arg_flush(&hc->hc_req_args);
 
     htsbuf_queue_flush(&hc->hc_reply);
@@ -772,53 +922,66 @@ http_serve_requests(http_connection_t *hc, htsbuf_queue_t *spill)
     free(hc->hc_password);
     hc->hc_password = NULL;
 
-  } while(hc->hc_keep_alive);
+    if(!hc->hc_keep_alive)
+      return TCP_SERVER_CLOSE;
 
-error:
-  free(hdrline);
-  free(cmdline);
+    /* Wait for the next request without a thread */
+    if(hc->hc_rbuf_off == hc->hc_rbuf_len) {
+      hc->hc_rbuf_off = hc->hc_rbuf_len = 0;
+      return TCP_SERVER_PARK;
+    }
+  }
 }
 
 
 /**
- *
+ * Called from the TCP worker pool whenever the connection is readable,
+ * between keep-alive requests the connection is parked
  */
-static void
+static int
 http_serve(int fd, void **opaque, struct sockaddr_storage *peer, 
 	   struct sockaddr_storage *self)
 {
-  htsbuf_queue_t spill;
-  http_connection_t hc;
-  
-  // Note: global_lock held on entry */
-  pthread_mutex_unlock(&global_lock);
-  memset(&hc, 0, sizeof(http_connection_t));
-  *opaque = &hc;
+  http_connection_t *hc = *opaque;
+
+  if(hc == NULL) {
+    hc = calloc(1, sizeof(http_connection_t));
+    *opaque = hc;
 
-  TAILQ_INIT(&hc.hc_args);
-  TAILQ_INIT(&hc.hc_req_args);
+    TAILQ_INIT(&hc->hc_args);
+    TAILQ_INIT(&hc->hc_req_args);
 
-  hc.hc_fd = fd;
-  hc.hc_peer = peer;
-  hc.hc_self = self;
+    hc->hc_fd = fd;
+    hc->hc_peer = peer;
+    hc->hc_self = self;
+    hc->hc_tcp = opaque;
 
-  htsbuf_queue_init(&spill, 0);
+    htsbuf_queue_init(&hc->hc_reply, 0);
+  }
+
+  return http_serve_requests(hc);
+}
+
+/**
+ * Connection closed (fd is closed by the caller)
+ */
+static void
+http_serve_stop(void *opaque)
+{
+  http_connection_t *hc = opaque;
 
-  http_serve_requests(&hc, &spill);
+  if(hc == NULL)
+    return;
 
-  http_arg_flush(&hc.hc_args);
-  http_arg_flush(&hc.hc_req_args);
+  http_arg_flush(&hc->hc_req_args);
 
-  htsbuf_queue_flush(&hc.hc_reply);
-  htsbuf_queue_flush(&spill);
-  close(fd);
+  htsbuf_queue_flush(&hc->hc_reply);
 
-  // Note: leave global_lock held for parent
-  pthread_mutex_lock(&global_lock);
-  free(hc.hc_post_data);
-  free(hc.hc_username);
-  free(hc.hc_password);
-  *opaque = NULL;
+  free(hc->hc_post_data);
+  free(hc->hc_username);
+  free(hc->hc_password);
+  free(hc->hc_rbuf);
+  free(hc);
 }
 
 #if 0
@@ -839,8 +1002,8 @@ void
 http_server_init(const char *bindaddr)
 {
   static tcp_server_ops_t ops = {
-    .start  = http_serve,
-    .stop   = NULL,
+    .serve  = http_serve,
+    .stop   = http_serve_stop,
     .status = NULL,
   };
   http_server = tcp_server_create(bindaddr, tvheadend_webui_port, &ops, NULL);
@@ -36,10 +36,16 @@ typedef struct http_arg {
 #define HTTP_STATUS_OK           200
 #define HTTP_STATUS_PARTIAL_CONTENT 206
 #define HTTP_STATUS_FOUND        302
+#define HTTP_STATUS_NOT_MODIFIED 304
 #define HTTP_STATUS_BAD_REQUEST  400
 #define HTTP_STATUS_UNAUTHORIZED 401
 #define HTTP_STATUS_NOT_FOUND    404
 
+#define HTTP_HDR_MAX   16384 /* Largest request header we accept */
+#define HTTP_HDR_ARGS  64    /* Max number of header lines */
+
+#define HTTP_SUSPEND   -2    /* Callback: reply later, see http_suspend() */
+
 
 typedef struct http_connection {
   int hc_fd;
@@ -52,16 +58,23 @@ typedef struct http_connection {
   int hc_keep_alive;
 
   htsbuf_queue_t hc_reply;
+  char *hc_rbuf;          /* Request read buffer */
+  size_t hc_rbuf_size;
+  size_t hc_rbuf_len;     /* Bytes read */
+  size_t hc_rbuf_off;     /* End of the current header / consumed body */
+  size_t hc_rbuf_line;    /* Start of the header line not yet scanned */
 
-  struct http_arg_list hc_args;
+  struct http_arg_list hc_args; /* Points into hc_rbuf */
+  http_arg_t hc_hdr_args[HTTP_HDR_ARGS];
 
   struct http_arg_list hc_req_args; /* Argumets from GET or POST request */
 
   enum {
     HTTP_CON_WAIT_REQUEST,
-    HTTP_CON_READ_HEADER,
+    HTTP_CON_READ_HEADER,  /* Header incomplete, parked */
     HTTP_CON_END,
-    HTTP_CON_POST_DATA,
+    HTTP_CON_POST_DATA,    /* Body incomplete, parked */
+    HTTP_CON_SUSPENDED,    /* Reply pending, see http_suspend() */
   } hc_state;
 
   enum {
@@ -93,9 +106,16 @@ typedef struct http_connection {
   
   char *hc_post_data;
   unsigned int hc_post_len;
+  unsigned int hc_post_off;  /* Bytes of hc_post_data read so far */
 
   struct rtsp *hc_rtsp_session;
 
+  /* Suspended request, the connection waits without a thread */
+
+  void **hc_tcp;          /* For tcp_server_resume() and release() */
+  int (*hc_resume)(struct http_connection *hc, void *opaque);
+  void *hc_resume_opaque;
+
 } http_connection_t;
 
 
@@ -107,6 +127,10 @@ void http_arg_set(struct http_arg_list *list, char *key, char *val);
 
 int http_tokenize(char *buf, char **vec, int vecsize, int delimiter);
 
+int http_read_header(http_connection_t *hc);
+
+int http_parse_header(http_connection_t *hc, char **cmd);
+
 void http_error(http_connection_t *hc, int error);
 
 void http_output_html(http_connection_t *hc);
@@ -120,9 +144,21 @@ void http_send_header(http_connection_t *hc, int rc, const char *content,
 		      const char *location, int maxage, const char *range,
 		      const char *disposition);
 
+void http_send_entity(http_connection_t *hc, const char *content,
+		      const char *encoding, const char *etag, int maxage,
+		      const void *data, size_t len);
+
 typedef int (http_callback_t)(http_connection_t *hc, 
 			      const char *remain, void *opaque);
 
+void http_suspend(http_connection_t *hc,
+                  int (*resume)(http_connection_t *hc, void *opaque),
+                  void *opaque);
+
+void http_resume(http_connection_t *hc);
+
+void http_release(http_connection_t *hc);
+
 typedef struct http_path {
   LIST_ENTRY(http_path) hp_link;
   const char *hp_path;
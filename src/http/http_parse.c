@@ -0,0 +1,161 @@
+/*
+ *  Tvheadend - HTTP request header parser
+ *  Copyright (C) 2014 Tvheadend Project
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+#include "tvheadend.h"
+#include "http.h"
+
+/*
+ * Split a string in components delimited by 'delimiter'
+ */
+int
+http_tokenize(char *buf, char **vec, int vecsize, int delimiter)
+{
+  int n = 0;
+
+  while(1) {
+    while((*buf > 0 && *buf < 33) || *buf == delimiter)
+      buf++;
+    if(*buf == 0)
+      break;
+    vec[n++] = buf;
+    if(n == vecsize)
+      break;
+    while(*buf > 32 && *buf != delimiter)
+      buf++;
+    if(*buf == 0)
+      break;
+    *buf = 0;
+    buf++;
+  }
+  return n;
+}
+
+/**
+ * Read until the empty line ending the request header, the header is
+ * left in hc_rbuf with hc_rbuf_off pointing just past it
+ *
+ * Only what's already available is read, returns 1 if the header is
+ * incomplete (call again when the socket is readable), -1 on errors
+ */
+int
+http_read_header(http_connection_t *hc)
+{
+  char *p;
+  size_t line = hc->hc_rbuf_line;
+  ssize_t r;
+
+  /* Move a pipelined request to the front */
+  if(hc->hc_rbuf_off) {
+    hc->hc_rbuf_len -= hc->hc_rbuf_off;
+    memmove(hc->hc_rbuf, hc->hc_rbuf + hc->hc_rbuf_off, hc->hc_rbuf_len);
+    hc->hc_rbuf_off = 0;
+    line = 0;
+  }
+
+  while(1) {
+    /* Scan complete lines once, looking for the empty one */
+    while(line < hc->hc_rbuf_len &&
+          (p = memchr(hc->hc_rbuf + line, '\n', hc->hc_rbuf_len - line))) {
+      if(p == hc->hc_rbuf + line ||
+         (p == hc->hc_rbuf + line + 1 && p[-1] == '\r')) {
+        hc->hc_rbuf_off = p + 1 - hc->hc_rbuf;
+        hc->hc_rbuf_line = 0;
+        return 0;
+      }
+      line = p + 1 - hc->hc_rbuf;
+    }
+    hc->hc_rbuf_line = line;
+
+    if(hc->hc_rbuf_len == hc->hc_rbuf_size) {
+      if(hc->hc_rbuf_size >= HTTP_HDR_MAX)
+        return -1;
+      hc->hc_rbuf_size = hc->hc_rbuf_size ? hc->hc_rbuf_size * 2 : 1024;
+      hc->hc_rbuf = realloc(hc->hc_rbuf, hc->hc_rbuf_size);
+    }
+
+    r = recv(hc->hc_fd, hc->hc_rbuf + hc->hc_rbuf_len,
+             hc->hc_rbuf_size - hc->hc_rbuf_len, MSG_DONTWAIT);
+    if(r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+      return 1;
+    if(r < 1)
+      return -1;
+    hc->hc_rbuf_len += r;
+  }
+}
+
+/**
+ * Cut the next line out of the header, in place
+ */
+static char *
+http_header_line(char **pp)
+{
+  char *s = *pp, *e = strchr(s, '\n');
+
+  if(e != NULL) {
+    *e = 0;
+    *pp = e + 1;
+  } else {
+    e = s + strlen(s);
+    *pp = e;
+  }
+  while(e > s && e[-1] < 32)
+    *--e = 0;
+  return s;
+}
+
+/**
+ * Split the header read by http_read_header() in place, the request
+ * line into cmd[3] and the header lines into hc_args
+ */
+int
+http_parse_header(http_connection_t *hc, char **cmd)
+{
+  char *argv[2], *c, *p;
+  http_arg_t *ra;
+
+  /* The header is terminated by an empty line, so every line ends in \n */
+  hc->hc_rbuf[hc->hc_rbuf_off - 1] = 0;
+  p = hc->hc_rbuf;
+
+  if(http_tokenize(http_header_line(&p), cmd, 3, -1) != 3)
+    return -1;
+
+  TAILQ_INIT(&hc->hc_args);
+  ra = hc->hc_hdr_args;
+  while(*p) {
+    if(http_tokenize(http_header_line(&p), argv, 2, -1) < 2)
+      continue;
+
+    if((c = strrchr(argv[0], ':')) == NULL ||
+       ra == hc->hc_hdr_args + HTTP_HDR_ARGS)
+      return -1;
+
+    *c = 0;
+    ra->key = argv[0];
+    ra->val = argv[1];
+    TAILQ_INSERT_TAIL(&hc->hc_args, ra, link);
+    ra++;
+  }
+  return 0;
+}
@@ -44,6 +44,7 @@ struct tvh_input_stream_stats
   int unc;    ///< Uncorrectable errors
   int snr;    ///< Signal 2 Noise (dB)
   int bps;    ///< Bandwidth (bps)
+  int cc;     ///< Continuity errors (e.g. lost RTP packets)
 };
 
 struct tvh_input_stream {
@@ -24,6 +24,7 @@
 #include "service.h"
 #include "mpegts/dvb.h"
 #include "subscriptions.h"
+#include "packet.h"
 
 #define MPEGTS_ONID_NONE        0xFFFF
 #define MPEGTS_TSID_NONE        0xFFFF
@@ -106,6 +107,38 @@ typedef struct mpegts_pid
   RB_ENTRY(mpegts_pid)     mp_link;
 } mpegts_pid_t;
 
+/*
+ * Precomputed packet routing for a single PID (see mm_pid_routes)
+ */
+typedef struct mpegts_pid_route
+{
+  int                 mpr_table;  // feed to table thread
+  int                 mpr_count;  // number of service consumers
+  struct {
+    int               idx;        // index into mm_pid_batch
+    int               table;      // passed through to ts_recv_packet1
+  }                   mpr_svcs[];
+} mpegts_pid_route_t;
+
+/*
+ * Batched packet delivery to a single service (see ts_recv_packets_batch)
+ */
+#define MPEGTS_BATCH_MAX 128
+
+typedef struct mpegts_pkt_vec
+{
+  const uint8_t      *mpv_tsb;
+  int                 mpv_table;
+  int                 mpv_pcr;    // store extracted PCR
+} mpegts_pkt_vec_t;
+
+typedef struct mpegts_pid_batch
+{
+  mpegts_service_t   *mpb_service;
+  int                 mpb_count;
+  mpegts_pkt_vec_t    mpb_vec[MPEGTS_BATCH_MAX];
+} mpegts_pid_batch_t;
+
 struct mpegts_table
 {
   /**
@@ -287,6 +320,15 @@ struct mpegts_mux
 
   RB_HEAD(, mpegts_pid)       mm_pids;
 
+  /*
+   * Flat PID routing table (indexed by PID), rebuilt by the input
+   * (under mi_delivery_mutex) whenever PIDs or services change
+   */
+  mpegts_pid_route_t        **mm_pid_routes;
+  int                         mm_pid_routes_dirty;
+  mpegts_pid_batch_t         *mm_pid_batch;
+  int                         mm_pid_batch_count;
+
   int                         mm_num_tables;
   LIST_HEAD(, mpegts_table)   mm_tables;
   TAILQ_HEAD(, mpegts_table)  mm_table_queue;
@@ -352,9 +394,10 @@ struct mpegts_service
 
   /**
    * When a subscription request SMT_MPEGTS, chunk them togeather 
-   * in order to recude load.
+   * in order to recude load. The chunk is filled in place and then
+   * shared (refcounted) between all the streaming targets.
    */
-  sbuf_t s_tsbuf;
+  pktbuf_t *s_tspb;
 
   /**
    * Average continuity errors
@@ -366,6 +409,11 @@ struct mpegts_service
    */
   int64_t  s_pcr_drift;
 
+  /**
+   * Last PCR seen on the PCR PID (s_stream_mutex)
+   */
+  int64_t  s_pcr_last;
+
 };
 
 /* **************************************************************************
@@ -595,6 +643,8 @@ void mpegts_mux_unsubscribe_by_name(mpegts_mux_t *mm, const char *name);
 
 mpegts_pid_t *mpegts_mux_find_pid(mpegts_mux_t *mm, int pid, int create);
 
+void mpegts_mux_flush_pid_routes(mpegts_mux_t *mm);
+
 size_t mpegts_input_recv_packets
   (mpegts_input_t *mi, mpegts_mux_instance_t *mmi, uint8_t *tsb, size_t len,
    int64_t *pcr, uint16_t *pcr_pid, const char *name);
@@ -21,6 +21,7 @@
 #include "tvhpoll.h"
 #include "tcp.h"
 #include "settings.h"
+#include "atomic.h"
 
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -39,9 +40,27 @@
 
 iptv_input_t    iptv_input;
 iptv_network_t  iptv_network;
-tvhpoll_t      *iptv_poll;
-pthread_t       iptv_thread;
-pthread_mutex_t iptv_lock;
+
+/*
+ * Input thread pool
+ *
+ * Each running mux is assigned to the least loaded input thread, each
+ * thread has its own poll instance and only per-mux locks are taken so
+ * that independent streams are processed in parallel.
+ *
+ * Note: thread assignment is protected by global_lock
+ */
+#define IPTV_THREADS_MAX 16
+
+struct iptv_thread
+{
+  tvhpoll_t *it_poll;
+  pthread_t  it_tid;
+  int        it_muxes;
+};
+
+static iptv_thread_t iptv_threads[IPTV_THREADS_MAX];
+static volatile int  iptv_bw_time;
 
 /* **************************************************************************
  * IPTV handlers
@@ -202,15 +221,14 @@ iptv_input_start_mux ( mpegts_input_t *mi, mpegts_mux_instance_t *mmi )
   }
 
   /* Start */
-  pthread_mutex_lock(&iptv_lock);
+  pthread_mutex_lock(&im->mm_iptv_lock);
   im->mm_active = mmi; // Note: must set here else mux_started call
                        // will not realise we're ready to accept pid open calls
+  im->im_handler = ih; // Note: mux_started call uses the buffer size
   ret            = ih->start(im, &url);
-  if (!ret)
-    im->im_handler = ih;
-  else
+  if (ret)
     im->mm_active  = NULL;
-  pthread_mutex_unlock(&iptv_lock);
+  pthread_mutex_unlock(&im->mm_iptv_lock);
 
   return ret;
 }
@@ -228,7 +246,7 @@ iptv_input_stop_mux ( mpegts_input_t *mi, mpegts_mux_instance_t *mmi )
   if (im->im_handler->stop)
     im->im_handler->stop(im);
 
-  pthread_mutex_lock(&iptv_lock);
+  pthread_mutex_lock(&im->mm_iptv_lock);
 
   /* Close file */
   if (im->mm_iptv_fd > 0) {
@@ -236,6 +254,12 @@ iptv_input_stop_mux ( mpegts_input_t *mi, mpegts_mux_instance_t *mmi )
     im->mm_iptv_fd = -1;
   }
 
+  /* Release thread */
+  if (im->mm_iptv_thread) {
+    im->mm_iptv_thread->it_muxes--;
+    im->mm_iptv_thread = NULL;
+  }
+
   /* Free memory */
   free(im->mm_iptv_tsb);
   im->mm_iptv_tsb = NULL;
@@ -243,7 +267,7 @@ iptv_input_stop_mux ( mpegts_input_t *mi, mpegts_mux_instance_t *mmi )
   /* Clear bw limit */
   iptv_network.in_bw_limited = 0;
 
-  pthread_mutex_unlock(&iptv_lock);
+  pthread_mutex_unlock(&im->mm_iptv_lock);
 }
 
 static void
@@ -259,10 +283,11 @@ iptv_input_thread ( void *aux )
   ssize_t len;
   size_t off;
   iptv_mux_t *im;
+  iptv_thread_t *it = aux;
   tvhpoll_event_t ev;
 
   while ( 1 ) {
-    nfds = tvhpoll_wait(iptv_poll, &ev, 1, -1);
+    nfds = tvhpoll_wait(it->it_poll, &ev, 1, -1);
     if ( nfds < 0 ) {
       tvhlog(LOG_ERR, "iptv", "poll() error %s, sleeping 1 second",
              strerror(errno));
@@ -273,43 +298,71 @@ iptv_input_thread ( void *aux )
     }
     im = ev.data.ptr;
 
-    pthread_mutex_lock(&iptv_lock);
+    pthread_mutex_lock(&im->mm_iptv_lock);
 
     /* No longer active */
-    if (!im->mm_active)
+    if (!im->mm_active || !im->mm_iptv_tsb)
       goto done;
 
     /* Get data */
     off = 0;
     if ((len = im->im_handler->read(im, &off)) < 0) {
       tvhlog(LOG_ERR, "iptv", "read() error %s", strerror(errno));
-      im->im_handler->stop(im);
+      if (im->im_handler->stop)
+        im->im_handler->stop(im);
       goto done;
     }
     iptv_input_recv_packets(im, off, len);
 
 done:
-    pthread_mutex_unlock(&iptv_lock);
+    pthread_mutex_unlock(&im->mm_iptv_lock);
   }
   return NULL;
 }
 
+/*
+ * Assign a mux to the least loaded input thread (starting it if required)
+ */
+static iptv_thread_t *
+iptv_input_thread_assign ( void )
+{
+  int i, num = iptv_network.in_threads;
+  iptv_thread_t *it = NULL;
+
+  if (!num)
+    num = sysconf(_SC_NPROCESSORS_ONLN);
+  num = MAX(1, MIN(num, IPTV_THREADS_MAX));
+
+  for (i = 0; i < num; i++)
+    if (!it || iptv_threads[i].it_muxes < it->it_muxes)
+      it = &iptv_threads[i];
+
+  if (!it->it_poll) {
+    it->it_poll = tvhpoll_create(10);
+    tvhthread_create(&it->it_tid, NULL, iptv_input_thread, it, 1);
+    tvhdebug("iptv", "started input thread %d", (int)(it - iptv_threads));
+  }
+  it->it_muxes++;
+  return it;
+}
+
 void
 iptv_input_recv_packets ( iptv_mux_t *im, size_t off, size_t len )
 {
-  static time_t t1 = 0, t2;
-  iptv_network.in_bps += len * 8;
-  time(&t2);
-  if (t2 != t1) {
+  int t, bps;
+
+  /* Bandwidth (shared by all input threads) */
+  atomic_add(&iptv_network.in_bps, len * 8);
+  t = (int)time(NULL);
+  if (t != iptv_bw_time && atomic_exchange(&iptv_bw_time, t) != t) {
+    bps = atomic_exchange(&iptv_network.in_bps, 0);
     if (iptv_network.in_max_bandwidth &&
-        iptv_network.in_bps > iptv_network.in_max_bandwidth * 1024) {
+        bps > iptv_network.in_max_bandwidth * 1024) {
       if (!iptv_network.in_bw_limited) {
         tvhinfo("iptv", "bandwidth limited exceeded");
         iptv_network.in_bw_limited = 1;
       }
     }
-    iptv_network.in_bps = 0;
-    t1 = t2;
   }
 
   /* Pass on */
@@ -330,16 +383,18 @@ iptv_input_mux_started ( iptv_mux_t *im )
 
   /* Allocate input buffer */
   im->mm_iptv_pos = 0;
-  im->mm_iptv_tsb = calloc(1, IPTV_PKT_SIZE);
+  im->mm_iptv_tsb = calloc(1, im->im_handler->buf_size ?: IPTV_PKT_SIZE);
 
   /* Setup poll */
   if (im->mm_iptv_fd > 0) {
     ev.fd       = im->mm_iptv_fd;
     ev.events   = TVHPOLL_IN;
     ev.data.ptr = im;
+    if (!im->mm_iptv_thread)
+      im->mm_iptv_thread = iptv_input_thread_assign();
 
     /* Error? */
-    if (tvhpoll_add(iptv_poll, &ev, 1) == -1) {
+    if (tvhpoll_add(im->mm_iptv_thread->it_poll, &ev, 1) == -1) {
       tvherror("iptv", "%s - failed to add to poll q", buf);
       close(im->mm_iptv_fd);
       im->mm_iptv_fd = -1;
@@ -381,6 +436,13 @@ const idclass_t iptv_network_class = {
       .off      = offsetof(iptv_network_t, in_max_bandwidth),
       .def.i    = 0,
     },
+    {
+      .type     = PT_U32,
+      .id       = "input_threads",
+      .name     = "Input Threads (0=auto)",
+      .off      = offsetof(iptv_network_t, in_threads),
+      .def.i    = 0,
+    },
     {}
   }
 };
@@ -464,10 +526,7 @@ void iptv_init ( void )
   /* Set table thread */
   tvhthread_create(&tid, NULL, mpegts_input_table_thread, &iptv_input, 1);
 
-  /* Setup TS thread */
-  iptv_poll = tvhpoll_create(10);
-  pthread_mutex_init(&iptv_lock, NULL);
-  tvhthread_create(&iptv_thread, NULL, iptv_input_thread, NULL, 1);
+  /* Note: TS threads are started on demand (iptv_input_thread_assign) */
 
   /* Load config */
   iptv_mux_load_all();
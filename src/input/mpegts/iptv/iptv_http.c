@@ -45,16 +45,18 @@ iptv_http_data
   size_t ret = len;
   iptv_mux_t *im = p;
 
-  pthread_mutex_lock(&iptv_lock);
+  pthread_mutex_lock(&im->mm_iptv_lock);
 
-  tsb = im->mm_iptv_tsb + im->mm_iptv_pos;
-  len = MIN(len, IPTV_PKT_SIZE   - im->mm_iptv_pos);
+  if (im->mm_iptv_tsb) {
+    tsb = im->mm_iptv_tsb + im->mm_iptv_pos;
+    len = MIN(len, IPTV_PKT_SIZE   - im->mm_iptv_pos);
 
-  memcpy(tsb, buf, len);
+    memcpy(tsb, buf, len);
 
-  iptv_input_recv_packets(im, 0, len);
+    iptv_input_recv_packets(im, 0, len);
+  }
 
-  pthread_mutex_unlock(&iptv_lock);
+  pthread_mutex_unlock(&im->mm_iptv_lock);
 
   return ret;
 }
@@ -98,6 +98,8 @@ iptv_mux_create ( const char *uuid, htsmsg_t *conf )
                       (mpegts_network_t*)&iptv_network,
                       MPEGTS_ONID_NONE, MPEGTS_TSID_NONE, conf);
 
+  pthread_mutex_init(&im->mm_iptv_lock, NULL);
+
   /* Callbacks */
   im->mm_display_name     = iptv_mux_display_name;
   im->mm_config_save      = iptv_mux_config_save;
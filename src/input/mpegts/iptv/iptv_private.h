@@ -27,13 +27,12 @@
 
 #define IPTV_PKT_SIZE (300*188)
 
-extern pthread_mutex_t iptv_lock;
-
 typedef struct iptv_input   iptv_input_t;
 typedef struct iptv_network iptv_network_t;
 typedef struct iptv_mux     iptv_mux_t;
 typedef struct iptv_service iptv_service_t;
 typedef struct iptv_handler iptv_handler_t;
+typedef struct iptv_thread  iptv_thread_t;
 
 struct iptv_handler
 {
@@ -45,6 +44,9 @@ struct iptv_handler
   // from start of mux buffer (useful for things with wrapper
   // around TS)
   ssize_t (*read)  ( iptv_mux_t *im, size_t *off );
+
+  // Mux buffer size (0 for IPTV_PKT_SIZE)
+  size_t    buf_size;
   
   RB_ENTRY(iptv_handler) link;
 };
@@ -63,17 +65,21 @@ struct iptv_network
 {
   mpegts_network_t;
 
-  int in_bps;
+  volatile int in_bps;
   int in_bw_limited;
 
   uint32_t in_max_streams;
   uint32_t in_max_bandwidth;
+  uint32_t in_threads;
 };
 
 struct iptv_mux
 {
   mpegts_mux_t;
 
+  pthread_mutex_t       mm_iptv_lock;
+  iptv_thread_t        *mm_iptv_thread;
+
   int                   mm_iptv_fd;
   char                 *mm_iptv_url;
   char                 *mm_iptv_interface;
@@ -83,6 +89,9 @@ struct iptv_mux
   uint8_t              *mm_iptv_tsb;
   int                   mm_iptv_pos;
 
+  int                   mm_iptv_rtp_seq;
+  int                   mm_iptv_trunc;
+
   iptv_handler_t       *im_handler;
 
   void                 *im_data;
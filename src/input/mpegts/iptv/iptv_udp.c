@@ -17,8 +17,10 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define _GNU_SOURCE
 #include "tvheadend.h"
 #include "iptv_private.h"
+#include "atomic.h"
 
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -38,6 +40,10 @@
 #  endif
 #endif
 
+#if ENABLE_RECVMMSG
+#define IPTV_MMSG_MAX  16
+#define IPTV_MMSG_SIZE 65536 /* Largest UDP datagram */
+#endif
 
 /*
  * Connect UDP/RTP
@@ -169,7 +175,9 @@ iptv_udp_start ( iptv_mux_t *im, const url_t *url )
             name, strerror(errno));
 
   /* Done */
-  im->mm_iptv_fd = fd;
+  im->mm_iptv_fd      = fd;
+  im->mm_iptv_rtp_seq = -1;
+  im->mm_iptv_trunc   = 0;
   iptv_input_mux_started(im);
   return 0;
 
@@ -178,19 +186,124 @@ error:
   return -1;
 }
 
+/*
+ * Validate and strip RTP header, returns header length or -1
+ */
+static ssize_t
+iptv_rtp_header ( iptv_mux_t *im, const uint8_t *rtp, ssize_t len )
+{
+  ssize_t hlen;
+  int seq;
+  int16_t delta;
+
+  if (len < 12)
+    return -1;
+  if ((rtp[0] & 0xC0) != 0x80)
+    return -1;
+  if ((rtp[1] & 0x7F) != 33)
+    return -1;
+  hlen = ((rtp[0] & 0xf) * 4) + 12;
+  if (rtp[0] & 0x10) {
+    if (len < hlen+4)
+      return -1;
+    hlen += (rtp[hlen+2] << 8) | (rtp[hlen+3]*4);
+    hlen += 4;
+  }
+  if (len < hlen || ((len - hlen) % 188) != 0)
+    return -1;
+
+  /* Sequence gaps (a step backwards is a reordered or duplicate
+     datagram, not a loss, so keep the highest sequence seen) */
+  seq = (rtp[2] << 8) | rtp[3];
+  if (im->mm_iptv_rtp_seq != -1) {
+    delta = seq - im->mm_iptv_rtp_seq;
+    if (delta <= 0)
+      return hlen;
+    if (delta > 1)
+      atomic_add(&im->mm_active->mmi_stats.cc, delta - 1);
+  }
+  im->mm_iptv_rtp_seq = seq;
+
+  return hlen;
+}
+
+#if ENABLE_RECVMMSG
+/*
+ * Receive as many datagrams as are queued in a single call
+ *
+ * Each datagram is received into its own slot of the mux buffer and
+ * the payloads are then compacted to the start of the buffer
+ */
+static ssize_t
+iptv_udp_read_mmsg ( iptv_mux_t *im, int rtp )
+{
+  int i, n;
+  ssize_t len = 0, l, hlen;
+  uint8_t *p;
+  struct mmsghdr msg[IPTV_MMSG_MAX];
+  struct iovec   iov[IPTV_MMSG_MAX];
+
+  memset(msg, 0, sizeof(msg));
+  for (i = 0; i < IPTV_MMSG_MAX; i++) {
+    iov[i].iov_base           = im->mm_iptv_tsb + i * IPTV_MMSG_SIZE;
+    iov[i].iov_len            = IPTV_MMSG_SIZE;
+    msg[i].msg_hdr.msg_iov    = &iov[i];
+    msg[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  n = recvmmsg(im->mm_iptv_fd, msg, IPTV_MMSG_MAX, MSG_DONTWAIT, NULL);
+  if (n < 0)
+    return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+
+  /* Compact (and strip headers) */
+  for (i = 0; i < n; i++) {
+    p = iov[i].iov_base;
+    l = msg[i].msg_len;
+    if (msg[i].msg_hdr.msg_flags & MSG_TRUNC) {
+      if (!im->mm_iptv_trunc++) {
+        char buf[256];
+        im->mm_display_name((mpegts_mux_t*)im, buf, sizeof(buf));
+        tvhwarn("iptv", "%s - datagram over %d bytes dropped",
+                buf, IPTV_MMSG_SIZE);
+      }
+      continue;
+    }
+    if (rtp) {
+      if ((hlen = iptv_rtp_header(im, p, l)) < 0)
+        continue;
+      p += hlen;
+      l -= hlen;
+    }
+    if (p != im->mm_iptv_tsb + len)
+      memmove(im->mm_iptv_tsb + len, p, l);
+    len += l;
+  }
+
+  return len;
+}
+#endif
+
 static ssize_t
 iptv_udp_read ( iptv_mux_t *im, size_t *off )
 {
   /* UDP/RTP should not have TS packets straddling datagrams, I think! */
   im->mm_iptv_pos = 0;
 
+#if ENABLE_RECVMMSG
+  return iptv_udp_read_mmsg(im, 0);
+#else
   /* Read */
   return read(im->mm_iptv_fd, im->mm_iptv_tsb, IPTV_PKT_SIZE);
+#endif
 }
 
 static ssize_t
 iptv_rtp_read ( iptv_mux_t *im, size_t *off )
 {
+#if ENABLE_RECVMMSG
+  im->mm_iptv_pos = 0;
+  return iptv_udp_read_mmsg(im, 1);
+#else
   ssize_t len, hlen;
 
   /* Raw packet */
@@ -199,25 +312,13 @@ iptv_rtp_read ( iptv_mux_t *im, size_t *off )
     return -1;
 
   /* Strip RTP header */
-  if (len < 12)
+  if ((hlen = iptv_rtp_header(im, im->mm_iptv_tsb, len)) < 0)
     return 0; // ignore
-  if ((im->mm_iptv_tsb[0] & 0xC0) != 0x80)
-    return 0;
-  if ((im->mm_iptv_tsb[1] & 0x7F) != 33)
-    return 0;
-  hlen = ((im->mm_iptv_tsb[0] & 0xf) * 4) + 12;
-  if (im->mm_iptv_tsb[0] & 0x10) {
-    if (len < hlen+4)
-      return 0;
-    hlen += (im->mm_iptv_tsb[hlen+2] << 8) | (im->mm_iptv_tsb[hlen+3]*4);
-    hlen += 4;
-  }
-  if (len < hlen || ((len - hlen) % 188) != 0)
-    return 0;
 
   /* OK */
   *off = hlen;
   return len;
+#endif
 }
 
 /*
@@ -232,11 +333,17 @@ iptv_udp_init ( void )
       .scheme = "udp",
       .start  = iptv_udp_start,
       .read   = iptv_udp_read,
+#if ENABLE_RECVMMSG
+      .buf_size = IPTV_MMSG_MAX * IPTV_MMSG_SIZE,
+#endif
     },
     {
       .scheme = "rtp",
       .start  = iptv_udp_start,
       .read   = iptv_rtp_read,
+#if ENABLE_RECVMMSG
+      .buf_size = IPTV_MMSG_MAX * IPTV_MMSG_SIZE,
+#endif
     }
   };
   iptv_handler_register(ih, 2);
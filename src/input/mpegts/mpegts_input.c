@@ -176,6 +176,7 @@ mpegts_input_open_pid
       tvhdebug("mpegts", "%s - open PID %04X (%d) [%d/%p]",
                buf, mp->mp_pid, mp->mp_pid, type, owner);
       skel = NULL;
+      mm->mm_pid_routes_dirty = 1;
     }
   }
   return mp;
@@ -197,6 +198,7 @@ mpegts_input_close_pid
   if (mps) {
     RB_REMOVE(&mp->mp_subs, mps, mps_link);
     free(mps);
+    mm->mm_pid_routes_dirty = 1;
 
     if (!RB_FIRST(&mp->mp_subs)) {
       RB_REMOVE(&mm->mm_pids, mp, mp_link);
@@ -222,6 +224,7 @@ mpegts_input_open_service ( mpegts_input_t *mi, mpegts_service_t *s, int init )
     LIST_INSERT_HEAD(&mi->mi_transports, ((service_t*)s), s_active_link);
     s->s_dvb_active_input = mi;
   }
+  s->s_dvb_mux->mm_pid_routes_dirty = 1;
 
 
   /* Register PIDs */
@@ -246,6 +249,7 @@ mpegts_input_close_service ( mpegts_input_t *mi, mpegts_service_t *s )
     LIST_REMOVE(((service_t*)s), s_active_link);
     s->s_dvb_active_input = NULL;
   }
+  s->s_dvb_mux->mm_pid_routes_dirty = 1;
   
   /* Close PID */
   pthread_mutex_lock(&s->s_stream_mutex);
@@ -332,6 +336,105 @@ mpegts_input_has_subscription ( mpegts_input_t *mi, mpegts_mux_t *mm )
  * Data processing
  * *************************************************************************/
 
+/*
+ * Rebuild the flat PID routing table for a mux
+ *
+ * This resolves, up front, which services and tables consume each PID
+ * so that the per-packet path is a direct index and a short fan-out.
+ * Only done when PIDs are opened/closed or services start/stop.
+ */
+static void
+mpegts_input_build_pid_routes ( mpegts_input_t *mi, mpegts_mux_t *mm )
+{
+  int i, c, n = 0, pid, stream, table;
+  service_t *t;
+  mpegts_pid_t *mp;
+  mpegts_pid_sub_t *mps;
+  mpegts_pid_route_t *mpr;
+
+  lock_assert(&mi->mi_delivery_mutex);
+
+  /* Active services on this mux (keep list order) */
+  LIST_FOREACH(t, &mi->mi_transports, s_active_link)
+    if (((mpegts_service_t*)t)->s_dvb_mux == mm)
+      n++;
+  mpegts_service_t *svcs[n + 1];
+  n = 0;
+  LIST_FOREACH(t, &mi->mi_transports, s_active_link)
+    if (((mpegts_service_t*)t)->s_dvb_mux == mm)
+      svcs[n++] = (mpegts_service_t*)t;
+
+  /* Reset */
+  mpegts_mux_flush_pid_routes(mm);
+  mm->mm_pid_routes = calloc(MPEGTS_FULLMUX_PID, sizeof(mpegts_pid_route_t*));
+  if (n) {
+    mm->mm_pid_batch       = calloc(n, sizeof(mpegts_pid_batch_t));
+    mm->mm_pid_batch_count = n;
+    for (i = 0; i < n; i++)
+      mm->mm_pid_batch[i].mpb_service = svcs[i];
+  }
+
+  RB_FOREACH(mp, &mm->mm_pids, mp_link) {
+    pid = mp->mp_pid;
+    if (pid >= MPEGTS_FULLMUX_PID) continue;
+
+    /* Stream takes pref. */
+    stream = table = (pid == 0);
+    RB_FOREACH(mps, &mp->mp_subs, mps_link) {
+      if (mps->mps_type & MPS_STREAM)
+        stream = 1;
+      if (mps->mps_type & MPS_TABLE)
+        table  = 1;
+    }
+    for (i = 0; i < n; i++)
+      if (pid == svcs[i]->s_pmt_pid || pid == svcs[i]->s_pcr_pid)
+        stream = 1;
+
+    /* Service consumers */
+    mpr = calloc(1, sizeof(mpegts_pid_route_t) + n * sizeof(mpr->mpr_svcs[0]));
+    c   = 0;
+    if (stream) {
+      for (i = 0; i < n; i++) {
+        int f = table || (pid == svcs[i]->s_pmt_pid) ||
+                         (pid == svcs[i]->s_pcr_pid);
+
+        /* Only services that registered the PID need it */
+        if (!f) {
+          RB_FOREACH(mps, &mp->mp_subs, mps_link)
+            if ((mps->mps_type & MPS_STREAM) && mps->mps_owner == svcs[i])
+              break;
+          if (!mps) continue;
+        }
+        mpr->mpr_svcs[c].idx   = i;
+        mpr->mpr_svcs[c].table = f;
+        c++;
+      }
+    }
+    mpr->mpr_count = c;
+    mpr->mpr_table = table;
+
+    if (!c && !table) {
+      free(mpr);
+      continue;
+    }
+    mm->mm_pid_routes[pid] = mpr;
+  }
+
+  mm->mm_pid_routes_dirty = 0;
+}
+
+/*
+ * Deliver the packets queued for a service in one go
+ */
+static inline void
+mpegts_input_flush_batch ( mpegts_pid_batch_t *mpb, int64_t *pcr )
+{
+  if (mpb->mpb_count) {
+    ts_recv_packets_batch(mpb->mpb_service, mpb->mpb_vec, mpb->mpb_count, pcr);
+    mpb->mpb_count = 0;
+  }
+}
+
 size_t
 mpegts_input_recv_packets
   ( mpegts_input_t *mi, mpegts_mux_instance_t *mmi,
@@ -339,7 +442,7 @@ mpegts_input_recv_packets
     const char *name )
 {
   int len = l;
-  int i = 0, table_wakeup = 0;
+  int i = 0, j, table_wakeup = 0, lost = 0;
   mpegts_mux_t *mm = mmi->mmi_mux;
   assert(mm != NULL);
   assert(name != NULL);
@@ -350,87 +453,102 @@ mpegts_input_recv_packets
   
   /* Not enough data */
   if (len < 188) return len;
-  
-  /* Streaming - lock mutex */
-  pthread_mutex_lock(&mi->mi_delivery_mutex);
 
   /* Process */
-  while ( len >= 188 ) {
-
-    /* Sync */
-    if ( tsb[i] == 0x47 ) {
-      mpegts_pid_t *mp;
-      mpegts_pid_sub_t *mps;
-      service_t *s;
-      int     pid   = ((tsb[i+1] & 0x1f) << 8) | tsb[i+2];
-      int64_t *ppcr = (pcr_pid && *pcr_pid == pid) ? pcr : NULL;
-      tvhtrace("tsdemux", "%s - recv pkt for pid %04X (%d) on mmi %p",
-               name, pid, pid, mmi);
-
-      /* Find PID */
-      if ((mp = mpegts_mux_find_pid(mm, pid, 0))) {
-        int stream = 0;
-        int table  = 0;
-
-        /* Stream takes pref. */
-        RB_FOREACH(mps, &mp->mp_subs, mps_link) {
-          if (mps->mps_type & MPS_STREAM)
-            stream = 1;
-          if (mps->mps_type & MPS_TABLE)
-            table  = 1;
-        }
+  while ( len >= 188 && !lost ) {
+    int n = 0;
 
-        /* Special case streams */
-        if (pid == 0) table = stream = 1;
-        LIST_FOREACH(s, &mi->mi_transports, s_active_link) {
-          if (((mpegts_service_t*)s)->s_dvb_mux != mmi->mmi_mux) continue;
-               if (pid == s->s_pmt_pid) stream = 1;
-          else if (pid == s->s_pcr_pid) stream = 1;
-        }
-  
-        /* Stream data */
-        if (stream) {
-          LIST_FOREACH(s, &mi->mi_transports, s_active_link) {
-            int f;
-            if (((mpegts_service_t*)s)->s_dvb_mux != mmi->mmi_mux) continue;
-            f = table || (pid == s->s_pmt_pid) || (pid == s->s_pcr_pid);
-            ts_recv_packet1((mpegts_service_t*)s, tsb+i, ppcr, f);
+    /* Streaming - lock mutex */
+    pthread_mutex_lock(&mi->mi_delivery_mutex);
+
+    /* Update routing */
+    if (mm->mm_pid_routes_dirty || !mm->mm_pid_routes)
+      mpegts_input_build_pid_routes(mi, mm);
+
+    /* Route (at most one batch worth per pass) */
+    while ( len >= 188 && n < MPEGTS_BATCH_MAX ) {
+
+      /* Sync */
+      if ( tsb[i] == 0x47 ) {
+        mpegts_pid_route_t *mpr;
+        int     pid   = ((tsb[i+1] & 0x1f) << 8) | tsb[i+2];
+        int64_t *ppcr = (pcr_pid && *pcr_pid == pid) ? pcr : NULL;
+        tvhtrace("tsdemux", "%s - recv pkt for pid %04X (%d) on mmi %p",
+                 name, pid, pid, mmi);
+
+        /* Find route */
+        if ((mpr = mm->mm_pid_routes[pid])) {
+
+          /* Stream data (queued per service) */
+          for (j = 0; j < mpr->mpr_count; j++) {
+            mpegts_pid_batch_t *mpb = mm->mm_pid_batch + mpr->mpr_svcs[j].idx;
+            mpegts_pkt_vec_t   *mpv = mpb->mpb_vec + mpb->mpb_count++;
+            mpv->mpv_tsb   = tsb+i;
+            mpv->mpv_table = mpr->mpr_svcs[j].table;
+            mpv->mpv_pcr   = ppcr != NULL;
           }
-        }
 
-        /* Table data */
-        if (table) {
-          if (!(tsb[i+1] & 0x80)) {
-            mpegts_table_feed_t *mtf = malloc(sizeof(mpegts_table_feed_t));
-            memcpy(mtf->mtf_tsb, tsb+i, 188);
-            mtf->mtf_mux = mm;
-            TAILQ_INSERT_TAIL(&mi->mi_table_feed, mtf, mtf_link);
-            table_wakeup = 1;
-          } else {
-            tvhdebug("tsdemux", "%s - SI packet had errors", name);
+          /* Table data */
+          if (mpr->mpr_table) {
+            if (!(tsb[i+1] & 0x80)) {
+              mpegts_table_feed_t *mtf = malloc(sizeof(mpegts_table_feed_t));
+              memcpy(mtf->mtf_tsb, tsb+i, 188);
+              mtf->mtf_mux = mm;
+              TAILQ_INSERT_TAIL(&mi->mi_table_feed, mtf, mtf_link);
+              table_wakeup = 1;
+            } else {
+              tvhdebug("tsdemux", "%s - SI packet had errors", name);
+            }
           }
+
+        /* Force PCR extraction for tsfile */
+        } else {
+          if (ppcr && *ppcr == PTS_UNSET)
+            ts_recv_packet1(NULL, tsb+i, ppcr, 0);
         }
 
-      /* Force PCR extraction for tsfile */
+        i   += 188;
+        len -= 188;
+        n++;
+      
+      /* Re-sync */
       } else {
-        if (ppcr && *ppcr == PTS_UNSET)
-          ts_recv_packet1(NULL, tsb+i, ppcr, 0);
+        tvhdebug("tsdemux", "%s - ts sync lost", name);
+        if ((lost = ts_resync(tsb, &len, &i))) break;
+        tvhdebug("tsdemux", "%s - ts sync found", name);
       }
+    }
 
-      i   += 188;
-      len -= 188;
-    
-    /* Re-sync */
-    } else {
-      tvhdebug("tsdemux", "%s - ts sync lost", name);
-      if (ts_resync(tsb, &len, &i)) break;
-      tvhdebug("tsdemux", "%s - ts sync found", name);
+    /* Wake table */
+    if (table_wakeup) {
+      pthread_cond_signal(&mi->mi_table_feed_cond);
+      table_wakeup = 0;
     }
 
+    /* Hold services being delivered to */
+    for (j = 0; j < mm->mm_pid_batch_count; j++)
+      if (mm->mm_pid_batch[j].mpb_count)
+        service_ref((service_t*)mm->mm_pid_batch[j].mpb_service);
+
+    pthread_mutex_unlock(&mi->mi_delivery_mutex);
+
+    /* Deliver service batches
+     *
+     * Note: this is done without the delivery lock so that muxes sharing
+     *       an input (IPTV) can be processed in parallel
+     */
+    for (j = 0; j < mm->mm_pid_batch_count; j++) {
+      mpegts_pid_batch_t *mpb = mm->mm_pid_batch + j;
+      if (mpb->mpb_count) {
+        mpegts_input_flush_batch(mpb, pcr);
+        service_unref((service_t*)mpb->mpb_service);
+      }
+    }
   }
 
   /* Raw stream */
   // Note: this will include unsynced data if that's what is received
+  pthread_mutex_lock(&mi->mi_delivery_mutex);
   if (i > 0 && LIST_FIRST(&mmi->mmi_streaming_pad.sp_targets) != NULL) {
     streaming_message_t sm;
     pktbuf_t *pb = pktbuf_alloc(tsb, i);
@@ -440,11 +558,6 @@ mpegts_input_recv_packets
     streaming_pad_deliver(&mmi->mmi_streaming_pad, &sm);
     pktbuf_ref_dec(pb);
   }
-
-  /* Wake table */
-  if (table_wakeup)
-    pthread_cond_signal(&mi->mi_table_feed_cond);
-
   pthread_mutex_unlock(&mi->mi_delivery_mutex);
 
   /* Bandwidth monitoring */
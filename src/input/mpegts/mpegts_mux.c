@@ -544,6 +544,7 @@ mpegts_mux_stop ( mpegts_mux_t *mm, int force )
     }
     free(mp);
   }
+  mpegts_mux_flush_pid_routes(mm);
 
   /* Scanning */
   if (mm->mm_initial_scan_status == MM_SCAN_CURRENT) {
@@ -919,6 +920,23 @@ mpegts_mux_find_pid ( mpegts_mux_t *mm, int pid, int create )
   return mp;
 }
 
+void
+mpegts_mux_flush_pid_routes ( mpegts_mux_t *mm )
+{
+  int i;
+
+  if (mm->mm_pid_routes) {
+    for (i = 0; i < MPEGTS_FULLMUX_PID; i++)
+      free(mm->mm_pid_routes[i]);
+    free(mm->mm_pid_routes);
+    mm->mm_pid_routes = NULL;
+  }
+  free(mm->mm_pid_batch);
+  mm->mm_pid_batch       = NULL;
+  mm->mm_pid_batch_count = 0;
+  mm->mm_pid_routes_dirty = 1;
+}
+
 /******************************************************************************
  * Editor Configuration
  *
@@ -218,6 +218,11 @@ mpegts_service_start(service_t *t, int instance)
   /* Start */
   if (!r) {
 
+    /* Forget the PCR of a previous run */
+    pthread_mutex_lock(&s->s_stream_mutex);
+    s->s_pcr_last = PTS_UNSET;
+    pthread_mutex_unlock(&s->s_stream_mutex);
+
     /* Open service */
     mmi->mmi_input->mi_open_service(mmi->mmi_input, s, 1);
   }
@@ -353,6 +358,8 @@ mpegts_service_delete ( service_t *t )
   free(ms->s_dvb_svcname);
   free(ms->s_dvb_provider);
   free(ms->s_dvb_charset);
+  if (ms->s_tspb)
+    pktbuf_ref_dec(ms->s_tspb);
   LIST_REMOVE(ms, s_dvb_mux_link);
 
   // Note: the ultimate deletion and removal from the idnode list
@@ -376,7 +383,8 @@ mpegts_service_create0
   service_create0((service_t*)s, class, uuid, S_MPEG_TS, conf);
 
   /* Create */
-  sbuf_init(&s->s_tsbuf);
+  s->s_tspb = NULL;
+  s->s_pcr_last = PTS_UNSET;
   if (!conf) {
     if (sid)     s->s_dvb_service_id = sid;
     if (pmt_pid) s->s_pmt_pid        = pmt_pid;
@@ -40,7 +40,7 @@
 #include "parsers/parser_teletext.h"
 #include "tsdemux.h"
 
-#define TS_REMUX_BUFSIZE (188 * 100)
+#define TS_REMUX_BUFSIZE (188 * 87) // fits in the 16K pktbuf class
 
 static void ts_remux(mpegts_service_t *t, const uint8_t *tsb);
 
@@ -138,6 +138,9 @@ ts_process_pcr(mpegts_service_t *t, elementary_stream_t *st, int64_t pcr)
   if(st == NULL)
     return;
 
+  if(t->s_pcr_pid == st->es_pid)
+    t->s_pcr_last = pcr;
+
   real = getmonoclock();
 
   if(st->es_pcr_real_last != PTS_UNSET) {
@@ -166,18 +169,39 @@ ts_process_pcr(mpegts_service_t *t, elementary_stream_t *st, int64_t pcr)
 }
 
 /**
- * Process service stream packets, extract PCR and optionally descramble
+ * Extract PCR from the adaptation field
  */
-int
-ts_recv_packet1
-  (mpegts_service_t *t, const uint8_t *tsb, int64_t *pcrp, int table)
+static inline int64_t
+ts_get_pcr(const uint8_t *tsb)
+{
+  int64_t pcr;
+
+  if(!(tsb[3] & 0x20 && tsb[4] > 0 && tsb[5] & 0x10) || (tsb[1] & 0x80))
+    return PTS_UNSET;
+
+  pcr  = (uint64_t)tsb[6] << 25;
+  pcr |= (uint64_t)tsb[7] << 17;
+  pcr |= (uint64_t)tsb[8] << 9;
+  pcr |= (uint64_t)tsb[9] << 1;
+  pcr |= ((uint64_t)tsb[10] >> 7) & 0x01;
+  return pcr;
+}
+
+/**
+ * Process a service stream packet, optionally descramble
+ *
+ * Must be called with s_stream_mutex held, returns 1 if the packet
+ * belongs to the service
+ */
+static int
+ts_recv_packet_locked
+  (mpegts_service_t *t, const uint8_t *tsb, int64_t pcr, int table)
 {
   elementary_stream_t *st;
   int pid, n, m, r;
   th_descrambler_t *td;
   int error = 0;
-  int64_t pcr = PTS_UNSET;
-  
+
   /* Error */
   if (tsb[1] & 0x80)
     error = 1;
@@ -187,27 +211,6 @@ ts_recv_packet1
          tsb[0], tsb[1], tsb[2], tsb[3], tsb[4], tsb[5]);
 #endif
 
-  /* Extract PCR (do this early for tsfile) */
-  if(tsb[3] & 0x20 && tsb[4] > 0 && tsb[5] & 0x10 && !error) {
-    pcr  = (uint64_t)tsb[6] << 25;
-    pcr |= (uint64_t)tsb[7] << 17;
-    pcr |= (uint64_t)tsb[8] << 9;
-    pcr |= (uint64_t)tsb[9] << 1;
-    pcr |= ((uint64_t)tsb[10] >> 7) & 0x01;
-    if (pcrp) *pcrp = pcr;
-  }
-
-  /* Nothing - special case for tsfile to get PCR */
-  if (!t) return 0;
-
-  /* Service inactive - ignore */
-  if(t->s_status != SERVICE_RUNNING)
-    return 0;
-
-  pthread_mutex_lock(&t->s_stream_mutex);
-
-  service_set_streaming_status_flags((service_t*)t, TSS_INPUT_HARDWARE);
-
   if(error) {
     /* Transport Error Indicator */
     limitedlog(&t->s_loglimit_tei, "TS", service_nicename((service_t*)t),
@@ -222,15 +225,8 @@ ts_recv_packet1
   if (pcr != PTS_UNSET)
     ts_process_pcr(t, st, pcr);
 
-  if((st == NULL) && (pid != t->s_pcr_pid) && !table) {
-    pthread_mutex_unlock(&t->s_stream_mutex);
+  if((st == NULL) && (pid != t->s_pcr_pid) && !table)
     return 0;
-  }
-
-  if(!error)
-    service_set_streaming_status_flags((service_t*)t, TSS_INPUT_SERVICE);
-
-  avgstat_add(&t->s_rate, 188, dispatch_clock);
 
   if((tsb[3] & 0xc0) ||
       (t->s_scrambled_seen && st && st->es_type != SCT_CA)) {
@@ -248,10 +244,8 @@ ts_recv_packet1
       n++;
       
       r = td->td_descramble(td, (service_t*)t, st, tsb);
-      if(r == 0) {
-        pthread_mutex_unlock(&t->s_stream_mutex);
+      if(r == 0)
         return 1;
-      }
 
       if(r == 1)
         m++;
@@ -268,10 +262,97 @@ ts_recv_packet1
   } else {
     ts_recv_packet0(t, st, tsb);
   }
-  pthread_mutex_unlock(&t->s_stream_mutex);
   return 1;
 }
 
+/**
+ * Process service stream packets, extract PCR and optionally descramble
+ */
+int
+ts_recv_packet1
+  (mpegts_service_t *t, const uint8_t *tsb, int64_t *pcrp, int table)
+{
+  int r;
+  int64_t pcr;
+  
+  /* Extract PCR (do this early for tsfile) */
+  pcr = ts_get_pcr(tsb);
+  if (pcr != PTS_UNSET && pcrp) *pcrp = pcr;
+
+  /* Nothing - special case for tsfile to get PCR */
+  if (!t) return 0;
+
+  /* Service inactive - ignore */
+  if(t->s_status != SERVICE_RUNNING)
+    return 0;
+
+  pthread_mutex_lock(&t->s_stream_mutex);
+
+  service_set_streaming_status_flags((service_t*)t, TSS_INPUT_HARDWARE);
+
+  if ((r = ts_recv_packet_locked(t, tsb, pcr, table))) {
+    if(!(tsb[1] & 0x80))
+      service_set_streaming_status_flags((service_t*)t, TSS_INPUT_SERVICE);
+    avgstat_add(&t->s_rate, 188, dispatch_clock);
+  }
+
+  pthread_mutex_unlock(&t->s_stream_mutex);
+  return r;
+}
+
+/**
+ * Process a batch of service stream packets
+ *
+ * As ts_recv_packet1() but the service is only locked, and its status
+ * and statistics updated, once for the whole batch. Returns the number
+ * of packets that belonged to the service.
+ */
+int
+ts_recv_packets_batch
+  (mpegts_service_t *t, const mpegts_pkt_vec_t *vec, int count,
+   int64_t *pcrp)
+{
+  int i, n = 0, ok = 0;
+  int64_t pcr;
+
+  /* Service inactive - only extract PCR (for tsfile) */
+  if(t->s_status != SERVICE_RUNNING) {
+    if (pcrp)
+      for (i = 0; i < count; i++)
+        if (vec[i].mpv_pcr && (pcr = ts_get_pcr(vec[i].mpv_tsb)) != PTS_UNSET)
+          *pcrp = pcr;
+    return 0;
+  }
+
+  pthread_mutex_lock(&t->s_stream_mutex);
+
+  /* Stopped whilst waiting (delivery is not under the input lock) */
+  if(t->s_status != SERVICE_RUNNING) {
+    pthread_mutex_unlock(&t->s_stream_mutex);
+    return 0;
+  }
+
+  service_set_streaming_status_flags((service_t*)t, TSS_INPUT_HARDWARE);
+
+  for (i = 0; i < count; i++) {
+    const uint8_t *tsb = vec[i].mpv_tsb;
+    pcr = ts_get_pcr(tsb);
+    if (pcr != PTS_UNSET && pcrp && vec[i].mpv_pcr) *pcrp = pcr;
+    if (ts_recv_packet_locked(t, tsb, pcr, vec[i].mpv_table)) {
+      n++;
+      ok |= !(tsb[1] & 0x80);
+    }
+  }
+
+  if (ok)
+    service_set_streaming_status_flags((service_t*)t, TSS_INPUT_SERVICE);
+  if (n)
+    avgstat_add(&t->s_rate, 188 * n, dispatch_clock);
+
+  pthread_mutex_unlock(&t->s_stream_mutex);
+  return n;
+}
+
 
 /*
  * Process transport stream packets, simple version
@@ -294,15 +375,21 @@ static void
 ts_remux(mpegts_service_t *t, const uint8_t *src)
 {
   streaming_message_t sm;
-  pktbuf_t *pb;
-  sbuf_t *sb = &t->s_tsbuf;
+  pktbuf_t *pb = t->s_tspb;
 
-  sbuf_append(sb, src, 188);
+  if (!pb) {
+    pb = t->s_tspb = pktbuf_alloc(NULL, TS_REMUX_BUFSIZE);
+    pb->pb_size = 0;
+  }
 
-  if(sb->sb_ptr < TS_REMUX_BUFSIZE) 
+  memcpy(pb->pb_data + pb->pb_size, src, 188);
+  pb->pb_size += 188;
+
+  if(pb->pb_size < TS_REMUX_BUFSIZE) 
     return;
 
-  pb = pktbuf_alloc(sb->sb_data, sb->sb_ptr);
+  /* Chunk is shared between targets, see pktbuf_writable() */
+  t->s_tspb = NULL;
 
   sm.sm_type = SMT_MPEGTS;
   sm.sm_data = pb;
@@ -311,8 +398,6 @@ ts_remux(mpegts_service_t *t, const uint8_t *src)
   pktbuf_ref_dec(pb);
 
   service_set_streaming_status_flags((service_t*)t, TSS_PACKETS);
-
-  sbuf_reset(sb);
 }
 
 /*
@@ -24,6 +24,10 @@ int ts_resync ( const uint8_t *tsb, int *len, int *idx );
 int ts_recv_packet1
   (struct mpegts_service *t, const uint8_t *tsb, int64_t *pcrp, int table);
 
+int ts_recv_packets_batch
+  (struct mpegts_service *t, const struct mpegts_pkt_vec *vec, int count,
+   int64_t *pcrp);
+
 void ts_recv_packet2(struct mpegts_service *t, const uint8_t *tsb);
 
 #endif /* TSDEMUX_H */
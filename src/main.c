@@ -52,6 +52,9 @@
 #include "avahi.h"
 #include "input.h"
 #include "service.h"
+#include "parsers.h"
+#include "packet.h"
+#include "streaming.h"
 #include "trap.h"
 #include "settings.h"
 #include "config2.h"
@@ -713,6 +716,10 @@ main(int argc, char **argv)
   if (!isatty(2))
     tvhlog_options &= ~TVHLOG_OPT_DECORATE;
   
+  /* Initialise packet/message pools */
+  pkt_init();
+  streaming_init();
+
   /* Initialise configuration */
   idnode_init();
   hts_settings_init(opt_config);
@@ -743,6 +750,8 @@ main(int argc, char **argv)
 
   imagecache_init();
 
+  parsers_init();
+
   service_init();
 
 #if ENABLE_TSFILE
@@ -826,6 +835,7 @@ main(int argc, char **argv)
   //       we need to disable the gtimer_arm call in epg_save()
   pthread_mutex_lock(&global_lock);
   epg_save(NULL);
+  epg_done();
 
 #if ENABLE_TIMESHIFT
   timeshift_term();
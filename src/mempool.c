@@ -0,0 +1,223 @@
+/*
+ *  TVheadend - fixed size object pools
+ *
+ *  Copyright (C) 2014 Tvheadend Project
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <limits.h>
+
+#include "tvheadend.h"
+#include "mempool.h"
+#include "atomic.h"
+
+#define MEMPOOL_MAX          16
+#define MEMPOOL_TCACHE_MAX   64          ///< Objects cached per thread (per pool)
+#define MEMPOOL_TCACHE_MIN   2
+#define MEMPOOL_TCACHE_BYTES (256*1024)  ///< Bytes cached per thread (per pool)
+
+struct mempool
+{
+  const char      *mp_name;
+  size_t           mp_size;
+  int              mp_idx;
+  int              mp_max_free; ///< Max objects kept on the shared list
+  int              mp_tcache;   ///< Max objects cached per thread
+
+  pthread_mutex_t  mp_lock;
+  void            *mp_free;     ///< Shared free list
+  int              mp_nfree;
+
+  /* Stats (only updated on the slow paths) */
+  volatile int     mp_allocated; ///< Objects currently obtained from malloc
+  volatile int     mp_mallocs;   ///< Total malloc() calls
+};
+
+typedef struct mempool_cache
+{
+  void *mc_head;
+  int   mc_count;
+} mempool_cache_t;
+
+static mempool_t                mempools[MEMPOOL_MAX];
+static int                      mempool_count;
+static pthread_key_t            mempool_key;
+static __thread mempool_cache_t mempool_tcache[MEMPOOL_MAX];
+static __thread int             mempool_tinit;
+
+#define MEMPOOL_NEXT(p) (*(void**)(p))
+
+/*
+ * Return cached objects to the shared list (or the system)
+ */
+static void
+mempool_spill ( mempool_t *mp, mempool_cache_t *mc, int num )
+{
+  void *p, *f = NULL;
+
+  pthread_mutex_lock(&mp->mp_lock);
+  while (num-- > 0 && (p = mc->mc_head)) {
+    mc->mc_head = MEMPOOL_NEXT(p);
+    mc->mc_count--;
+    if (mp->mp_nfree < mp->mp_max_free) {
+      MEMPOOL_NEXT(p) = mp->mp_free;
+      mp->mp_free     = p;
+      mp->mp_nfree++;
+    } else {
+      MEMPOOL_NEXT(p) = f;
+      f               = p;
+    }
+  }
+  pthread_mutex_unlock(&mp->mp_lock);
+
+  /* Release (outside lock) */
+  while ((p = f)) {
+    f = MEMPOOL_NEXT(p);
+    free(p);
+    atomic_add(&mp->mp_allocated, -1);
+  }
+}
+
+/*
+ * Take a batch of objects from the shared list
+ */
+static void
+mempool_refill ( mempool_t *mp, mempool_cache_t *mc )
+{
+  void *p;
+  int num = mp->mp_tcache / 2;
+
+  pthread_mutex_lock(&mp->mp_lock);
+  while (num-- > 0 && (p = mp->mp_free)) {
+    mp->mp_free     = MEMPOOL_NEXT(p);
+    mp->mp_nfree--;
+    MEMPOOL_NEXT(p) = mc->mc_head;
+    mc->mc_head     = p;
+    mc->mc_count++;
+  }
+  pthread_mutex_unlock(&mp->mp_lock);
+}
+
+/*
+ * Thread exit, give back everything
+ */
+static void
+mempool_thread_exit ( void *aux )
+{
+  int i;
+  for (i = 0; i < mempool_count; i++)
+    mempool_spill(&mempools[i], &mempool_tcache[i], INT_MAX);
+}
+
+static inline mempool_cache_t *
+mempool_cache ( mempool_t *mp )
+{
+  if (!mempool_tinit) {
+    mempool_tinit = 1;
+    pthread_setspecific(mempool_key, mempool_tcache);
+  }
+  return &mempool_tcache[mp->mp_idx];
+}
+
+/*
+ * Create pool (must be done before any threads use it)
+ */
+mempool_t *
+mempool_create ( const char *name, size_t size, size_t max_free )
+{
+  mempool_t *mp;
+
+  assert(mempool_count < MEMPOOL_MAX);
+  if (!mempool_count)
+    pthread_key_create(&mempool_key, mempool_thread_exit);
+
+  mp = &mempools[mempool_count];
+  mp->mp_name     = name;
+  mp->mp_size     = MAX(size, sizeof(void*));
+  mp->mp_idx      = mempool_count++;
+  mp->mp_max_free = max_free;
+  mp->mp_tcache   = MEMPOOL_TCACHE_BYTES / mp->mp_size;
+  mp->mp_tcache   = MAX(MEMPOOL_TCACHE_MIN, MIN(mp->mp_tcache, MEMPOOL_TCACHE_MAX));
+  pthread_mutex_init(&mp->mp_lock, NULL);
+  return mp;
+}
+
+void *
+mempool_alloc ( mempool_t *mp )
+{
+  mempool_cache_t *mc = mempool_cache(mp);
+  void *p;
+
+  if (!mc->mc_head)
+    mempool_refill(mp, mc);
+  if ((p = mc->mc_head)) {
+    mc->mc_head = MEMPOOL_NEXT(p);
+    mc->mc_count--;
+  } else {
+    p = malloc(mp->mp_size);
+    atomic_add(&mp->mp_allocated, 1);
+    atomic_add(&mp->mp_mallocs, 1);
+  }
+  return p;
+}
+
+void *
+mempool_calloc ( mempool_t *mp )
+{
+  void *p = mempool_alloc(mp);
+  memset(p, 0, mp->mp_size);
+  return p;
+}
+
+void
+mempool_free ( mempool_t *mp, void *p )
+{
+  mempool_cache_t *mc;
+
+  if (!p) return;
+
+  mc = mempool_cache(mp);
+  MEMPOOL_NEXT(p) = mc->mc_head;
+  mc->mc_head     = p;
+  if (++mc->mc_count > mp->mp_tcache)
+    mempool_spill(mp, mc, mp->mp_tcache / 2);
+}
+
+/*
+ * Statistics
+ */
+htsmsg_t *
+mempool_stats ( void )
+{
+  int i, nfree;
+  mempool_t *mp;
+  htsmsg_t *l = htsmsg_create_list(), *e;
+
+  for (i = 0; i < mempool_count; i++) {
+    mp = &mempools[i];
+    pthread_mutex_lock(&mp->mp_lock);
+    nfree = mp->mp_nfree;
+    pthread_mutex_unlock(&mp->mp_lock);
+    e = htsmsg_create_map();
+    htsmsg_add_str(e, "name",      mp->mp_name);
+    htsmsg_add_u32(e, "size",      mp->mp_size);
+    htsmsg_add_u32(e, "allocated", mp->mp_allocated);
+    htsmsg_add_u32(e, "free",      nfree);
+    htsmsg_add_u32(e, "mallocs",   mp->mp_mallocs);
+    htsmsg_add_s64(e, "bytes",     (int64_t)mp->mp_allocated * mp->mp_size);
+    htsmsg_add_msg(l, NULL, e);
+  }
+  return l;
+}
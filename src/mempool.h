@@ -0,0 +1,47 @@
+/*
+ *  TVheadend - fixed size object pools
+ *
+ *  Copyright (C) 2014 Tvheadend Project
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TVH_MEMPOOL_H__
+#define __TVH_MEMPOOL_H__
+
+#include <stddef.h>
+
+#include "htsmsg.h"
+
+/*
+ * Pools of fixed size objects for high rate allocations (packets,
+ * streaming messages etc...)
+ *
+ * Each thread keeps a small cache of free objects per pool so the
+ * common case takes no lock, excess objects are passed back to (or
+ * taken from) a shared free list in batches. The cache is bounded in
+ * bytes, so pools of large objects cache fewer of them.
+ */
+
+typedef struct mempool mempool_t;
+
+mempool_t *mempool_create  ( const char *name, size_t size, size_t max_free );
+
+void      *mempool_alloc   ( mempool_t *mp );
+void      *mempool_calloc  ( mempool_t *mp );
+void       mempool_free    ( mempool_t *mp, void *ptr );
+
+htsmsg_t  *mempool_stats   ( void );
+
+#endif /* __TVH_MEMPOOL_H__ */
@@ -414,28 +414,45 @@ pass_muxer_write(muxer_t *m, const void *data, size_t size)
 
 /**
  * Write TS packets to the file descriptor
+ *
+ * The buffer is shared with other subscribers, it's only copied
+ * (see pktbuf_writable()) when a PAT/PMT packet has to be rewritten.
+ * Returns the (possibly new) buffer reference.
  */
-static void
+static pktbuf_t *
 pass_muxer_write_ts(muxer_t *m, pktbuf_t *pb)
 {
   pass_muxer_t *pm = (pass_muxer_t*)m;
   unsigned char* tsb;
+  size_t off;
+  int pid, writable = 0;
   
   /* Rewrite PAT/PMT in operation */
   if (pm->pm_flags & (MUX_REWRITE_PAT | MUX_REWRITE_PMT)) {
 
-    tsb = pb->pb_data;
-    while (tsb < pb->pb_data + pb->pb_size) {
-      int pid = (tsb[1] & 0x1f) << 8 | tsb[2];
+    for (off = 0; off + 188 <= pb->pb_size; off += 188) {
+      tsb = pb->pb_data + off;
+      pid = (tsb[1] & 0x1f) << 8 | tsb[2];
+
+      if (!((pm->pm_flags & MUX_REWRITE_PAT && pid == 0) ||
+            (pm->pm_flags & MUX_REWRITE_PMT && pid == pm->pm_pmt_pid)))
+        continue;
+
+      /* Copy on write */
+      if (!writable) {
+        pb = pktbuf_writable(pb);
+        tsb = pb->pb_data + off;
+        writable = 1;
+      }
 
       /* PAT */
-      if (pm->pm_flags & MUX_REWRITE_PAT && pid == 0) {
+      if (pid == 0) {
         if (pass_muxer_rewrite_pat(pm, tsb)) {
           tvherror("pass", "PAT rewrite failed, disabling");
           pm->pm_flags &= ~MUX_REWRITE_PAT;
         }
       /* PMT */
-      } else if (pm->pm_flags & MUX_REWRITE_PMT && pid == pm->pm_pmt_pid) {
+      } else {
         if (tsb[1] & 0x40) { /* pusi - the first PMT packet */  
           memcpy(tsb, pm->pm_pmt, 188);
           tsb[3] = (pm->pm_pmt[3] & 0xf0) | pm->pm_pmt_cc;
@@ -446,12 +463,12 @@ pass_muxer_write_ts(muxer_t *m, pktbuf_t *pb)
           memset(tsb+2, 0xff, 186);
         }
       }
-
-      tsb += 188;
     }
   }
 
   pass_muxer_write(m, pb->pb_data, pb->pb_size);
+
+  return pb;
 }
 
 
@@ -468,7 +485,7 @@ pass_muxer_write_pkt(muxer_t *m, streaming_message_type_t smt, void *data)
 
   switch(smt) {
   case SMT_MPEGTS:
-    pass_muxer_write_ts(m, pb);
+    pb = pass_muxer_write_ts(m, pb);
     break;
   default:
     //TODO: add support for v4l (MPEG-PS)
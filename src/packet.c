@@ -21,6 +21,41 @@
 #include "packet.h"
 #include "string.h"
 #include "atomic.h"
+#include "mempool.h"
+
+/*
+ * Pools
+ */
+#define PKTBUF_CLASSES 5
+
+static mempool_t *pkt_pool;
+static mempool_t *pktbuf_pool;
+static mempool_t *pktbuf_data_pool[PKTBUF_CLASSES];
+
+void
+pkt_init(void)
+{
+  static const char *names[PKTBUF_CLASSES] = {
+    "pktbuf data 256", "pktbuf data 1K", "pktbuf data 4K",
+    "pktbuf data 16K", "pktbuf data 64K"
+  };
+  int i;
+
+  pkt_pool    = mempool_create("packet", sizeof(th_pkt_t), 4096);
+  pktbuf_pool = mempool_create("pktbuf", sizeof(pktbuf_t), 4096);
+  for(i = 0; i < PKTBUF_CLASSES; i++)
+    pktbuf_data_pool[i] =
+      mempool_create(names[i], 256 << (2 * i), (4 * 1024 * 1024) >> (2 * i + 8));
+}
+
+/**
+ * Allocate an (uninitialised) packet
+ */
+th_pkt_t *
+pkt_create(void)
+{
+  return mempool_alloc(pkt_pool);
+}
 
 /*
  *
@@ -33,7 +68,7 @@ pkt_destroy(th_pkt_t *pkt)
 
   if(pkt->pkt_header != NULL)
     pktbuf_ref_dec(pkt->pkt_header);
-  free(pkt);
+  mempool_free(pkt_pool, pkt);
 }
 
 
@@ -46,7 +81,7 @@ pkt_alloc(const void *data, size_t datalen, int64_t pts, int64_t dts)
 {
   th_pkt_t *pkt;
 
-  pkt = calloc(1, sizeof(th_pkt_t));
+  pkt = mempool_calloc(pkt_pool);
   if(datalen)
     pkt->pkt_payload = pktbuf_alloc(data, datalen);
   pkt->pkt_dts = dts;
@@ -137,7 +172,7 @@ pkt_merge_header(th_pkt_t *pkt)
   if(pkt->pkt_header == NULL)
     return pkt;
 
-  n = malloc(sizeof(th_pkt_t));
+  n = mempool_alloc(pkt_pool);
   *n = *pkt;
 
   n->pkt_refcount = 1;
@@ -166,7 +201,7 @@ pkt_merge_header(th_pkt_t *pkt)
 th_pkt_t *
 pkt_copy_shallow(th_pkt_t *pkt)
 {
-  th_pkt_t *n = malloc(sizeof(th_pkt_t));
+  th_pkt_t *n = mempool_alloc(pkt_pool);
   *n = *pkt;
 
   n->pkt_refcount = 1;
@@ -198,8 +233,11 @@ void
 pktbuf_ref_dec(pktbuf_t *pb)
 {
   if((atomic_add(&pb->pb_refcount, -1)) == 1) {
-    free(pb->pb_data);
-    free(pb);
+    if(pb->pb_pool)
+      mempool_free(pb->pb_pool, pb->pb_data);
+    else
+      free(pb->pb_data);
+    mempool_free(pktbuf_pool, pb);
   }
 }
 
@@ -212,24 +250,56 @@ pktbuf_ref_inc(pktbuf_t *pb)
 pktbuf_t *
 pktbuf_alloc(const void *data, size_t size)
 {
-  pktbuf_t *pb = malloc(sizeof(pktbuf_t));
+  int i;
+  pktbuf_t *pb = mempool_alloc(pktbuf_pool);
   pb->pb_refcount = 1;
   pb->pb_size = size;
+  pb->pb_data = NULL;
+  pb->pb_pool = NULL;
 
   if(size > 0) {
-    pb->pb_data = malloc(size);
+    for(i = 0; i < PKTBUF_CLASSES; i++)
+      if(size <= (256 << (2 * i)))
+        break;
+    if(i < PKTBUF_CLASSES) {
+      pb->pb_pool = pktbuf_data_pool[i];
+      pb->pb_data = mempool_alloc(pb->pb_pool);
+    } else {
+      pb->pb_data = malloc(size);
+    }
     if(data != NULL)
       memcpy(pb->pb_data, data, size);
   }
   return pb;
 }
 
+/**
+ * Return a buffer which may be modified in place
+ *
+ * Buffers are shared read-only between all streaming targets, so if
+ * there is anybody else holding a reference the data is copied and the
+ * callers reference is moved to the copy.
+ */
+pktbuf_t *
+pktbuf_writable(pktbuf_t *pb)
+{
+  pktbuf_t *n;
+
+  if(pb->pb_refcount == 1)
+    return pb;
+
+  n = pktbuf_alloc(pb->pb_data, pb->pb_size);
+  pktbuf_ref_dec(pb);
+  return n;
+}
+
 pktbuf_t *
 pktbuf_make(void *data, size_t size)
 {
-  pktbuf_t *pb = malloc(sizeof(pktbuf_t));
+  pktbuf_t *pb = mempool_alloc(pktbuf_pool);
   pb->pb_refcount = 1;
   pb->pb_size = size;
   pb->pb_data = data;
+  pb->pb_pool = NULL;
   return pb;
 }
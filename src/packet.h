@@ -24,6 +24,7 @@ typedef struct pktbuf {
   int pb_refcount;
   uint8_t *pb_data;
   size_t pb_size;
+  struct mempool *pb_pool; /* Pool pb_data came from (NULL = malloc) */
 } pktbuf_t;
 
 
@@ -80,6 +81,10 @@ typedef struct th_pktref {
 /**
  *
  */
+void pkt_init(void);
+
+th_pkt_t *pkt_create(void);
+
 void pkt_ref_dec(th_pkt_t *pkt);
 
 void pkt_ref_inc(th_pkt_t *pkt);
@@ -110,6 +115,8 @@ pktbuf_t *pktbuf_alloc(const void *data, size_t size);
 
 pktbuf_t *pktbuf_make(void *data, size_t size);
 
+pktbuf_t *pktbuf_writable(pktbuf_t *pb);
+
 #define pktbuf_len(pb) ((pb)->pb_size)
 #define pktbuf_ptr(pb) ((pb)->pb_data)
 
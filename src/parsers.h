@@ -36,4 +36,6 @@ void parser_set_stream_vparam(struct elementary_stream *st, int width, int heigh
 
 extern const unsigned int mpeg2video_framedurations[16];
 
+void parsers_init(void);
+
 #endif /* PARSERS_H */
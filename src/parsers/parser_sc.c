@@ -0,0 +1,68 @@
+/*
+ *  Start code scanner
+ *  Copyright (C) 2014 Tvheadend Project
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "tvheadend.h"
+#include "parser_sc.h"
+
+int (*parser_sc_find) ( const uint8_t *p, int len ) = parser_sc_find_c;
+
+/*
+ * Generic version (memchr for the 01 and look behind)
+ */
+int
+parser_sc_find_c ( const uint8_t *p, int len )
+{
+  const uint8_t *q = p + 2, *end = p + len;
+
+  while (q < end) {
+    if (!(q = memchr(q, 1, end - q)))
+      break;
+    if (!q[-1] && !q[-2])
+      return q - p - 2;
+    q++;
+  }
+  return -1;
+}
+
+/*
+ * Select the best implementation for this CPU
+ */
+void
+parser_sc_init ( void )
+{
+#if defined(__i386__) || defined(__x86_64__)
+  __builtin_cpu_init();
+#if ENABLE_AVX2
+  if (__builtin_cpu_supports("avx2")) {
+    parser_sc_find = parser_sc_find_avx2;
+    tvhlog(LOG_INFO, "parser", "Using AVX2 start code scanner");
+    return;
+  }
+#endif
+#if ENABLE_SSE2
+  if (__builtin_cpu_supports("sse2")) {
+    parser_sc_find = parser_sc_find_sse2;
+    tvhlog(LOG_INFO, "parser", "Using SSE2 start code scanner");
+    return;
+  }
+#endif
+#endif
+  tvhlog(LOG_INFO, "parser", "Using generic start code scanner");
+}
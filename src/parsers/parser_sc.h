@@ -0,0 +1,37 @@
+/*
+ *  Start code scanner
+ *  Copyright (C) 2014 Tvheadend Project
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PARSER_SC_H_
+#define PARSER_SC_H_
+
+#include <stdint.h>
+
+/*
+ * Find the first 00 00 01 start code prefix in p[0..len-1]
+ *
+ * Returns the offset of the prefix or -1 if there is none
+ */
+extern int (*parser_sc_find) ( const uint8_t *p, int len );
+
+int parser_sc_find_c    ( const uint8_t *p, int len );
+int parser_sc_find_sse2 ( const uint8_t *p, int len );
+int parser_sc_find_avx2 ( const uint8_t *p, int len );
+
+void parser_sc_init ( void );
+
+#endif /* PARSER_SC_H_ */
@@ -0,0 +1,59 @@
+/*
+ *  Start code scanner (AVX2)
+ *  Copyright (C) 2014 Tvheadend Project
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <immintrin.h>
+
+#include "parser_sc.h"
+
+static inline int
+parser_sc_find_avx2_32
+  ( const uint8_t *p, __m256i c, const __m256i zero, const __m256i one )
+{
+  __m256i a = _mm256_loadu_si256((const __m256i*)p);
+  __m256i b = _mm256_loadu_si256((const __m256i*)(p + 1));
+  unsigned int m =
+    _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(c, one),
+                         _mm256_and_si256(_mm256_cmpeq_epi8(a, zero),
+                                          _mm256_cmpeq_epi8(b, zero))));
+  return m ? __builtin_ctz(m) : -1;
+}
+
+int
+parser_sc_find_avx2 ( const uint8_t *p, int len )
+{
+  int i, r;
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one  = _mm256_set1_epi8(1);
+
+  /* Look for 01 in 64 candidate positions at a time, then confirm */
+  for (i = 0; i + 66 <= len; i += 64) {
+    __m256i c0 = _mm256_loadu_si256((const __m256i*)(p + i + 2));
+    __m256i c1 = _mm256_loadu_si256((const __m256i*)(p + i + 34));
+    if (!_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(c0, one),
+                                              _mm256_cmpeq_epi8(c1, one))))
+      continue;
+    if ((r = parser_sc_find_avx2_32(p + i, c0, zero, one)) >= 0)
+      return i + r;
+    if ((r = parser_sc_find_avx2_32(p + i + 32, c1, zero, one)) >= 0)
+      return i + 32 + r;
+  }
+
+  /* Remainder */
+  r = parser_sc_find_c(p + i, len - i);
+  return r < 0 ? r : i + r;
+}
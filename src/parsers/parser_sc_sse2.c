@@ -0,0 +1,66 @@
+/*
+ *  Start code scanner (SSE2)
+ *  Copyright (C) 2014 Tvheadend Project
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <emmintrin.h>
+
+#include "parser_sc.h"
+
+static inline int
+parser_sc_find_sse2_16
+  ( const uint8_t *p, __m128i c, const __m128i zero, const __m128i one )
+{
+  __m128i a = _mm_loadu_si128((const __m128i*)p);
+  __m128i b = _mm_loadu_si128((const __m128i*)(p + 1));
+  unsigned int m =
+    _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(c, one),
+                      _mm_and_si128(_mm_cmpeq_epi8(a, zero),
+                                    _mm_cmpeq_epi8(b, zero))));
+  return m ? __builtin_ctz(m) : -1;
+}
+
+int
+parser_sc_find_sse2 ( const uint8_t *p, int len )
+{
+  int i, r;
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one  = _mm_set1_epi8(1);
+
+  /* Look for 01 in 64 candidate positions at a time, then confirm */
+  for (i = 0; i + 66 <= len; i += 64) {
+    __m128i c0 = _mm_loadu_si128((const __m128i*)(p + i + 2));
+    __m128i c1 = _mm_loadu_si128((const __m128i*)(p + i + 18));
+    __m128i c2 = _mm_loadu_si128((const __m128i*)(p + i + 34));
+    __m128i c3 = _mm_loadu_si128((const __m128i*)(p + i + 50));
+    if (!_mm_movemask_epi8(_mm_or_si128(
+          _mm_or_si128(_mm_cmpeq_epi8(c0, one), _mm_cmpeq_epi8(c1, one)),
+          _mm_or_si128(_mm_cmpeq_epi8(c2, one), _mm_cmpeq_epi8(c3, one)))))
+      continue;
+    if ((r = parser_sc_find_sse2_16(p + i, c0, zero, one)) >= 0)
+      return i + r;
+    if ((r = parser_sc_find_sse2_16(p + i + 16, c1, zero, one)) >= 0)
+      return i + 16 + r;
+    if ((r = parser_sc_find_sse2_16(p + i + 32, c2, zero, one)) >= 0)
+      return i + 32 + r;
+    if ((r = parser_sc_find_sse2_16(p + i + 48, c3, zero, one)) >= 0)
+      return i + 48 + r;
+  }
+
+  /* Remainder */
+  r = parser_sc_find_c(p + i, len - i);
+  return r < 0 ? r : i + r;
+}
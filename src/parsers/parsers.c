@@ -30,6 +30,7 @@
 #include "parsers.h"
 #include "parser_h264.h"
 #include "parser_latm.h"
+#include "parser_sc.h"
 #include "bitstream.h"
 #include "packet.h"
 #include "streaming.h"
@@ -125,6 +126,15 @@ static void parser_deliver(service_t *t, elementary_stream_t *st, th_pkt_t *pkt,
 static int parse_pes_header(service_t *t, elementary_stream_t *st,
 			    const uint8_t *buf, size_t len);
 
+/**
+ * Initialise parsers
+ */
+void
+parsers_init(void)
+{
+  parser_sc_init();
+}
+
 /**
  * Parse raw mpeg data
  */
@@ -321,6 +331,20 @@ parse_sc(service_t *t, elementary_stream_t *st, const uint8_t *data, int len,
       continue;
     }
 
+    /* Skip to the next start code (unless one could straddle the
+       previous data), copying everything before it in one go */
+    if((sc & 0xff) && (sc & 0xffffff) != 0x000001) {
+      int k, n = parser_sc_find(data + i, len - i);
+      n = n < 0 ? len - i : MIN(n + 3, len - i);
+      memcpy(st->es_buf.sb_data + st->es_buf.sb_ptr, data + i, n);
+      st->es_buf.sb_ptr += n;
+      i += n;
+      for(k = i - MIN(n, 4); k < i; k++)
+        sc = sc << 8 | data[k];
+      if(i == len)
+        break;
+    }
+
     st->es_buf.sb_data[st->es_buf.sb_ptr++] = data[i];
     sc = sc << 8 | data[i];
 
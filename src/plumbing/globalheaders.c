@@ -208,7 +208,8 @@ gh_hold(globalheaders_t *gh, streaming_message_t *sm)
     assert(ssc != NULL);
 
     if(ssc->ssc_type == SCT_TELETEXT) {
-      free(sm);
+      sm->sm_data = NULL;
+      streaming_msg_free(sm);
       ssc->ssc_disabled = 1;
       break;
     }
@@ -220,7 +221,8 @@ gh_hold(globalheaders_t *gh, streaming_message_t *sm)
     pr = pktref_create(pkt);
     TAILQ_INSERT_TAIL(&gh->gh_holdq, pr, pr_link);
 
-    free(sm);
+    sm->sm_data = NULL;
+    streaming_msg_free(sm);
 
     if(!headers_complete(gh, gh_queue_delay(gh))) 
       break;
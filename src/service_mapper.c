@@ -331,8 +331,8 @@ service_mapper_thread ( void *aux )
 
       /* Wait for message */
       while((sm = TAILQ_FIRST(&sq.sq_queue)) == NULL)
-        pthread_cond_wait(&sq.sq_cond, &sq.sq_mutex);
-      TAILQ_REMOVE(&sq.sq_queue, sm, sm_link);
+        streaming_queue_wait(&sq, NULL);
+      streaming_queue_remove(&sq, sm);
       pthread_mutex_unlock(&sq.sq_mutex);
 
       if(sm->sm_type == SMT_PACKET) {
@@ -355,6 +355,7 @@ service_mapper_thread ( void *aux )
     }
 
     streaming_queue_clear(&sq.sq_queue);
+    sq.sq_size = 0;
     pthread_mutex_unlock(&sq.sq_mutex);
  
     pthread_mutex_lock(&global_lock);
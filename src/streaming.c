@@ -25,6 +25,19 @@
 #include "atomic.h"
 #include "service.h"
 #include "timeshift.h"
+#include "mempool.h"
+
+static mempool_t *streaming_msg_pool;
+
+/**
+ *
+ */
+void
+streaming_init(void)
+{
+  streaming_msg_pool =
+    mempool_create("streaming message", sizeof(streaming_message_t), 4096);
+}
 
 void
 streaming_pad_init(streaming_pad_t *sp)
@@ -45,6 +58,24 @@ streaming_target_init(streaming_target_t *st, st_callback_t *cb, void *opaque,
 }
 
 
+/**
+ * Payload size of a message (for queue size accounting)
+ */
+static size_t
+streaming_message_data_size(streaming_message_t *sm)
+{
+  if (sm->sm_type == SMT_PACKET) {
+    th_pkt_t *pkt = sm->sm_data;
+    if (pkt && pkt->pkt_payload)
+      return pkt->pkt_payload->pb_size;
+  } else if (sm->sm_type == SMT_MPEGTS) {
+    pktbuf_t *pkt_payload = sm->sm_data;
+    if (pkt_payload)
+      return pkt_payload->pb_size;
+  }
+  return 0;
+}
+
 /**
  *
  */
@@ -56,18 +87,73 @@ streaming_queue_deliver(void *opauqe, streaming_message_t *sm)
   pthread_mutex_lock(&sq->sq_mutex);
 
   /* queue size protection */
-  // TODO: would be better to update size as we go, but this would
-  //       require updates elsewhere to ensure all removals from the queue
-  //       are covered (new function)
-  if (sq->sq_maxsize && streaming_queue_size(&sq->sq_queue) >= sq->sq_maxsize)
+  if (sq->sq_maxsize && sq->sq_size >= sq->sq_maxsize) {
     streaming_msg_free(sm);
-  else
+  } else {
     TAILQ_INSERT_TAIL(&sq->sq_queue, sm, sm_link);
+    sq->sq_size += streaming_message_data_size(sm);
+  }
 
-  pthread_cond_signal(&sq->sq_cond);
+  /* Only wake the consumer if it's actually waiting */
+  if (sq->sq_waiting)
+    pthread_cond_signal(&sq->sq_cond);
   pthread_mutex_unlock(&sq->sq_mutex);
 }
 
+/**
+ * Remove a single message from the queue (sq_mutex must be held)
+ */
+void
+streaming_queue_remove(streaming_queue_t *sq, streaming_message_t *sm)
+{
+  sq->sq_size -= streaming_message_data_size(sm);
+  TAILQ_REMOVE(&sq->sq_queue, sm, sm_link);
+}
+
+/**
+ * Wait for messages (sq_mutex must be held)
+ *
+ * Returns ETIMEDOUT if abstime (if specified) passed
+ */
+int
+streaming_queue_wait(streaming_queue_t *sq, const struct timespec *abstime)
+{
+  int r = 0;
+  sq->sq_waiting++;
+  if (abstime)
+    r = pthread_cond_timedwait(&sq->sq_cond, &sq->sq_mutex, abstime);
+  else
+    pthread_cond_wait(&sq->sq_cond, &sq->sq_mutex);
+  sq->sq_waiting--;
+  return r;
+}
+
+/**
+ * Move all queued messages to q, waiting for some if the queue is empty
+ *
+ * This allows a consumer to take the lock once per batch rather than
+ * once per message. Returns ETIMEDOUT if abstime (if specified) passed
+ * without any messages arriving
+ */
+int
+streaming_queue_dequeue_all(streaming_queue_t *sq,
+                            struct streaming_message_queue *q,
+                            const struct timespec *abstime)
+{
+  int r = 0;
+
+  TAILQ_INIT(q);
+
+  pthread_mutex_lock(&sq->sq_mutex);
+  while (TAILQ_FIRST(&sq->sq_queue) == NULL && !r)
+    r = streaming_queue_wait(sq, abstime);
+  TAILQ_CONCAT(q, &sq->sq_queue, sm_link);
+  sq->sq_size = 0;
+  pthread_mutex_unlock(&sq->sq_mutex);
+
+  return TAILQ_FIRST(q) ? 0 : r;
+}
+
 
 /**
  *
@@ -82,6 +168,8 @@ streaming_queue_init2(streaming_queue_t *sq, int reject_filter, size_t maxsize)
   TAILQ_INIT(&sq->sq_queue);
 
   sq->sq_maxsize = maxsize;
+  sq->sq_size    = 0;
+  sq->sq_waiting = 0;
 }
 
 /**
@@ -101,6 +189,7 @@ void
 streaming_queue_deinit(streaming_queue_t *sq)
 {
   streaming_queue_clear(&sq->sq_queue);
+  sq->sq_size = 0;
   pthread_mutex_destroy(&sq->sq_mutex);
   pthread_cond_destroy(&sq->sq_cond);
 }
@@ -137,7 +226,7 @@ streaming_target_disconnect(streaming_pad_t *sp, streaming_target_t *st)
 streaming_message_t *
 streaming_msg_create(streaming_message_type_t type)
 {
-  streaming_message_t *sm = malloc(sizeof(streaming_message_t));
+  streaming_message_t *sm = mempool_alloc(streaming_msg_pool);
   sm->sm_type = type;
 #if ENABLE_TIMESHIFT
   sm->sm_time      = 0;
@@ -190,7 +279,7 @@ streaming_msg_create_code(streaming_message_type_t type, int code)
 streaming_message_t *
 streaming_msg_clone(streaming_message_t *src)
 {
-  streaming_message_t *dst = malloc(sizeof(streaming_message_t));
+  streaming_message_t *dst = mempool_alloc(streaming_msg_pool);
   streaming_start_t *ss;
 
   dst->sm_type      = src->sm_type;
@@ -305,7 +394,7 @@ streaming_msg_free(streaming_message_t *sm)
   default:
     abort();
   }
-  free(sm);
+  mempool_free(streaming_msg_pool, sm);
 }
 
 /**
@@ -375,26 +464,10 @@ streaming_queue_clear(struct streaming_message_queue *q)
 size_t streaming_queue_size(struct streaming_message_queue *q)
 {
   streaming_message_t *sm;
-  int size = 0;
-
-  TAILQ_FOREACH(sm, q, sm_link) {
-    if (sm->sm_type == SMT_PACKET)
-    {
-      th_pkt_t *pkt = sm->sm_data;
-      if (pkt && pkt->pkt_payload)
-      {
-        size += pkt->pkt_payload->pb_size;
-      }
-    }
-    else if (sm->sm_type == SMT_MPEGTS)
-    {
-      pktbuf_t *pkt_payload = sm->sm_data;
-      if (pkt_payload)
-      {
-        size += pkt_payload->pb_size;
-      }
-    }
-  }
+  size_t size = 0;
+
+  TAILQ_FOREACH(sm, q, sm_link)
+    size += streaming_message_data_size(sm);
   return size;
 }
 
@@ -66,6 +66,8 @@ typedef struct streaming_start {
 /**
  *
  */
+void streaming_init(void);
+
 void streaming_pad_init(streaming_pad_t *sp);
 
 void streaming_target_init(streaming_target_t *st,
@@ -83,6 +85,14 @@ size_t streaming_queue_size(struct streaming_message_queue *q);
 
 void streaming_queue_deinit(streaming_queue_t *sq);
 
+void streaming_queue_remove(streaming_queue_t *sq, streaming_message_t *sm);
+
+int streaming_queue_wait(streaming_queue_t *sq, const struct timespec *abstime);
+
+int streaming_queue_dequeue_all(streaming_queue_t *sq,
+                                struct streaming_message_queue *q,
+                                const struct timespec *abstime);
+
 void streaming_target_connect(streaming_pad_t *sp, streaming_target_t *st);
 
 void streaming_target_disconnect(streaming_pad_t *sp, streaming_target_t *st);
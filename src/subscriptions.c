@@ -432,6 +432,7 @@ subscription_create
   int reject = 0;
   static int tally;
   TAILQ_INIT(&s->ths_instances);
+  s->ths_queue_delay = -1;
 
   if(flags & SUBSCRIPTION_NONE)
     reject |= (SMT_TO_MASK(SMT_PACKET) | SMT_TO_MASK(SMT_MPEGTS));
@@ -708,8 +709,10 @@ subscription_create_msg(th_subscription_t *s)
   if(s->ths_channel != NULL)
     htsmsg_add_str(m, "channel", channel_get_name(s->ths_channel));
   
-  if(s->ths_service != NULL)
+  if(s->ths_service != NULL) {
     htsmsg_add_str(m, "service", s->ths_service->s_nicename ?: "");
+    descrambler_service_status(s->ths_service, m);
+  }
 
   else if (s->ths_mmi != NULL && s->ths_mmi->mmi_mux != NULL) {
     char buf[512];
@@ -717,6 +720,13 @@ subscription_create_msg(th_subscription_t *s)
     mm->mm_display_name(mm, buf, sizeof(buf));
     htsmsg_add_str(m, "service", buf);
   }
+
+  if(s->ths_queue_delay >= 0) {
+    htsmsg_add_u32(m, "queue_packets", s->ths_queue_packets);
+    htsmsg_add_u32(m, "queue_bytes", s->ths_queue_bytes);
+    htsmsg_add_s64(m, "queue_delay", s->ths_queue_delay);
+    htsmsg_add_u32(m, "queue_drops", s->ths_queue_drops);
+  }
   
   return m;
 }
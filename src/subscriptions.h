@@ -66,6 +66,13 @@ typedef struct th_subscription {
   int ths_bytes_in;   // Reset every second to get aprox. bandwidth (in)
   int ths_bytes_out; // Reset every second to get approx bandwidth (out)
 
+  /* Output queue status, set by clients that queue (HTSP), ths_queue_delay
+     in us (-1 = no queue) */
+  int ths_queue_packets;
+  int ths_queue_bytes;
+  int64_t ths_queue_delay;
+  int ths_queue_drops;
+
   streaming_target_t ths_input;
 
   streaming_target_t *ths_output;
@@ -27,6 +27,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <netinet/in.h>
@@ -376,7 +377,14 @@ tcp_get_ip_str(const struct sockaddr *sa, char *s, size_t maxlen)
 /**
  *
  */
+#define TCP_SERVER_WORKERS     4  /* Worker threads kept when idle */
+#define TCP_SERVER_WORKERS_MAX 64 /* Worker threads limit, beyond this
+                                     ready connections queue (workers
+                                     released by long-lived replies are
+                                     not counted) */
+
 static tvhpoll_t *tcp_server_poll;
+static tvhpoll_t *tcp_server_park_poll;
 
 typedef struct tcp_server {
   int serverfd;
@@ -391,18 +399,30 @@ typedef struct tcp_server_launch {
   struct sockaddr_storage peer;
   struct sockaddr_storage self;
   time_t started;
+  int suspended;  /* serve() returned TCP_SERVER_SUSPEND */
+  int resumed;    /* tcp_server_resume() called before that */
+  int released;   /* tcp_server_release() called by serve() */
   LIST_ENTRY(tcp_server_launch) link;
+  TAILQ_ENTRY(tcp_server_launch) jlink;
 } tcp_server_launch_t;
 
 static LIST_HEAD(, tcp_server_launch) tcp_server_launches = { 0 };
 
+/* Worker pool (event driven connections ready to be served) */
+static pthread_mutex_t tcp_server_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t tcp_server_cond = PTHREAD_COND_INITIALIZER;
+static TAILQ_HEAD(, tcp_server_launch) tcp_server_jobs;
+static int tcp_server_workers;
+static int tcp_server_idle;
+
+static void *tcp_server_worker(void *aux);
+
 /**
  *
  */
-static void *
-tcp_server_start(void *aux)
+static void
+tcp_server_setup(tcp_server_launch_t *tsl)
 {
-  tcp_server_launch_t *tsl = aux;
   struct timeval to;
   int val;
 
@@ -431,7 +451,11 @@ tcp_server_start(void *aux)
   to.tv_usec =  0;
   setsockopt(tsl->fd, SOL_SOCKET, SO_SNDTIMEO, &to, sizeof(to));
 
-  /* Start */
+  /* Event driven connections read what's available, a blocking read
+     (in a reply) must not hold a worker forever */
+  if (tsl->ops.serve)
+    setsockopt(tsl->fd, SOL_SOCKET, SO_RCVTIMEO, &to, sizeof(to));
+
   time(&tsl->started);
   if (tsl->ops.status) {
     pthread_mutex_lock(&global_lock);
@@ -439,6 +463,18 @@ tcp_server_start(void *aux)
     notify_reload("connections");
     pthread_mutex_unlock(&global_lock);
   }
+}
+
+/**
+ * Dedicated thread (long-lived sessions)
+ */
+static void *
+tcp_server_start(void *aux)
+{
+  tcp_server_launch_t *tsl = aux;
+
+  /* Start */
+  tcp_server_setup(tsl);
   pthread_mutex_lock(&global_lock);
   tsl->ops.start(tsl->fd, &tsl->opaque, &tsl->peer, &tsl->self);
 
@@ -454,6 +490,190 @@ tcp_server_start(void *aux)
   return NULL;
 }
 
+/**
+ * Event driven connection is finished
+ */
+static void
+tcp_server_done(tcp_server_launch_t *tsl)
+{
+  if (tsl->ops.stop) tsl->ops.stop(tsl->opaque);
+  close(tsl->fd);
+  if (tsl->ops.status && tsl->started) {
+    pthread_mutex_lock(&global_lock);
+    LIST_REMOVE(tsl, link);
+    notify_reload("connections");
+    pthread_mutex_unlock(&global_lock);
+  }
+  free(tsl);
+}
+
+/**
+ * Wait (without a thread) until the connection is readable
+ */
+static void
+tcp_server_park(tcp_server_launch_t *tsl)
+{
+  tvhpoll_event_t ev;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.fd       = tsl->fd;
+  ev.events   = TVHPOLL_IN;
+  ev.data.ptr = tsl;
+  if (tvhpoll_add(tcp_server_park_poll, &ev, 1))
+    tcp_server_done(tsl);
+}
+
+/**
+ * Queue connection for the worker pool (tcp_server_mutex held)
+ */
+static void
+tcp_server_dispatch0(tcp_server_launch_t *tsl)
+{
+  pthread_t tid;
+
+  TAILQ_INSERT_TAIL(&tcp_server_jobs, tsl, jlink);
+  if (tcp_server_idle > 0) {
+    pthread_cond_signal(&tcp_server_cond);
+  } else if (tcp_server_workers < TCP_SERVER_WORKERS_MAX) {
+    tcp_server_workers++;
+    tvhthread_create(&tid, NULL, tcp_server_worker, NULL, 1);
+  }
+}
+
+/**
+ * Queue connection for the worker pool
+ */
+static void
+tcp_server_dispatch(tcp_server_launch_t *tsl)
+{
+  pthread_mutex_lock(&tcp_server_mutex);
+  tcp_server_dispatch0(tsl);
+  pthread_mutex_unlock(&tcp_server_mutex);
+}
+
+/**
+ * Worker pool thread, extra workers (started when all are busy, e.g.
+ * serving streams) exit when idle
+ */
+static void *
+tcp_server_worker(void *aux)
+{
+  tcp_server_launch_t *tsl;
+  int r, released;
+
+  pthread_mutex_lock(&tcp_server_mutex);
+  while (1) {
+    if ((tsl = TAILQ_FIRST(&tcp_server_jobs)) == NULL) {
+      if (tcp_server_idle >= TCP_SERVER_WORKERS)
+        break;
+      tcp_server_idle++;
+      pthread_cond_wait(&tcp_server_cond, &tcp_server_mutex);
+      tcp_server_idle--;
+      continue;
+    }
+    TAILQ_REMOVE(&tcp_server_jobs, tsl, jlink);
+    pthread_mutex_unlock(&tcp_server_mutex);
+
+    if (!tsl->started)
+      tcp_server_setup(tsl);
+
+    r = tsl->ops.serve(tsl->fd, &tsl->opaque, &tsl->peer, &tsl->self);
+    released = tsl->released;
+    tsl->released = 0;
+    if (r == TCP_SERVER_PARK)
+      tcp_server_park(tsl);
+    else if (r != TCP_SERVER_SUSPEND)
+      tcp_server_done(tsl);
+
+    pthread_mutex_lock(&tcp_server_mutex);
+    if (released)
+      tcp_server_workers++;
+    if (r == TCP_SERVER_SUSPEND) {
+      if (tsl->resumed) {
+        tsl->resumed = 0;
+        TAILQ_INSERT_TAIL(&tcp_server_jobs, tsl, jlink);
+      } else {
+        tsl->suspended = 1;
+      }
+    }
+  }
+  tcp_server_workers--;
+  pthread_mutex_unlock(&tcp_server_mutex);
+  return NULL;
+}
+
+/**
+ * Serve a suspended connection again, opaque is the pointer passed
+ * to serve() (may be called before serve() has returned)
+ */
+void
+tcp_server_resume(void **opaque)
+{
+  tcp_server_launch_t *tsl =
+    (void *)((char *)opaque - offsetof(tcp_server_launch_t, opaque));
+
+  pthread_mutex_lock(&tcp_server_mutex);
+  if (tsl->suspended) {
+    tsl->suspended = 0;
+    tcp_server_dispatch0(tsl);
+  } else {
+    tsl->resumed = 1;
+  }
+  pthread_mutex_unlock(&tcp_server_mutex);
+}
+
+/**
+ * Called from serve() before a long-lived reply (e.g. a stream), the
+ * worker no longer counts against TCP_SERVER_WORKERS_MAX until serve()
+ * returns, so streams can't starve the other connections
+ */
+void
+tcp_server_release(void **opaque)
+{
+  tcp_server_launch_t *tsl =
+    (void *)((char *)opaque - offsetof(tcp_server_launch_t, opaque));
+  pthread_t tid;
+
+  pthread_mutex_lock(&tcp_server_mutex);
+  if (!tsl->released) {
+    tsl->released = 1;
+    tcp_server_workers--;
+    /* Jobs may be waiting for the worker limit */
+    if (!TAILQ_EMPTY(&tcp_server_jobs) && tcp_server_idle == 0) {
+      tcp_server_workers++;
+      tvhthread_create(&tid, NULL, tcp_server_worker, NULL, 1);
+    }
+  }
+  pthread_mutex_unlock(&tcp_server_mutex);
+}
+
+/**
+ * Parked (idle) connections
+ */
+static void *
+tcp_server_park_loop(void *aux)
+{
+  tvhpoll_event_t ev[16];
+  tcp_server_launch_t *tsl;
+  int i, r;
+
+  while(1) {
+    r = tvhpoll_wait(tcp_server_park_poll, ev, 16, -1);
+    if(r == -1) {
+      if (errno != EINTR)
+        perror("tcp_server: tvhpoll_wait");
+      continue;
+    }
+
+    for (i = 0; i < r; i++) {
+      tsl = ev[i].data.ptr;
+      ev[i].fd = tsl->fd;
+      tvhpoll_rem(tcp_server_park_poll, &ev[i], 1);
+      tcp_server_dispatch(tsl);
+    }
+  }
+  return NULL;
+}
 
 /**
  *
@@ -511,7 +731,16 @@ tcp_server_loop(void *aux)
         continue;
      	}
 
-     	tvhthread_create(&tid, &attr, tcp_server_start, tsl, 1);
+      if (tsl->ops.serve) {
+        /* Setup is done by the first worker, not to block accept */
+        tsl->started   = 0;
+        tsl->suspended = 0;
+        tsl->resumed   = 0;
+        tsl->released  = 0;
+        tcp_server_park(tsl);
+      } else {
+     	  tvhthread_create(&tid, &attr, tcp_server_start, tsl, 1);
+      }
     }
   }
   return NULL;
@@ -643,6 +872,11 @@ tcp_server_init(int opt_ipv6)
   if(opt_ipv6)
     tcp_preferred_address_family = AF_INET6;
 
+  TAILQ_INIT(&tcp_server_jobs);
+
   tcp_server_poll = tvhpoll_create(10);
   tvhthread_create(&tid, NULL, tcp_server_loop, NULL, 1);
+
+  tcp_server_park_poll = tvhpoll_create(256);
+  tvhthread_create(&tid, NULL, tcp_server_park_loop, NULL, 1);
 }
@@ -22,11 +22,22 @@
 #include "htsbuf.h"
 #include "htsmsg.h"
 
+#define TCP_SERVER_CLOSE 0 /* serve(): done with the connection */
+#define TCP_SERVER_PARK  1 /* serve(): wait for more input */
+#define TCP_SERVER_SUSPEND 2 /* serve(): call again on tcp_server_resume() */
+
 typedef struct tcp_server_ops
 {
+  /* Long-lived sessions, run in a dedicated thread (global_lock held) */
   void (*start)  (int fd, void **opaque,
                      struct sockaddr_storage *peer,
                      struct sockaddr_storage *self);
+  /* Event driven, called from the worker pool whenever the connection
+     is readable, returns TCP_SERVER_CLOSE, TCP_SERVER_PARK or
+     TCP_SERVER_SUSPEND */
+  int  (*serve)  (int fd, void **opaque,
+                     struct sockaddr_storage *peer,
+                     struct sockaddr_storage *self);
   void (*stop)   (void *opaque);
   void (*status) (void *opaque, htsmsg_t *m);
 } tcp_server_ops_t;
@@ -60,4 +71,8 @@ char *tcp_get_ip_str(const struct sockaddr *sa, char *s, size_t maxlen);
 
 htsmsg_t *tcp_server_connections ( void );
 
+void tcp_server_resume(void **opaque);
+
+void tcp_server_release(void **opaque);
+
 #endif /* TCP_H_ */
@@ -33,6 +33,8 @@
 #include <stdio.h>
 
 static int timeshift_index = 0;
+static int timeshift_buffer_index = 0;
+static LIST_HEAD(,timeshift_buffer) timeshift_buffers;
 
 uint32_t  timeshift_enabled;
 int       timeshift_ondemand;
@@ -41,6 +43,10 @@ int       timeshift_unlimited_period;
 uint32_t  timeshift_max_period;
 int       timeshift_unlimited_size;
 uint64_t  timeshift_max_size;
+int       timeshift_shared;
+uint64_t  timeshift_ram_size;
+uint64_t  timeshift_ram_service_size;
+int       timeshift_ram_only;
 
 /*
  * Intialise global file manager
@@ -61,6 +67,10 @@ void timeshift_init ( void )
   timeshift_max_period       = 3600;                    // 1Hr
   timeshift_unlimited_size   = 0;
   timeshift_max_size         = 10000 * (size_t)1048576; // 10G
+  timeshift_shared           = 0;
+  timeshift_ram_size         = 0;                       // Disk only
+  timeshift_ram_service_size = 0;                       // No limit
+  timeshift_ram_only         = 0;
 
   /* Load settings */
   if ((m = hts_settings_load("timeshift/config"))) {
@@ -77,6 +87,14 @@ void timeshift_init ( void )
       timeshift_unlimited_size = u32 ? 1 : 0;
     if (!htsmsg_get_u32(m, "max_size", &u32))
       timeshift_max_size = 1048576LL * u32;
+    if (!htsmsg_get_u32(m, "shared", &u32))
+      timeshift_shared = u32 ? 1 : 0;
+    if (!htsmsg_get_u32(m, "ram_size", &u32))
+      timeshift_ram_size = 1048576LL * u32;
+    if (!htsmsg_get_u32(m, "ram_service_size", &u32))
+      timeshift_ram_service_size = 1048576LL * u32;
+    if (!htsmsg_get_u32(m, "ram_only", &u32))
+      timeshift_ram_only = u32 ? 1 : 0;
     htsmsg_destroy(m);
   }
 }
@@ -105,10 +123,223 @@ void timeshift_save ( void )
   htsmsg_add_u32(m, "max_period", timeshift_max_period);
   htsmsg_add_u32(m, "unlimited_size", timeshift_unlimited_size);
   htsmsg_add_u32(m, "max_size", timeshift_max_size / 1048576);
+  htsmsg_add_u32(m, "shared", timeshift_shared);
+  htsmsg_add_u32(m, "ram_size", timeshift_ram_size / 1048576);
+  htsmsg_add_u32(m, "ram_service_size", timeshift_ram_service_size / 1048576);
+  htsmsg_add_u32(m, "ram_only", timeshift_ram_only);
 
   hts_settings_save(m, "timeshift/config");
 }
 
+/* **************************************************************************
+ * Buffer
+ * *************************************************************************/
+
+/*
+ * PTS offset of an instance to its buffer (feed_mutex held)
+ *
+ * Until a payload common with the feeder has been seen this is estimated
+ * from the clock deltas (which is all that can be done for instances fed
+ * from different services)
+ */
+static int64_t _timeshift_pts_offset ( timeshift_t *ts )
+{
+  timeshift_buffer_t *tb = ts->buf;
+
+  if (ts->pts_offset != PTS_UNSET)
+    return ts->pts_offset;
+  if (ts->pts_delta == PTS_UNSET || tb->pts_delta == PTS_UNSET)
+    return 0;
+  return ts_rescale_i(tb->pts_delta - ts->pts_delta, 1000000);
+}
+
+int64_t timeshift_pts_offset ( timeshift_t *ts )
+{
+  int64_t r;
+  pthread_mutex_lock(&ts->buf->feed_mutex);
+  r = _timeshift_pts_offset(ts);
+  pthread_mutex_unlock(&ts->buf->feed_mutex);
+  return r;
+}
+
+/*
+ * Pass message to the buffer writer (feeder only) and match the PTS
+ * bases of the other attached instances
+ */
+static void timeshift_buffer_feed
+  ( timeshift_t *ts, streaming_message_t *sm )
+{
+  timeshift_buffer_t *tb = ts->buf;
+  timeshift_t *ts2;
+  th_pkt_t *pkt = NULL;
+  streaming_message_t *sm2;
+  int64_t off;
+
+  if (sm->sm_type == SMT_PACKET)
+    pkt = sm->sm_data;
+
+  pthread_mutex_lock(&tb->feed_mutex);
+
+  /* Not feeding, just look for a common payload */
+  if (tb->feeder != ts) {
+    if (pkt && pkt->pkt_payload && pkt->pkt_pts != PTS_UNSET &&
+        ts->pts_offset == PTS_UNSET) {
+      if (pkt->pkt_payload == tb->feed_payload) {
+        ts->pts_offset = pkt->pkt_pts - tb->feed_pts;
+        tvhlog(LOG_DEBUG, "timeshift", "ts %d pts offset %"PRId64" to buffer %d",
+               ts->id, ts->pts_offset, tb->id);
+      } else {
+        if (ts->probe_payload)
+          pktbuf_ref_dec(ts->probe_payload);
+        pktbuf_ref_inc(pkt->pkt_payload);
+        ts->probe_payload = pkt->pkt_payload;
+        ts->probe_pts     = pkt->pkt_pts;
+      }
+    }
+    pthread_mutex_unlock(&tb->feed_mutex);
+    streaming_msg_free(sm);
+    return;
+  }
+
+  if (pkt) {
+
+    /* Rebase */
+    if ((off = _timeshift_pts_offset(ts)) != 0) {
+      pkt = pkt_copy_shallow(pkt);
+      if (pkt->pkt_pts != PTS_UNSET)
+        pkt->pkt_pts -= off;
+      if (pkt->pkt_dts != PTS_UNSET)
+        pkt->pkt_dts -= off;
+      sm2 = streaming_msg_create_pkt(pkt);
+      pkt_ref_dec(pkt);
+      sm2->sm_time = sm->sm_time;
+      streaming_msg_free(sm);
+      sm = sm2;
+    }
+
+    /* Resolve waiting probes */
+    if (pkt->pkt_payload && pkt->pkt_pts != PTS_UNSET) {
+      if (tb->feed_payload)
+        pktbuf_ref_dec(tb->feed_payload);
+      pktbuf_ref_inc(pkt->pkt_payload);
+      tb->feed_payload = pkt->pkt_payload;
+      tb->feed_pts     = pkt->pkt_pts;
+      LIST_FOREACH(ts2, &tb->attached, buf_link)
+        if (ts2->pts_offset == PTS_UNSET &&
+            ts2->probe_payload == pkt->pkt_payload) {
+          ts2->pts_offset = ts2->probe_pts - tb->feed_pts;
+          tvhlog(LOG_DEBUG, "timeshift", "ts %d pts offset %"PRId64" to buffer %d",
+                 ts2->id, ts2->pts_offset, tb->id);
+        }
+    }
+  }
+
+  pthread_mutex_unlock(&tb->feed_mutex);
+
+  streaming_target_deliver2(&tb->wr_queue.sq_st, sm);
+}
+
+/*
+ * Attach instance to a buffer, shared with other instances using the
+ * same key (and period) or private if key is NULL
+ */
+static timeshift_buffer_t *timeshift_buffer_attach
+  ( timeshift_t *ts, time_t max_time, void *key )
+{
+  timeshift_buffer_t *tb = NULL;
+
+  lock_assert(&global_lock);
+
+  if (key)
+    LIST_FOREACH(tb, &timeshift_buffers, link)
+      if (tb->key == key && tb->max_time == max_time)
+        break;
+
+  if (!tb) {
+    tb = calloc(1, sizeof(timeshift_buffer_t));
+    TAILQ_INIT(&tb->files);
+    LIST_INIT(&tb->attached);
+    tb->id        = timeshift_buffer_index++;
+    tb->max_time  = max_time;
+    tb->key       = key;
+    tb->vididx    = -1;
+    tb->pts_delta = PTS_UNSET;
+    pthread_mutex_init(&tb->rdwr_mutex, NULL);
+    pthread_mutex_init(&tb->feed_mutex, NULL);
+    streaming_queue_init(&tb->wr_queue, 0);
+    tvhthread_create(&tb->wr_thread, NULL, timeshift_writer, tb, 0);
+    if (key)
+      LIST_INSERT_HEAD(&timeshift_buffers, tb, link);
+    ts->pts_offset = 0;
+  } else {
+    tvhlog(LOG_DEBUG, "timeshift", "ts %d attach to shared buffer %d",
+           ts->id, tb->id);
+  }
+
+  tb->refcount++;
+  pthread_mutex_lock(&tb->feed_mutex);
+  LIST_INSERT_HEAD(&tb->attached, ts, buf_link);
+  if (!tb->feeder)
+    tb->feeder = ts;
+  pthread_mutex_unlock(&tb->feed_mutex);
+
+  return tb;
+}
+
+/*
+ * Detach instance from its buffer, the last one destroys it
+ */
+static void timeshift_buffer_detach ( timeshift_t *ts )
+{
+  timeshift_buffer_t *tb = ts->buf;
+  streaming_message_t *sm;
+
+  lock_assert(&global_lock);
+
+  pthread_mutex_lock(&tb->feed_mutex);
+  LIST_REMOVE(ts, buf_link);
+  if (tb->feeder == ts) {
+    tb->feeder = LIST_FIRST(&tb->attached);
+    if (tb->feeder) {
+      /* Fix the offset while feeding */
+      tb->feeder->pts_offset = _timeshift_pts_offset(tb->feeder);
+      tvhlog(LOG_DEBUG, "timeshift", "ts %d feeds buffer %d",
+             tb->feeder->id, tb->id);
+    }
+  }
+  if (ts->probe_payload) {
+    pktbuf_ref_dec(ts->probe_payload);
+    ts->probe_payload = NULL;
+  }
+  pthread_mutex_unlock(&tb->feed_mutex);
+
+  ts->buf = NULL;
+  if (--tb->refcount > 0)
+    return;
+
+  if (tb->key)
+    LIST_REMOVE(tb, link);
+
+  /* Stop writer */
+  sm = streaming_msg_create(SMT_EXIT);
+  streaming_target_deliver2(&tb->wr_queue.sq_st, sm);
+  pthread_join(tb->wr_thread, NULL);
+  streaming_queue_deinit(&tb->wr_queue);
+
+  /* Flush files */
+  timeshift_filemgr_flush(tb, NULL);
+
+  if (tb->feed_payload)
+    pktbuf_ref_dec(tb->feed_payload);
+  if (tb->path)
+    free(tb->path);
+  free(tb);
+}
+
+/* **************************************************************************
+ * Instance
+ * *************************************************************************/
+
 /*
  * Receive data
  */
@@ -117,6 +348,7 @@ static void timeshift_input
 {
   int exit = 0;
   timeshift_t *ts = opaque;
+  timeshift_buffer_t *tb = ts->buf;
 
   pthread_mutex_lock(&ts->state_mutex);
 
@@ -132,8 +364,13 @@ static void timeshift_input
   else {
 
     /* Start */
-    if (sm->sm_type == SMT_START && ts->state == TS_INIT) {
-      ts->state  = TS_LIVE;
+    if (sm->sm_type == SMT_START) {
+      if (ts->state == TS_INIT)
+        ts->state  = TS_LIVE;
+      if (ts->smt_live)
+        streaming_start_unref(ts->smt_live);
+      ts->smt_live = sm->sm_data;
+      atomic_add(&ts->smt_live->ss_refcount, 1);
     }
 
     /* Pass-thru */
@@ -155,14 +392,22 @@ static void timeshift_input
     /* Record (one-off) PTS delta */
     if (sm->sm_type == SMT_PACKET && ts->pts_delta == PTS_UNSET) {
       th_pkt_t *pkt = sm->sm_data;
-      if (pkt->pkt_pts != PTS_UNSET)
+      if (pkt->pkt_pts != PTS_UNSET) {
         ts->pts_delta = getmonoclock() - ts_rescale(pkt->pkt_pts, 1000000);
+        pthread_mutex_lock(&tb->feed_mutex);
+        if (tb->feeder == ts && tb->pts_delta == PTS_UNSET)
+          tb->pts_delta = ts->pts_delta +
+                          ts_rescale(_timeshift_pts_offset(ts), 1000000);
+        pthread_mutex_unlock(&tb->feed_mutex);
+      }
     }
 
-    /* Buffer to disk */
-    if ((ts->state > TS_LIVE) || (!ts->ondemand && (ts->state == TS_LIVE))) {
+    /* Buffer (the writer lives as long as the buffer, so no exit/stop) */
+    if (exit || (sm->sm_type == SMT_STOP))
+      streaming_msg_free(sm);
+    else if ((ts->state > TS_LIVE) || (!ts->ondemand && (ts->state == TS_LIVE))) {
       sm->sm_time = getmonoclock();
-      streaming_target_deliver2(&ts->wr_queue.sq_st, sm);
+      timeshift_buffer_feed(ts, sm);
     } else
       streaming_msg_free(sm);
 
@@ -183,39 +428,31 @@ void
 timeshift_destroy(streaming_target_t *pad)
 {
   timeshift_t *ts = (timeshift_t*)pad;
-  streaming_message_t *sm;
 
   /* Must hold global lock */
   lock_assert(&global_lock);
 
-  /* Ensure the threads exits */
-  // Note: this is a workaround for the fact the Q might have been flushed
-  //       in reader thread (VERY unlikely)
+  /* Ensure the reader exits */
   pthread_mutex_lock(&ts->state_mutex);
-  sm = streaming_msg_create(SMT_EXIT);
-  streaming_target_deliver2(&ts->wr_queue.sq_st, sm);
   timeshift_write_exit(ts->rd_pipe.wr);
   pthread_mutex_unlock(&ts->state_mutex);
 
-  /* Wait for all threads */
+  /* Wait for reader */
   pthread_join(ts->rd_thread, NULL);
-  pthread_join(ts->wr_thread, NULL);
 
   /* Shut stuff down */
-  streaming_queue_deinit(&ts->wr_queue);
-
   close(ts->rd_pipe.rd);
   close(ts->rd_pipe.wr);
 
-  /* Flush files */
-  timeshift_filemgr_flush(ts, NULL);
+  /* Release buffer (and writer if last) */
+  timeshift_buffer_detach(ts);
 
   /* Release SMT_START index */
   if (ts->smt_start)
     streaming_start_unref(ts->smt_start);
+  if (ts->smt_live)
+    streaming_start_unref(ts->smt_live);
 
-  if (ts->path)
-    free(ts->path);
   free(ts);
 }
 
@@ -224,9 +461,10 @@ timeshift_destroy(streaming_target_t *pad)
  *
  * max_period of buffer in seconds (0 = unlimited)
  * max_size   of buffer in bytes   (0 = unlimited)
+ * key        to share the buffer with other instances (e.g. the channel)
  */
 streaming_target_t *timeshift_create
-  (streaming_target_t *out, time_t max_time)
+  (streaming_target_t *out, time_t max_time, void *key)
 {
   timeshift_t *ts = calloc(1, sizeof(timeshift_t));
 
@@ -234,26 +472,24 @@ streaming_target_t *timeshift_create
   lock_assert(&global_lock);
 
   /* Setup structure */
-  TAILQ_INIT(&ts->files);
   ts->output     = out;
-  ts->path       = NULL;
-  ts->max_time   = max_time;
   ts->state      = TS_INIT;
-  ts->full       = 0;
-  ts->vididx     = -1;
   ts->id         = timeshift_index;
   ts->ondemand   = timeshift_ondemand;
   ts->pts_delta  = PTS_UNSET;
-  pthread_mutex_init(&ts->rdwr_mutex, NULL);
+  ts->pts_offset = PTS_UNSET;
   pthread_mutex_init(&ts->state_mutex, NULL);
 
+  /* Sharing needs a permanently fed buffer */
+  if (!timeshift_shared || ts->ondemand)
+    key = NULL;
+  ts->buf = timeshift_buffer_attach(ts, max_time, key);
+
   /* Initialise output */
   tvh_pipe(O_NONBLOCK, &ts->rd_pipe);
 
   /* Initialise input */
-  streaming_queue_init(&ts->wr_queue, 0);
   streaming_target_init(&ts->input, timeshift_input, ts, 0);
-  tvhthread_create(&ts->wr_thread, NULL, timeshift_writer, ts, 0);
   tvhthread_create(&ts->rd_thread, NULL, timeshift_reader, ts, 0);
 
   /* Update index */
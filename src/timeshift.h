@@ -27,6 +27,11 @@ extern uint32_t  timeshift_max_period;
 extern int       timeshift_unlimited_size;
 extern uint64_t  timeshift_max_size;
 extern uint64_t  timeshift_total_size;
+extern int       timeshift_shared;
+extern uint64_t  timeshift_ram_size;
+extern uint64_t  timeshift_ram_service_size;
+extern int       timeshift_ram_only;
+extern uint64_t  timeshift_ram_total_size;
 
 typedef struct timeshift_status
 {
@@ -41,7 +46,7 @@ void timeshift_term ( void );
 void timeshift_save ( void );
 
 streaming_target_t *timeshift_create
-  (streaming_target_t *out, time_t max_period);
+  (streaming_target_t *out, time_t max_period, void *key);
 
 void timeshift_destroy(streaming_target_t *pad);
 
@@ -21,19 +21,21 @@
 
 #define TIMESHIFT_PLAY_BUF    2000000 // us to buffer in TX
 #define TIMESHIFT_FILE_PERIOD      60 // number of secs in each buffer file
+#define TIMESHIFT_WBUF_SIZE    131072 // bytes coalesced before a write()
+#define TIMESHIFT_WBUF_TIME    500000 // us before coalesced data is written
+#define TIMESHIFT_RA_SIZE      262144 // bytes read ahead by the reader
 
 /**
  * Indexes of import data in the stream
+ *
+ * I-frames are kept in an array per file, in time order (binary search)
  */
 typedef struct timeshift_index_iframe
 {
   off_t                               pos;    ///< Position in the file
   int64_t                             time;   ///< Packet time
-  TAILQ_ENTRY(timeshift_index_iframe) link;   ///< List entry
 } timeshift_index_iframe_t;
 
-typedef TAILQ_HEAD(timeshift_index_iframe_list,timeshift_index_iframe) timeshift_index_iframe_list_t;
-
 /**
  * Indexes of import data in the stream
  */
@@ -54,15 +56,27 @@ typedef struct timeshift_file
   int                           fd;       ///< Write descriptor
   char                          *path;    ///< Full path to file
 
+  uint8_t                       *ram;     ///< RAM segment (NULL = on disk)
+  size_t                        ram_alloc;///< RAM segment allocated size
+  size_t                        ram_limit;///< RAM segment share of limits
+  pthread_mutex_t               ram_lock; ///< RAM segment (realloc) lock
+
+  uint8_t                       *wbuf;    ///< Write buffer (not yet in fd)
+  size_t                        wbuf_len; ///< Write buffer used size
+  int64_t                       wbuf_time;///< Write buffer oldest data
+
   time_t                        time;     ///< Files coarse timestamp
   size_t                        size;     ///< Current file size;
   int64_t                       last;     ///< Latest timestamp
 
   uint8_t                       bad;      ///< File is broken
+  uint8_t                       closed;   ///< Complete (EOF written)
 
   int                           refcount; ///< Reader ref count
 
-  timeshift_index_iframe_list_t iframes;  ///< I-frame indexing
+  timeshift_index_iframe_t      *iframes; ///< I-frame indexing
+  int                           iframes_count; ///< I-frames indexed
+  int                           iframes_alloc; ///< I-frames allocated
   timeshift_index_data_list_t   sstart;   ///< Stream start messages
 
   TAILQ_ENTRY(timeshift_file) link;     ///< List entry
@@ -70,6 +84,39 @@ typedef struct timeshift_file
 
 typedef TAILQ_HEAD(timeshift_file_list,timeshift_file) timeshift_file_list_t;
 
+/**
+ * Buffer (files and writer), possibly shared by several timeshift
+ * instances on the same channel
+ *
+ * One attached instance (the feeder) writes its input to the buffer, all
+ * instances read from it. PTS values are stored in the buffer's time base
+ * (that of the first feeder), see timeshift_t.pts_offset.
+ */
+typedef struct timeshift_buffer {
+  int                         id;         ///< Reference number
+  char                        *path;      ///< Directory containing buffer
+  time_t                      max_time;   ///< Maximum period to shift
+  void                        *key;       ///< Sharing key (NULL = private)
+  int                         refcount;   ///< Attached instances (global_lock)
+  LIST_ENTRY(timeshift_buffer) link;      ///< Shared buffers (global_lock)
+
+  pthread_mutex_t             feed_mutex; ///< Protect feeder/attached
+  struct timeshift            *feeder;    ///< Instance writing the buffer
+  LIST_HEAD(,timeshift)       attached;   ///< Attached instances
+  pktbuf_t                    *feed_payload; ///< Last fed payload (matching)
+  int64_t                     feed_pts;   ///< Last fed PTS (buffer base)
+  int64_t                     pts_delta;  ///< Delta between clock and PTS
+
+  uint8_t                     full;       ///< Buffer is full
+  int                         vididx;     ///< Index of (current) video stream
+
+  streaming_queue_t           wr_queue;   ///< Writer queue
+  pthread_t                   wr_thread;  ///< Writer thread
+
+  pthread_mutex_t             rdwr_mutex; ///< Buffer protection
+  timeshift_file_list_t       files;      ///< List of files
+} timeshift_buffer_t;
+
 /**
  *
  */
@@ -79,11 +126,19 @@ typedef struct timeshift {
   streaming_target_t          *output;    ///< Output dest
 
   int                         id;         ///< Reference number
-  char                        *path;      ///< Directory containing buffer
-  time_t                      max_time;   ///< Maximum period to shift
   int                         ondemand;   ///< Whether this is an on-demand timeshift
   int64_t                     pts_delta;  ///< Delta between system clock and PTS
 
+  timeshift_buffer_t          *buf;       ///< Buffer
+  LIST_ENTRY(timeshift)       buf_link;   ///< Buffer attached list
+
+  /* PTS offset to the buffer time base (feed_mutex), i.e. own PTS =
+     buffer PTS + pts_offset. Found by matching a payload also seen by
+     the feeder (probe), as each subscription has its own PTS base */
+  int64_t                     pts_offset;
+  pktbuf_t                    *probe_payload;
+  int64_t                     probe_pts;
+
   enum {
     TS_INIT,
     TS_EXIT,
@@ -92,37 +147,39 @@ typedef struct timeshift {
     TS_PLAY,
   }                           state;       ///< Play state
   pthread_mutex_t             state_mutex; ///< Protect state changes
-  uint8_t                     full;        ///< Buffer is full
   
   streaming_start_t          *smt_start;   ///< Current stream makeup
-
-  streaming_queue_t           wr_queue;   ///< Writer queue
-  pthread_t                   wr_thread;  ///< Writer thread
+  streaming_start_t          *smt_live;    ///< Live (input) stream makeup
 
   pthread_t                   rd_thread;  ///< Reader thread
   th_pipe_t                   rd_pipe;    ///< Message passing to reader
 
-  pthread_mutex_t             rdwr_mutex; ///< Buffer protection
-  timeshift_file_list_t       files;      ///< List of files
-
-  int                         vididx;     ///< Index of (current) video stream
+  uint8_t                    *ra_buf;     ///< Reader readahead buffer
+  timeshift_file_t           *ra_file;    ///< Readahead file (NULL = none)
+  off_t                       ra_off;     ///< Readahead file position
+  size_t                      ra_len;     ///< Readahead data length
 
 } timeshift_t;
 
 /*
  * Write functions
  */
-ssize_t timeshift_write_start   ( int fd, int64_t time, streaming_start_t *ss );
-ssize_t timeshift_write_sigstat ( int fd, int64_t time, signal_status_t *ss );
-ssize_t timeshift_write_packet  ( int fd, int64_t time, th_pkt_t *pkt );
-ssize_t timeshift_write_mpegts  ( int fd, int64_t time, void *data );
+ssize_t timeshift_write         ( int fd, const void *buf, size_t count );
+ssize_t timeshift_write_sigstat
+  ( timeshift_file_t *tsf, int64_t time, signal_status_t *ss );
+ssize_t timeshift_write_packet
+  ( timeshift_file_t *tsf, int64_t time, th_pkt_t *pkt );
+ssize_t timeshift_write_mpegts
+  ( timeshift_file_t *tsf, int64_t time, void *data );
 ssize_t timeshift_write_skip    ( int fd, streaming_skip_t *skip );
 ssize_t timeshift_write_speed   ( int fd, int speed );
 ssize_t timeshift_write_stop    ( int fd, int code );
 ssize_t timeshift_write_exit    ( int fd );
-ssize_t timeshift_write_eof     ( int fd );
+ssize_t timeshift_write_eof     ( timeshift_file_t *tsf );
+
+void timeshift_writer_flush ( timeshift_buffer_t *tb );
 
-void timeshift_writer_flush ( timeshift_t *ts );
+int64_t timeshift_pts_offset ( timeshift_t *ts );
 
 /*
  * Threads
@@ -138,18 +195,22 @@ void timeshift_filemgr_term     ( void );
 int  timeshift_filemgr_makedirs ( int ts_index, char *buf, size_t len );
 
 timeshift_file_t *timeshift_filemgr_get
-  ( timeshift_t *ts, int create );
+  ( timeshift_buffer_t *tb, int create );
 timeshift_file_t *timeshift_filemgr_oldest
-  ( timeshift_t *ts );
+  ( timeshift_buffer_t *tb );
 timeshift_file_t *timeshift_filemgr_newest
-  ( timeshift_t *ts );
+  ( timeshift_buffer_t *tb );
 timeshift_file_t *timeshift_filemgr_prev
   ( timeshift_file_t *ts, int *end, int keep );
 timeshift_file_t *timeshift_filemgr_next
   ( timeshift_file_t *ts, int *end, int keep );
 void timeshift_filemgr_remove
-  ( timeshift_t *ts, timeshift_file_t *tsf, int force );
-void timeshift_filemgr_flush ( timeshift_t *ts, timeshift_file_t *end );
+  ( timeshift_buffer_t *tb, timeshift_file_t *tsf, int force );
+void timeshift_filemgr_flush ( timeshift_buffer_t *tb, timeshift_file_t *end );
 void timeshift_filemgr_close ( timeshift_file_t *tsf );
 
+ssize_t timeshift_filemgr_write
+  ( timeshift_file_t *tsf, const void *buf, size_t count );
+ssize_t timeshift_filemgr_sync  ( timeshift_file_t *tsf );
+
 #endif /* __TVH_TIMESHIFT_PRIVATE_H__ */
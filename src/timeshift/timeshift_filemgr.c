@@ -39,6 +39,9 @@ static pthread_mutex_t       timeshift_reaper_lock;
 static pthread_cond_t        timeshift_reaper_cond;
 
 uint64_t                     timeshift_total_size;
+uint64_t                     timeshift_ram_total_size;
+
+#define TIMESHIFT_RAM_INITIAL (1024 * 1024)
 
 /* **************************************************************************
  * File reaper thread
@@ -48,7 +51,6 @@ static void* timeshift_reaper_callback ( void *p )
 {
   char *dpath;
   timeshift_file_t *tsf;
-  timeshift_index_iframe_t *ti;
   timeshift_index_data_t *tid;
   streaming_message_t *sm;
   pthread_mutex_lock(&timeshift_reaper_lock);
@@ -66,18 +68,20 @@ static void* timeshift_reaper_callback ( void *p )
     tvhtrace("timeshift", "remove file %s", tsf->path);
 
     /* Remove */
-    unlink(tsf->path);
-    dpath = dirname(tsf->path);
-    if (rmdir(dpath) == -1)
-      if (errno != ENOTEMPTY)
-        tvhlog(LOG_ERR, "timeshift", "failed to remove %s [e=%s]",
-               dpath, strerror(errno));
+    if (tsf->ram) {
+      free(tsf->ram);
+      pthread_mutex_destroy(&tsf->ram_lock);
+    } else {
+      unlink(tsf->path);
+      dpath = dirname(tsf->path);
+      if (rmdir(dpath) == -1)
+        if (errno != ENOTEMPTY)
+          tvhlog(LOG_ERR, "timeshift", "failed to remove %s [e=%s]",
+                 dpath, strerror(errno));
+    }
 
     /* Free memory */
-    while ((ti = TAILQ_FIRST(&tsf->iframes))) {
-      TAILQ_REMOVE(&tsf->iframes, ti, link);
-      free(ti);
-    }
+    free(tsf->iframes);
     while ((tid = TAILQ_FIRST(&tsf->sstart))) {
       TAILQ_REMOVE(&tsf->sstart, tid, link);
       sm = tid->data;
@@ -131,140 +135,303 @@ int timeshift_filemgr_makedirs ( int index, char *buf, size_t len )
   return makedirs(buf, 0700);
 }
 
+/*
+ * Write out coalesced data (rdwr_mutex held)
+ */
+ssize_t timeshift_filemgr_sync ( timeshift_file_t *tsf )
+{
+  ssize_t r;
+
+  if (!tsf->wbuf_len)
+    return 0;
+  r = timeshift_write(tsf->fd, tsf->wbuf, tsf->wbuf_len);
+  if (r < 0)
+    return -1;
+  tsf->wbuf_len = 0;
+  return r;
+}
+
+/*
+ * Write data, RAM segments are grown as required and small writes to
+ * disk are coalesced (see timeshift_filemgr_sync)
+ */
+ssize_t timeshift_filemgr_write
+  ( timeshift_file_t *tsf, const void *buf, size_t count )
+{
+  size_t  alloc;
+  uint8_t *ram;
+
+  if (tsf->ram) {
+    pthread_mutex_lock(&tsf->ram_lock);
+    if (tsf->size + count > tsf->ram_alloc) {
+      alloc = MAX(tsf->ram_alloc * 2, tsf->size + count);
+      if (!(ram = realloc(tsf->ram, alloc))) {
+        pthread_mutex_unlock(&tsf->ram_lock);
+        return -1;
+      }
+      tsf->ram       = ram;
+      tsf->ram_alloc = alloc;
+    }
+    memcpy(tsf->ram + tsf->size, buf, count);
+    tsf->size += count;
+    pthread_mutex_unlock(&tsf->ram_lock);
+    atomic_add_u64(&timeshift_ram_total_size, count);
+    return count;
+  }
+
+  if (tsf->wbuf_len + count > TIMESHIFT_WBUF_SIZE)
+    if (timeshift_filemgr_sync(tsf) < 0)
+      return -1;
+  if (count >= TIMESHIFT_WBUF_SIZE) {
+    if (timeshift_write(tsf->fd, buf, count) < 0)
+      return -1;
+  } else {
+    if (!tsf->wbuf_len)
+      tsf->wbuf_time = getmonoclock();
+    memcpy(tsf->wbuf + tsf->wbuf_len, buf, count);
+    tsf->wbuf_len += count;
+  }
+  tsf->size += count;
+  atomic_add_u64(&timeshift_total_size, count);
+  return count;
+}
+
 /*
  * Close file
  */
 void timeshift_filemgr_close ( timeshift_file_t *tsf )
 {
-  ssize_t r = timeshift_write_eof(tsf->fd);
-  if (r > 0)
-  {
-    tsf->size += r;
-    atomic_add_u64(&timeshift_total_size, r);
+  timeshift_write_eof(tsf);
+  if (tsf->fd != -1) {
+    timeshift_filemgr_sync(tsf);
+    close(tsf->fd);
   }
-  close(tsf->fd);
-  tsf->fd = -1;
+  free(tsf->wbuf);
+  tsf->wbuf     = NULL;
+  tsf->wbuf_len = 0;
+  tsf->fd     = -1;
+  tsf->closed = 1;
 }
 
 /*
  * Remove file
  */
 void timeshift_filemgr_remove
-  ( timeshift_t *ts, timeshift_file_t *tsf, int force )
+  ( timeshift_buffer_t *tb, timeshift_file_t *tsf, int force )
 {
   if (tsf->fd != -1)
     close(tsf->fd);
-  tvhlog(LOG_DEBUG, "timeshift", "ts %d remove %s", ts->id, tsf->path);
-  TAILQ_REMOVE(&ts->files, tsf, link);
-  atomic_add_u64(&timeshift_total_size, -tsf->size);
+  free(tsf->wbuf);
+  tsf->wbuf     = NULL;
+  tsf->wbuf_len = 0;
+  tvhlog(LOG_DEBUG, "timeshift", "ts %d remove %s", tb->id, tsf->path);
+  TAILQ_REMOVE(&tb->files, tsf, link);
+  if (tsf->ram)
+    atomic_add_u64(&timeshift_ram_total_size, -tsf->size);
+  else
+    atomic_add_u64(&timeshift_total_size, -tsf->size);
   timeshift_reaper_remove(tsf);
 }
 
 /*
  * Flush all files
  */
-void timeshift_filemgr_flush ( timeshift_t *ts, timeshift_file_t *end )
+void timeshift_filemgr_flush ( timeshift_buffer_t *tb, timeshift_file_t *end )
 {
   timeshift_file_t *tsf;
-  while ((tsf = TAILQ_FIRST(&ts->files))) {
+  while ((tsf = TAILQ_FIRST(&tb->files))) {
     if (tsf == end) break;
-    timeshift_filemgr_remove(ts, tsf, 1);
+    timeshift_filemgr_remove(tb, tsf, 1);
+  }
+}
+
+/*
+ * RAM available to a new segment, within the global and per buffer limits
+ */
+static size_t timeshift_filemgr_ram_avail ( timeshift_buffer_t *tb )
+{
+  timeshift_file_t *tsf;
+  uint64_t used = 0, total;
+  size_t avail;
+
+  if (!timeshift_ram_size)
+    return 0;
+  total = atomic_pre_add_u64(&timeshift_ram_total_size, 0);
+  if (total >= timeshift_ram_size)
+    return 0;
+  avail = timeshift_ram_size - total;
+  if (timeshift_ram_service_size) {
+    TAILQ_FOREACH(tsf, &tb->files, link)
+      if (tsf->ram)
+        used += tsf->size;
+    if (used >= timeshift_ram_service_size)
+      return 0;
+    avail = MIN(avail, timeshift_ram_service_size - used);
   }
+  return avail;
+}
+
+/*
+ * Check whether an open RAM segment has used up its share of the limits
+ * (the global one is shared with other buffers, so it's checked as is)
+ */
+static int timeshift_filemgr_ram_over ( timeshift_file_t *tsf )
+{
+  return tsf->size >= tsf->ram_limit ||
+         atomic_pre_add_u64(&timeshift_ram_total_size, 0) >= timeshift_ram_size;
 }
 
 /*
  * Get current / new file
  */
-timeshift_file_t *timeshift_filemgr_get ( timeshift_t *ts, int create )
+timeshift_file_t *timeshift_filemgr_get ( timeshift_buffer_t *tb, int create )
 {
-  int fd;
+  int fd, ram = 0, split;
   struct timespec tp;
   timeshift_file_t *tsf_tl, *tsf_hd, *tsf_tmp;
   timeshift_index_data_t *ti;
   char path[512];
   time_t time;
+  size_t size, avail = 0, alloc = 0;
+  uint8_t *rambuf = NULL;
 
   /* Return last file */
   if (!create)
-    return timeshift_filemgr_newest(ts);
+    return timeshift_filemgr_newest(tb);
 
-  /* No space */
-  if (ts->full)
-    return NULL;
+  /* No space (a shared buffer retries, readers come and go) */
+  if (tb->full) {
+    if (!tb->key)
+      return NULL;
+    tb->full = 0;
+  }
 
   /* Store to file */
   clock_gettime(CLOCK_MONOTONIC_COARSE, &tp);
   time   = tp.tv_sec / TIMESHIFT_FILE_PERIOD;
-  tsf_tl = TAILQ_LAST(&ts->files, timeshift_file_list);
-  if (!tsf_tl || tsf_tl->time != time) {
-    tsf_hd = TAILQ_FIRST(&ts->files);
+  tsf_tl = TAILQ_LAST(&tb->files, timeshift_file_list);
+
+  /* The RAM limits are checked on each write, a RAM segment that's used
+     its share is ended early (the rest of the period goes to disk, or a
+     new RAM segment once the oldest is dropped) */
+  split  = tsf_tl && tsf_tl->ram && !tsf_tl->closed &&
+           timeshift_filemgr_ram_over(tsf_tl);
+  if (!tsf_tl || tsf_tl->time != time || split) {
+    tsf_hd = TAILQ_FIRST(&tb->files);
 
     /* Close existing */
-    if (tsf_tl && tsf_tl->fd != -1)
+    if (tsf_tl && !tsf_tl->closed)
       timeshift_filemgr_close(tsf_tl);
 
     /* Check period */
-    if (ts->max_time && tsf_hd && tsf_tl) {
+    if (tb->max_time && tsf_hd && tsf_tl) {
       time_t d = (tsf_tl->time - tsf_hd->time) * TIMESHIFT_FILE_PERIOD;
-      if (d > (ts->max_time+5)) {
+      if (d > (tb->max_time+5)) {
         if (!tsf_hd->refcount) {
-          timeshift_filemgr_remove(ts, tsf_hd, 0);
+          timeshift_filemgr_remove(tb, tsf_hd, 0);
           tsf_hd = NULL;
         } else {
-          tvhlog(LOG_DEBUG, "timeshift", "ts %d buffer full", ts->id);
-          ts->full = 1;
+          tvhlog(LOG_DEBUG, "timeshift", "ts %d buffer full", tb->id);
+          tb->full = 1;
+        }
+      }
+    }
+
+    /* Check RAM, the next segment is assumed to be the size of the last
+       one. If it doesn't fit, spill to disk (or drop the oldest) */
+    size = tsf_tl ? tsf_tl->size : 0;
+    if (!tb->full && timeshift_ram_size) {
+      tsf_hd = TAILQ_FIRST(&tb->files);
+      avail  = timeshift_filemgr_ram_avail(tb);
+      ram    = avail && avail >= size;
+      if (!ram && timeshift_ram_only) {
+        if (tsf_hd && tsf_hd != tsf_tl && !tsf_hd->refcount && tsf_hd->ram) {
+          timeshift_filemgr_remove(tb, tsf_hd, 0);
+          avail = timeshift_filemgr_ram_avail(tb);
+          ram   = 1;
+        } else {
+          tvhlog(LOG_DEBUG, "timeshift", "ts %d buffer full (RAM)", tb->id);
+          tb->full = 1;
         }
       }
     }
 
+    /* Allocate the RAM segment, use a file if that fails */
+    if (!tb->full && ram) {
+      alloc = MAX(size + size / 8, TIMESHIFT_RAM_INITIAL);
+      if (!(rambuf = malloc(alloc))) {
+        tvhlog(LOG_WARNING, "timeshift",
+               "ts %d failed to allocate %zu bytes of RAM", tb->id, alloc);
+        ram = 0;
+        if (timeshift_ram_only)
+          tb->full = 1;
+      }
+    }
+
     /* Check size */
-    if (!timeshift_unlimited_size &&
+    if (!ram && !tb->full && !timeshift_unlimited_size &&
         atomic_pre_add_u64(&timeshift_total_size, 0) >= timeshift_max_size) {
 
       /* Remove the last file (if we can) */
-      if (tsf_hd && !tsf_hd->refcount) {
-        timeshift_filemgr_remove(ts, tsf_hd, 0);
+      tsf_hd = TAILQ_FIRST(&tb->files);
+      if (tsf_hd && tsf_hd != tsf_tl && !tsf_hd->refcount) {
+        timeshift_filemgr_remove(tb, tsf_hd, 0);
 
       /* Full */
       } else {
-        tvhlog(LOG_DEBUG, "timeshift", "ts %d buffer full", ts->id);
-        ts->full = 1;
+        tvhlog(LOG_DEBUG, "timeshift", "ts %d buffer full", tb->id);
+        tb->full = 1;
       }
     }
       
     /* Create new file */
     tsf_tmp = NULL;
-    if (!ts->full) {
+    if (!tb->full && ram) {
+
+      /* Create RAM segment */
+      snprintf(path, sizeof(path), "ram:%d/tvh-%"PRItime_t, tb->id, time);
+      tvhtrace("timeshift", "ts %d create segment %s", tb->id, path);
+      tsf_tmp = calloc(1, sizeof(timeshift_file_t));
+      tsf_tmp->fd        = -1;
+      tsf_tmp->ram_alloc = alloc;
+      tsf_tmp->ram_limit = avail;
+      tsf_tmp->ram       = rambuf;
+      pthread_mutex_init(&tsf_tmp->ram_lock, NULL);
+
+    } else if (!tb->full) {
 
       /* Create directories */
-      if (!ts->path) {
-        if (timeshift_filemgr_makedirs(ts->id, path, sizeof(path)))
+      if (!tb->path) {
+        if (timeshift_filemgr_makedirs(tb->id, path, sizeof(path)))
           return NULL;
-        ts->path = strdup(path);
+        tb->path = strdup(path);
       }
 
       /* Create File */
-      snprintf(path, sizeof(path), "%s/tvh-%"PRItime_t, ts->path, time);
-      tvhtrace("timeshift", "ts %d create file %s", ts->id, path);
+      snprintf(path, sizeof(path), "%s/tvh-%"PRItime_t, tb->path, time);
+      tvhtrace("timeshift", "ts %d create file %s", tb->id, path);
       if ((fd = open(path, O_WRONLY | O_CREAT, 0600)) > 0) {
         tsf_tmp = calloc(1, sizeof(timeshift_file_t));
-        tsf_tmp->time     = time;
         tsf_tmp->fd       = fd;
-        tsf_tmp->path     = strdup(path);
-        tsf_tmp->refcount = 0;
-        tsf_tmp->last     = getmonoclock();
-        TAILQ_INIT(&tsf_tmp->iframes);
-        TAILQ_INIT(&tsf_tmp->sstart);
-        TAILQ_INSERT_TAIL(&ts->files, tsf_tmp, link);
-
-        /* Copy across last start message */
-        if (tsf_tl && (ti = TAILQ_LAST(&tsf_tl->sstart, timeshift_index_data_list))) {
-          tvhtrace("timeshift", "ts %d copy smt_start to new file",
-                   ts->id);
-          timeshift_index_data_t *ti2 = calloc(1, sizeof(timeshift_index_data_t));
-          ti2->data = streaming_msg_clone(ti->data);
-          TAILQ_INSERT_TAIL(&tsf_tmp->sstart, ti2, link);
-        }
+        tsf_tmp->wbuf     = malloc(TIMESHIFT_WBUF_SIZE);
+      }
+    }
+
+    if (tsf_tmp) {
+      tsf_tmp->time     = time;
+      tsf_tmp->path     = strdup(path);
+      tsf_tmp->refcount = 0;
+      tsf_tmp->last     = getmonoclock();
+      TAILQ_INIT(&tsf_tmp->sstart);
+      TAILQ_INSERT_TAIL(&tb->files, tsf_tmp, link);
+
+      /* Copy across last start message */
+      if (tsf_tl && (ti = TAILQ_LAST(&tsf_tl->sstart, timeshift_index_data_list))) {
+        tvhtrace("timeshift", "ts %d copy smt_start to new file",
+                 tb->id);
+        timeshift_index_data_t *ti2 = calloc(1, sizeof(timeshift_index_data_t));
+        ti2->data = streaming_msg_clone(ti->data);
+        TAILQ_INSERT_TAIL(&tsf_tmp->sstart, ti2, link);
       }
     }
     tsf_tl = tsf_tmp;
@@ -302,9 +469,9 @@ timeshift_file_t *timeshift_filemgr_prev
 /*
  * Get the oldest file
  */
-timeshift_file_t *timeshift_filemgr_oldest ( timeshift_t *ts )
+timeshift_file_t *timeshift_filemgr_oldest ( timeshift_buffer_t *tb )
 {
-  timeshift_file_t *tsf = TAILQ_FIRST(&ts->files);
+  timeshift_file_t *tsf = TAILQ_FIRST(&tb->files);
   if (tsf)
     tsf->refcount++;
   return tsf;
@@ -313,9 +480,9 @@ timeshift_file_t *timeshift_filemgr_oldest ( timeshift_t *ts )
 /*
  * Get the newest file
  */
-timeshift_file_t *timeshift_filemgr_newest ( timeshift_t *ts )
+timeshift_file_t *timeshift_filemgr_newest ( timeshift_buffer_t *tb )
 {
-  timeshift_file_t *tsf = TAILQ_LAST(&ts->files, timeshift_file_list);
+  timeshift_file_t *tsf = TAILQ_LAST(&tb->files, timeshift_file_list);
   if (tsf)
     tsf->refcount++;
   return tsf;
@@ -337,7 +504,8 @@ void timeshift_filemgr_init ( void )
   rmtree(path);
 
   /* Size processing */
-  timeshift_total_size = 0;
+  timeshift_total_size     = 0;
+  timeshift_ram_total_size = 0;
 
   /* Start the reaper thread */
   timeshift_reaper_run = 1;
@@ -41,13 +41,69 @@
  * File Reading
  * *************************************************************************/
 
-static ssize_t _read_pktbuf ( int fd, pktbuf_t **pktbuf )
+/*
+ * Read from a RAM segment or a disk segment (at *roff, through the
+ * readahead buffer) or from the pipe (tsf = NULL)
+ */
+static ssize_t _read_buf
+  ( timeshift_t *ts, timeshift_file_t *tsf, int fd, off_t *roff,
+    void *buf, size_t size )
+{
+  ssize_t r;
+
+  if (tsf && tsf->ram) {
+    pthread_mutex_lock(&tsf->ram_lock);
+    if ((size_t)*roff >= tsf->size)
+      r = 0;
+    else
+      r = MIN(size, tsf->size - (size_t)*roff);
+    memcpy(buf, tsf->ram + *roff, r);
+    pthread_mutex_unlock(&tsf->ram_lock);
+    *roff += r;
+    return r;
+  }
+
+  if (tsf) {
+    if (ts->ra_file != tsf || *roff < ts->ra_off ||
+        *roff + size > ts->ra_off + ts->ra_len) {
+
+      /* Too big, read directly */
+      if (size > TIMESHIFT_RA_SIZE) {
+        r = pread(fd, buf, size, *roff);
+        if (r > 0)
+          *roff += r;
+        return r;
+      }
+
+      /* Refill */
+      if (!ts->ra_buf)
+        ts->ra_buf = malloc(TIMESHIFT_RA_SIZE);
+      r = pread(fd, ts->ra_buf, TIMESHIFT_RA_SIZE, *roff);
+      if (r < 0) {
+        ts->ra_file = NULL;
+        return -1;
+      }
+      ts->ra_file = tsf;
+      ts->ra_off  = *roff;
+      ts->ra_len  = r;
+    }
+    r = MIN(size, ts->ra_off + ts->ra_len - *roff);
+    memcpy(buf, ts->ra_buf + (*roff - ts->ra_off), r);
+    *roff += r;
+    return r;
+  }
+
+  return read(fd, buf, size);
+}
+
+static ssize_t _read_pktbuf
+  ( timeshift_t *ts, timeshift_file_t *tsf, int fd, off_t *roff, pktbuf_t **pktbuf )
 {
   ssize_t r, cnt = 0;
   size_t sz;
 
   /* Size */
-  r = read(fd, &sz, sizeof(sz));
+  r = _read_buf(ts, tsf, fd, roff, &sz, sizeof(sz));
   if (r < 0) return -1;
   if (r != sizeof(sz)) return 0;
   cnt += r;
@@ -60,10 +116,10 @@ static ssize_t _read_pktbuf ( int fd, pktbuf_t **pktbuf )
 
   /* Data */
   *pktbuf = pktbuf_alloc(NULL, sz);
-  r = read(fd, (*pktbuf)->pb_data, sz);
+  r = _read_buf(ts, tsf, fd, roff, (*pktbuf)->pb_data, sz);
   if (r != sz) {
-    free((*pktbuf)->pb_data);
-    free(*pktbuf);
+    pktbuf_ref_dec(*pktbuf);
+    *pktbuf = NULL;
     return r < 0 ? -1 : 0;
   }
   cnt += r;
@@ -72,7 +128,8 @@ static ssize_t _read_pktbuf ( int fd, pktbuf_t **pktbuf )
 }
 
 
-static ssize_t _read_msg ( int fd, streaming_message_t **sm )
+static ssize_t _read_msg
+  ( timeshift_t *ts, timeshift_file_t *tsf, int fd, off_t *roff, streaming_message_t **sm )
 {
   ssize_t r, cnt = 0;
   size_t sz;
@@ -85,7 +142,7 @@ static ssize_t _read_msg ( int fd, streaming_message_t **sm )
   *sm = NULL;
 
   /* Size */
-  r = read(fd, &sz, sizeof(sz));
+  r = _read_buf(ts, tsf, fd, roff, &sz, sizeof(sz));
   if (r < 0) return -1;
   if (r != sizeof(sz)) return 0;
   cnt += r;
@@ -94,13 +151,13 @@ static ssize_t _read_msg ( int fd, streaming_message_t **sm )
   if (sz == 0) return cnt;
 
   /* Type */
-  r = read(fd, &type, sizeof(type));
+  r = _read_buf(ts, tsf, fd, roff, &type, sizeof(type));
   if (r < 0) return -1;
   if (r != sizeof(type)) return 0;
   cnt += r;
 
   /* Time */
-  r = read(fd, &time, sizeof(time));
+  r = _read_buf(ts, tsf, fd, roff, &time, sizeof(time));
   if (r < 0) return -1;
   if (r != sizeof(time)) return 0;
   cnt += r;
@@ -124,7 +181,7 @@ static ssize_t _read_msg ( int fd, streaming_message_t **sm )
     case SMT_EXIT:
     case SMT_SPEED:
       if (sz != sizeof(code)) return -1;
-      r = read(fd, &code, sz);
+      r = _read_buf(ts, tsf, fd, roff, &code, sz);
       if (r != sz) {
         if (r < 0) return -1;
         return 0;
@@ -137,10 +194,20 @@ static ssize_t _read_msg ( int fd, streaming_message_t **sm )
     case SMT_SIGNAL_STATUS:
     case SMT_MPEGTS:
     case SMT_PACKET:
-      data = malloc(sz);
-      r = read(fd, data, sz);
+      if (type == SMT_PACKET) {
+        if (sz != sizeof(th_pkt_t)) return -1;
+        data = pkt_create();
+      } else
+        data = malloc(sz);
+      r = _read_buf(ts, tsf, fd, roff, data, sz);
       if (r != sz) {
-        free(data);
+        if (type == SMT_PACKET) {
+          th_pkt_t *pkt = data;
+          pkt->pkt_payload  = pkt->pkt_header = NULL;
+          pkt->pkt_refcount = 1;
+          pkt_ref_dec(pkt);
+        } else
+          free(data);
         if (r < 0) return -1;
         return 0;
       }
@@ -149,13 +216,13 @@ static ssize_t _read_msg ( int fd, streaming_message_t **sm )
         pkt->pkt_payload  = pkt->pkt_header = NULL;
         pkt->pkt_refcount = 0;
         *sm = streaming_msg_create_pkt(pkt);
-        r   = _read_pktbuf(fd, &pkt->pkt_header);
+        r   = _read_pktbuf(ts, tsf, fd, roff, &pkt->pkt_header);
         if (r < 0) {
           streaming_msg_free(*sm);
           return r;
         }
         cnt += r;
-        r   = _read_pktbuf(fd, &pkt->pkt_payload);
+        r   = _read_pktbuf(ts, tsf, fd, roff, &pkt->pkt_payload);
         if (r < 0) {
           streaming_msg_free(*sm);
           return r;
@@ -192,121 +259,109 @@ static streaming_message_t *_timeshift_find_sstart
   return ti ? ti->data : NULL;
 }
 
-static timeshift_index_iframe_t *_timeshift_first_frame
-  ( timeshift_t *ts )
-{ 
-  int end;
-  timeshift_index_iframe_t *tsi = NULL;
-  timeshift_file_t *tsf = timeshift_filemgr_oldest(ts);
-  while (tsf && !tsi) {
-    if (!(tsi = TAILQ_FIRST(&tsf->iframes))) {
-      tsf = timeshift_filemgr_next(tsf, &end, 0);
+/*
+ * Times of the first and last indexed I-frames in the buffer
+ */
+static void _timeshift_frame_times
+  ( timeshift_t *ts, int64_t *first, int64_t *last )
+{
+  timeshift_file_t *tsf;
+
+  *first = *last = PTS_UNSET;
+  pthread_mutex_lock(&ts->buf->rdwr_mutex);
+  TAILQ_FOREACH(tsf, &ts->buf->files, link)
+    if (tsf->iframes_count) {
+      *first = tsf->iframes[0].time;
+      break;
     }
-  }
-  if (tsf)
-    tsf->refcount--;
-  return tsi;
+  TAILQ_FOREACH_REVERSE(tsf, &ts->buf->files, timeshift_file_list, link)
+    if (tsf->iframes_count) {
+      *last = tsf->iframes[tsf->iframes_count - 1].time;
+      break;
+    }
+  pthread_mutex_unlock(&ts->buf->rdwr_mutex);
 }
 
-static timeshift_index_iframe_t *_timeshift_last_frame
-  ( timeshift_t *ts )
+/*
+ * Find the last I-frame at or before (back) / the first at or after time
+ * in the file, -1 if none
+ */
+static int _timeshift_iframe_find
+  ( timeshift_file_t *tsf, int64_t time, int back )
 {
-  int end;
-  timeshift_index_iframe_t *tsi = NULL;
-  timeshift_file_t *tsf = timeshift_filemgr_get(ts, 0);
-  while (tsf && !tsi) {
-    if (!(tsi = TAILQ_LAST(&tsf->iframes, timeshift_index_iframe_list))) {
-      tsf = timeshift_filemgr_prev(tsf, &end, 0);
-    }
+  int lo = 0, hi = tsf->iframes_count, mid;
+
+  /* First at or after */
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (tsf->iframes[mid].time < time)
+      lo = mid + 1;
+    else
+      hi = mid;
   }
-  if (tsf)
-    tsf->refcount--;
-  return tsi;
+
+  if (back) {
+    if (lo < tsf->iframes_count && tsf->iframes[lo].time == time)
+      return lo;
+    return lo - 1;
+  }
+  return lo < tsf->iframes_count ? lo : -1;
 }
 
+/*
+ * Find the I-frame to skip to (rdwr_mutex held)
+ *
+ * The file is found by its first/last I-frame time, then the I-frame by
+ * binary search. Returns -1/1 if the start/end of the buffer was hit, the
+ * new file (if any) has a reference taken.
+ */
 static int _timeshift_skip
   ( timeshift_t *ts, int64_t req_time, int64_t cur_time,
-    timeshift_file_t *cur_file, timeshift_file_t **new_file,
-    timeshift_index_iframe_t **iframe )
+    timeshift_file_t *cur_file, timeshift_file_t **new_file, int *iframe )
 {
-  timeshift_index_iframe_t *tsi  = *iframe;
-  timeshift_file_t         *tsf  = cur_file;
-  int64_t                   sec  = req_time / (1000000 * TIMESHIFT_FILE_PERIOD);
-  int                       back = (req_time < cur_time) ? 1 : 0;
-  int                       end  = 0;
-  
-  /* Hold local ref */
-  if (cur_file)
-    cur_file->refcount++;
-
-  /* Coarse search */
-  if (!tsi) {
-    while (tsf && !end) {
-      if (back) {
-        if ((tsf->time <= sec) &&
-            (tsi = TAILQ_LAST(&tsf->iframes, timeshift_index_iframe_list)))
-          break;
-        tsf = timeshift_filemgr_prev(tsf, &end, 1);
-      } else {
-        if ((tsf->time >= sec) &&
-            (tsi = TAILQ_FIRST(&tsf->iframes)))
-          break;
-        tsf = timeshift_filemgr_next(tsf, &end, 0);
-      }
-      tsi = NULL;
-    }
-  }
+  timeshift_file_t *tsf  = cur_file;
+  int               back = (req_time < cur_time) ? 1 : 0;
+  int               end  = 0, i = -1;
+
+  if (!tsf)
+    tsf = TAILQ_LAST(&ts->buf->files, timeshift_file_list);
 
-  /* Fine search */
+  /* Find file */
   if (back) {
-    while (!end && tsf && tsi && (tsi->time > req_time)) {
-      tsi = TAILQ_PREV(tsi, timeshift_index_iframe_list, link);
-      while (!end && tsf && !tsi) {
-        if ((tsf = timeshift_filemgr_prev(tsf, &end, 1)))
-          tsi = TAILQ_LAST(&tsf->iframes, timeshift_index_iframe_list);
-      }
-    }
+    while (tsf && (!tsf->iframes_count || tsf->iframes[0].time > req_time))
+      tsf = TAILQ_PREV(tsf, timeshift_file_list, link);
   } else {
-    while (!end && tsf && tsi && (tsi->time < req_time)) {
-      tsi = TAILQ_NEXT(tsi, link);
-      while (!end && tsf && !tsi) {
-        if ((tsf = timeshift_filemgr_next(tsf, &end, 0)))
-          tsi = TAILQ_FIRST(&tsf->iframes);
-      }
-    }
+    while (tsf && (!tsf->iframes_count ||
+                   tsf->iframes[tsf->iframes_count - 1].time < req_time))
+      tsf = TAILQ_NEXT(tsf, link);
   }
 
-  /* End */
-  if (!tsf || !tsi)
-    end = 1;
+  /* Find I-frame */
+  if (tsf)
+    i = _timeshift_iframe_find(tsf, req_time, back);
 
   /* Find start/end of buffer */
-  if (end) {
+  if (!tsf || i < 0) {
     if (back) {
-      tsf = timeshift_filemgr_oldest(ts);
-      tsi = NULL;
-      while (tsf && !tsi) {
-        if (!(tsi = TAILQ_FIRST(&tsf->iframes)))
-          tsf = timeshift_filemgr_next(tsf, &end, 0);
-      }
+      TAILQ_FOREACH(tsf, &ts->buf->files, link)
+        if (tsf->iframes_count)
+          break;
+      i   = 0;
       end = -1;
     } else {
-      tsf = timeshift_filemgr_get(ts, 0);
-      tsi = NULL;
-      while (tsf && !tsi) {
-        if (!(tsi = TAILQ_LAST(&tsf->iframes, timeshift_index_iframe_list)))
-          tsf = timeshift_filemgr_prev(tsf, &end, 0);
-      }
+      TAILQ_FOREACH_REVERSE(tsf, &ts->buf->files, timeshift_file_list, link)
+        if (tsf->iframes_count)
+          break;
+      i   = tsf ? tsf->iframes_count - 1 : -1;
       end = 1;
     }
   }
 
-  if (cur_file)
-    cur_file->refcount--;
-
   /* Done */
+  if (tsf)
+    tsf->refcount++;
   *new_file = tsf;
-  *iframe   = tsi;
+  *iframe   = tsf ? i : -1;
   return end;
 }
 
@@ -319,17 +374,33 @@ static int _timeshift_read
 {
   if (*cur_file) {
 
-    /* Open file */
-    if (*fd == -1) {
-      tvhtrace("timeshift", "ts %d open file %s",
-               ts->id, (*cur_file)->path);
-      *fd = open((*cur_file)->path, O_RDONLY);
+    timeshift_file_t *tsf = *cur_file;
+    off_t roff = *cur_off;
+    int64_t off;
+
+    /* Open file (RAM segments are read in place) */
+    if (!tsf->ram) {
+      if (*fd == -1) {
+        tvhtrace("timeshift", "ts %d open file %s",
+                 ts->id, tsf->path);
+        *fd = open(tsf->path, O_RDONLY);
+        ts->ra_file = NULL;
+      }
+      tvhtrace("timeshift", "ts %d read at %"PRIoff_t, ts->id, *cur_off);
     }
-    tvhtrace("timeshift", "ts %d seek to %"PRIoff_t, ts->id, *cur_off);
-    lseek(*fd, *cur_off, SEEK_SET);
 
     /* Read msg */
-    ssize_t r = _read_msg(*fd, sm);
+    ssize_t r = _read_msg(ts, tsf, *fd, &roff, sm);
+
+    /* Incomplete, the rest may still be in the writer's buffer */
+    if (r == 0 && !tsf->ram) {
+      pthread_mutex_lock(&ts->buf->rdwr_mutex);
+      if (timeshift_filemgr_sync(tsf) > 0) {
+        roff = *cur_off;
+        r    = _read_msg(ts, tsf, *fd, &roff, sm);
+      }
+      pthread_mutex_unlock(&ts->buf->rdwr_mutex);
+    }
     if (r < 0) {
       streaming_message_t *e = streaming_msg_create_code(SMT_STOP, SM_CODE_UNDEFINED_ERROR);
       streaming_target_deliver2(ts->output, e);
@@ -340,9 +411,17 @@ static int _timeshift_read
              ts->id, *sm, r);
 
     /* Incomplete */
-    if (r == 0) {
-      lseek(*fd, *cur_off, SEEK_SET);
+    if (r == 0)
       return 0;
+
+    /* Rebase to own PTS */
+    if (*sm && (*sm)->sm_type == SMT_PACKET &&
+        (off = timeshift_pts_offset(ts)) != 0) {
+      th_pkt_t *pkt = (*sm)->sm_data;
+      if (pkt->pkt_pts != PTS_UNSET)
+        pkt->pkt_pts += off;
+      if (pkt->pkt_dts != PTS_UNSET)
+        pkt->pkt_dts += off;
     }
 
     /* Update */
@@ -350,11 +429,12 @@ static int _timeshift_read
 
     /* Special case - EOF */
     if (r == sizeof(size_t) || *cur_off > (*cur_file)->size) {
-      close(*fd);
+      if (*fd != -1)
+        close(*fd);
       *fd       = -1;
-      pthread_mutex_lock(&ts->rdwr_mutex);
+      pthread_mutex_lock(&ts->buf->rdwr_mutex);
       *cur_file = timeshift_filemgr_next(*cur_file, NULL, 0);
-      pthread_mutex_unlock(&ts->rdwr_mutex);
+      pthread_mutex_unlock(&ts->buf->rdwr_mutex);
       *cur_off  = 0; // reset
       *wait     = 0;
 
@@ -414,7 +494,6 @@ void *timeshift_reader ( void *p )
   int64_t pause_time = 0, play_time = 0, last_time = 0;
   int64_t now, deliver, skip_time = 0;
   streaming_message_t *sm = NULL, *ctrl = NULL;
-  timeshift_index_iframe_t *tsi = NULL;
   streaming_skip_t *skip = NULL;
   time_t last_status = 0;
   tvhpoll_t *pd;
@@ -446,7 +525,7 @@ void *timeshift_reader ( void *p )
     /* Control */
     pthread_mutex_lock(&ts->state_mutex);
     if (nfds == 1) {
-      if (_read_msg(ts->rd_pipe.rd, &ctrl) > 0) {
+      if (_read_msg(NULL, NULL, ts->rd_pipe.rd, NULL, &ctrl) > 0) {
 
         /* Exit */
         if (ctrl->sm_type == SMT_EXIT) {
@@ -484,14 +563,14 @@ void *timeshift_reader ( void *p )
               } else {
                 tvhlog(LOG_DEBUG, "timeshift", "ts %d enter timeshift mode",
                        ts->id);
-                timeshift_writer_flush(ts);
-                pthread_mutex_lock(&ts->rdwr_mutex);
-                if ((cur_file   = timeshift_filemgr_get(ts, 1))) {
+                timeshift_writer_flush(ts->buf);
+                pthread_mutex_lock(&ts->buf->rdwr_mutex);
+                if ((cur_file   = timeshift_filemgr_get(ts->buf, 1))) {
                   cur_off    = cur_file->size;
                   pause_time = cur_file->last;
                   last_time  = pause_time;
                 }
-                pthread_mutex_unlock(&ts->rdwr_mutex);
+                pthread_mutex_unlock(&ts->buf->rdwr_mutex);
               }
 
             /* Buffer playback */
@@ -508,9 +587,6 @@ void *timeshift_reader ( void *p )
               tvhlog(LOG_DEBUG, "timeshift", "using keyframe mode? %s",
                      keyframe ? "yes" : "no");
               keyframe_mode = keyframe;
-              if (keyframe) {
-                tsi = NULL;
-              }
             }
 
             /* Update */
@@ -534,12 +610,12 @@ void *timeshift_reader ( void *p )
             case SMT_SKIP_LIVE:
               if (ts->state != TS_LIVE) {
 
-                /* Reset */
-                if (ts->full) {
-                  pthread_mutex_lock(&ts->rdwr_mutex);
-                  timeshift_filemgr_flush(ts, NULL);
-                  ts->full = 0;
-                  pthread_mutex_unlock(&ts->rdwr_mutex);
+                /* Reset (shared buffers are kept for the others) */
+                if (ts->buf->full && ts->buf->refcount == 1) {
+                  pthread_mutex_lock(&ts->buf->rdwr_mutex);
+                  timeshift_filemgr_flush(ts->buf, NULL);
+                  ts->buf->full = 0;
+                  pthread_mutex_unlock(&ts->buf->rdwr_mutex);
                 }
 
                 /* Release */
@@ -567,15 +643,15 @@ void *timeshift_reader ( void *p )
 
               /* Live playback (stage1) */
               if (ts->state == TS_LIVE) {
-                pthread_mutex_lock(&ts->rdwr_mutex);
-                if ((cur_file   = timeshift_filemgr_get(ts, !ts->ondemand))) {
+                pthread_mutex_lock(&ts->buf->rdwr_mutex);
+                if ((cur_file   = timeshift_filemgr_get(ts->buf, !ts->ondemand))) {
                   cur_off    = cur_file->size;
                   last_time  = cur_file->last;
                 } else {
                   tvhlog(LOG_ERR, "timeshift", "ts %d failed to get current file", ts->id);
                   skip = NULL;
                 }
-                pthread_mutex_unlock(&ts->rdwr_mutex);
+                pthread_mutex_unlock(&ts->buf->rdwr_mutex);
               }
 
               /* May have failed */
@@ -601,7 +677,6 @@ void *timeshift_reader ( void *p )
                 /* Adjust time */
                 play_time  = now;
                 pause_time = skip_time;
-                tsi        = NULL;
 
                 /* Clear existing packet */
                 if (sm)
@@ -634,15 +709,15 @@ void *timeshift_reader ( void *p )
     if (now >= (last_status + 1000000)) {
       streaming_message_t *tsm;
       timeshift_status_t *status;
-      timeshift_index_iframe_t *fst, *lst;
+      int64_t fst, lst;
       status = calloc(1, sizeof(timeshift_status_t));
-      fst    = _timeshift_first_frame(ts);
-      lst    = _timeshift_last_frame(ts);
-      status->full  = ts->full;
+      _timeshift_frame_times(ts, &fst, &lst);
+      status->full  = ts->buf->full;
       status->shift = ts->state <= TS_LIVE ? 0 : ts_rescale_i(now - last_time, 1000000);
-      if (lst && fst && lst != fst && ts->pts_delta != PTS_UNSET) {
-        status->pts_start = ts_rescale_i(fst->time - ts->pts_delta, 1000000);
-        status->pts_end   = ts_rescale_i(lst->time - ts->pts_delta, 1000000);
+      if (lst != PTS_UNSET && fst != PTS_UNSET && lst != fst &&
+          ts->pts_delta != PTS_UNSET) {
+        status->pts_start = ts_rescale_i(fst - ts->pts_delta, 1000000);
+        status->pts_end   = ts_rescale_i(lst - ts->pts_delta, 1000000);
       } else {
         status->pts_start = PTS_UNSET;
         status->pts_end   = PTS_UNSET;
@@ -669,22 +744,34 @@ void *timeshift_reader ( void *p )
       /* Rewind or Fast forward (i-frame only) */
       if (skip || keyframe_mode) {
         timeshift_file_t *tsf = NULL;
-        int64_t req_time;
-
-        /* Time */
-        if (!skip)
-          req_time = last_time + ((cur_speed < 0) ? -1 : 1);
-        else
+        int64_t req_time, due, tsi_time = 0;
+        off_t tsi_pos = 0;
+        int tsi;
+
+        /* Time (in keyframe mode jump straight to the frame due now,
+           skipping those that are already late) */
+        due = ((now - play_time) * cur_speed) / 100 + pause_time;
+        if (skip)
           req_time = skip_time;
+        else if (cur_speed < 0)
+          req_time = MIN(last_time - 1, due);
+        else
+          req_time = MAX(last_time + 1, due);
         tvhlog(LOG_DEBUG, "timeshift", "ts %d skip to %"PRId64" from %"PRId64, ts->id, req_time, last_time);
 
         /* Find */
-        pthread_mutex_lock(&ts->rdwr_mutex);
+        pthread_mutex_lock(&ts->buf->rdwr_mutex);
         end = _timeshift_skip(ts, req_time, last_time,
                               cur_file, &tsf, &tsi);
-        pthread_mutex_unlock(&ts->rdwr_mutex);
-        if (tsi)
-          tvhlog(LOG_DEBUG, "timeshift", "ts %d skip found pkt @ %"PRId64, ts->id, tsi->time);
+        if (tsi >= 0) {
+          tsi_pos  = tsf->iframes[tsi].pos;
+          tsi_time = tsf->iframes[tsi].time;
+        }
+        if (cur_file)
+          cur_file->refcount--;
+        pthread_mutex_unlock(&ts->buf->rdwr_mutex);
+        if (tsi >= 0)
+          tvhlog(LOG_DEBUG, "timeshift", "ts %d skip found pkt @ %"PRId64, ts->id, tsi_time);
 
         /* File changed (close) */
         if ((tsf != cur_file) && (fd != -1)) {
@@ -693,13 +780,8 @@ void *timeshift_reader ( void *p )
         }
 
         /* Position */
-        if (cur_file)
-          cur_file->refcount--;
         cur_file = tsf;
-        if (tsi)
-          cur_off = tsi->pos;
-        else
-          cur_off = 0;
+        cur_off  = tsi_pos;
       }
 
       /* Find packet */
@@ -762,7 +844,7 @@ void *timeshift_reader ( void *p )
         end = (cur_speed > 0) ? 1 : -1;
 
       /* Back to live (unless buffer is full) */
-      if (end == 1 && !ts->full) {
+      if (end == 1 && !ts->buf->full) {
         tvhlog(LOG_DEBUG, "timeshift", "ts %d eob revert to live mode", ts->id);
         ts->state = TS_LIVE;
         cur_speed = 100;
@@ -773,6 +855,17 @@ void *timeshift_reader ( void *p )
         if (_timeshift_flush_to_live(ts, &cur_file, &cur_off, &fd, &sm, &wait) == -1)
           break;
 
+        /* Buffer may have been fed by another instance */
+        if (ts->smt_live && ts->smt_live != ts->smt_start) {
+          streaming_target_deliver2(ts->output,
+            streaming_msg_create_data(SMT_START, ts->smt_live));
+          atomic_add(&ts->smt_live->ss_refcount, 1);
+          if (ts->smt_start)
+            streaming_start_unref(ts->smt_start);
+          ts->smt_start = ts->smt_live;
+          atomic_add(&ts->smt_start->ss_refcount, 1);
+        }
+
         /* Close file (if open) */
         if (fd != -1) {
           close(fd);
@@ -781,7 +874,7 @@ void *timeshift_reader ( void *p )
 
         /* Flush ALL files */
         if (ts->ondemand)
-          timeshift_filemgr_flush(ts, NULL);
+          timeshift_filemgr_flush(ts->buf, NULL);
 
       /* Pause */
       } else {
@@ -801,9 +894,9 @@ void *timeshift_reader ( void *p )
 
     /* Flush unwanted */
     } else if (ts->ondemand && cur_file) {
-      pthread_mutex_lock(&ts->rdwr_mutex);
-      timeshift_filemgr_flush(ts, cur_file);
-      pthread_mutex_unlock(&ts->rdwr_mutex);
+      pthread_mutex_lock(&ts->buf->rdwr_mutex);
+      timeshift_filemgr_flush(ts->buf, cur_file);
+      pthread_mutex_unlock(&ts->buf->rdwr_mutex);
     }
 
     pthread_mutex_unlock(&ts->state_mutex);
@@ -812,6 +905,13 @@ void *timeshift_reader ( void *p )
   /* Cleanup */
   tvhpoll_destroy(pd);
   if (fd != -1) close(fd);
+  free(ts->ra_buf);
+  ts->ra_buf = NULL;
+  if (cur_file) {
+    pthread_mutex_lock(&ts->buf->rdwr_mutex);
+    cur_file->refcount--;
+    pthread_mutex_unlock(&ts->buf->rdwr_mutex);
+  }
   if (sm)       streaming_msg_free(sm);
   if (ctrl)     streaming_msg_free(ctrl);
   tvhtrace("timeshift", "ts %d exit reader thread", ts->id);
@@ -36,7 +36,7 @@
 /*
  * Write data (retry on EAGAIN)
  */
-static ssize_t _write
+ssize_t timeshift_write
   ( int fd, const void *buf, size_t count )
 {
   ssize_t r;
@@ -54,25 +54,44 @@ static ssize_t _write
   return count == n ? n : -1;
 }
 
+/*
+ * Write data to a buffer file (tsf) or the reader pipe (fd)
+ */
+static ssize_t _write_buf
+  ( timeshift_file_t *tsf, int fd, const void *buf, size_t count )
+{
+  if (tsf)
+    return timeshift_filemgr_write(tsf, buf, count);
+  return timeshift_write(fd, buf, count);
+}
+
 /*
  * Write message
+ *
+ * Small messages (all control messages) go out in a single write
  */
 static ssize_t _write_msg
-  ( int fd, streaming_message_type_t type, int64_t time,
-    const void *buf, size_t len )
+  ( timeshift_file_t *tsf, int fd, streaming_message_type_t type,
+    int64_t time, const void *buf, size_t len )
 {
-  size_t len2 = len + sizeof(type) + sizeof(time);
+  uint8_t hdr[sizeof(size_t) + sizeof(type) + sizeof(time) + 64];
+  size_t len2 = len + sizeof(type) + sizeof(time), n = 0;
   ssize_t err, ret;
-  ret = err = _write(fd, &len2, sizeof(len2));
-  if (err < 0) return err;
-  err = _write(fd, &type, sizeof(type));
-  if (err < 0) return err;
-  ret += err;
-  err = _write(fd, &time, sizeof(time));
+  memcpy(hdr + n, &len2, sizeof(len2));
+  n += sizeof(len2);
+  memcpy(hdr + n, &type, sizeof(type));
+  n += sizeof(type);
+  memcpy(hdr + n, &time, sizeof(time));
+  n += sizeof(time);
+  if (len && len <= sizeof(hdr) - n) {
+    memcpy(hdr + n, buf, len);
+    n  += len;
+    len = 0;
+  }
+  ret = err = _write_buf(tsf, fd, hdr, n);
   if (err < 0) return err;
-  ret += err;
   if (len) {
-    err = _write(fd, buf, len);
+    err = _write_buf(tsf, fd, buf, len);
     if (err < 0) return err;
     ret += err;
   }
@@ -82,18 +101,19 @@ static ssize_t _write_msg
 /*
  * Write packet buffer
  */
-static int _write_pktbuf ( int fd, pktbuf_t *pktbuf )
+static int _write_pktbuf ( timeshift_file_t *tsf, pktbuf_t *pktbuf )
 {
   ssize_t ret, err;
   if (pktbuf) {
-    ret = err = _write(fd, &pktbuf->pb_size, sizeof(pktbuf->pb_size));
+    ret = err = timeshift_filemgr_write(tsf, &pktbuf->pb_size,
+                                        sizeof(pktbuf->pb_size));
     if (err < 0) return err;
-    err = _write(fd, pktbuf->pb_data, pktbuf->pb_size);
+    err = timeshift_filemgr_write(tsf, pktbuf->pb_data, pktbuf->pb_size);
     if (err < 0) return err;
     ret += err;
   } else {
     size_t sz = 0;
-    ret = _write(fd, &sz, sizeof(sz));
+    ret = timeshift_filemgr_write(tsf, &sz, sizeof(sz));
   }
   return ret;
 }
@@ -102,24 +122,25 @@ static int _write_pktbuf ( int fd, pktbuf_t *pktbuf )
  * Write signal status
  */
 ssize_t timeshift_write_sigstat
-  ( int fd, int64_t time, signal_status_t *sigstat )
+  ( timeshift_file_t *tsf, int64_t time, signal_status_t *sigstat )
 {
-  return _write_msg(fd, SMT_SIGNAL_STATUS, time, sigstat,
+  return _write_msg(tsf, -1, SMT_SIGNAL_STATUS, time, sigstat,
                     sizeof(signal_status_t));
 }
 
 /*
  * Write packet
  */
-ssize_t timeshift_write_packet ( int fd, int64_t time, th_pkt_t *pkt )
+ssize_t timeshift_write_packet
+  ( timeshift_file_t *tsf, int64_t time, th_pkt_t *pkt )
 {
   ssize_t ret = 0, err;
-  ret = err = _write_msg(fd, SMT_PACKET, time, pkt, sizeof(th_pkt_t));
+  ret = err = _write_msg(tsf, -1, SMT_PACKET, time, pkt, sizeof(th_pkt_t));
   if (err <= 0) return err;
-  err = _write_pktbuf(fd, pkt->pkt_header);
+  err = _write_pktbuf(tsf, pkt->pkt_header);
   if (err <= 0) return err;
   ret += err;
-  err = _write_pktbuf(fd, pkt->pkt_payload);
+  err = _write_pktbuf(tsf, pkt->pkt_payload);
   if (err <= 0) return err;
   ret += err;
   return ret;
@@ -128,9 +149,10 @@ ssize_t timeshift_write_packet ( int fd, int64_t time, th_pkt_t *pkt )
 /*
  * Write MPEGTS data
  */
-ssize_t timeshift_write_mpegts ( int fd, int64_t time, void *data )
+ssize_t timeshift_write_mpegts
+  ( timeshift_file_t *tsf, int64_t time, void *data )
 {
-  return _write_msg(fd, SMT_MPEGTS, time, data, 188);
+  return _write_msg(tsf, -1, SMT_MPEGTS, time, data, 188);
 }
 
 /*
@@ -138,7 +160,7 @@ ssize_t timeshift_write_mpegts ( int fd, int64_t time, void *data )
  */
 ssize_t timeshift_write_skip ( int fd, streaming_skip_t *skip )
 {
-  return _write_msg(fd, SMT_SKIP, 0, skip, sizeof(streaming_skip_t));
+  return _write_msg(NULL, fd, SMT_SKIP, 0, skip, sizeof(streaming_skip_t));
 }
 
 /*
@@ -146,7 +168,7 @@ ssize_t timeshift_write_skip ( int fd, streaming_skip_t *skip )
  */
 ssize_t timeshift_write_speed ( int fd, int speed )
 {
-  return _write_msg(fd, SMT_SPEED, 0, &speed, sizeof(speed));
+  return _write_msg(NULL, fd, SMT_SPEED, 0, &speed, sizeof(speed));
 }
 
 /*
@@ -154,7 +176,7 @@ ssize_t timeshift_write_speed ( int fd, int speed )
  */
 ssize_t timeshift_write_stop ( int fd, int code )
 {
-  return _write_msg(fd, SMT_STOP, 0, &code, sizeof(code));
+  return _write_msg(NULL, fd, SMT_STOP, 0, &code, sizeof(code));
 }
 
 /*
@@ -163,16 +185,16 @@ ssize_t timeshift_write_stop ( int fd, int code )
 ssize_t timeshift_write_exit ( int fd )
 {
   int code = 0;
-  return _write_msg(fd, SMT_EXIT, 0, &code, sizeof(code));
+  return _write_msg(NULL, fd, SMT_EXIT, 0, &code, sizeof(code));
 }
 
 /*
  * Write end of file (special internal message)
  */
-ssize_t timeshift_write_eof ( int fd )
+ssize_t timeshift_write_eof ( timeshift_file_t *tsf )
 {
   size_t sz = 0;
-  return _write(fd, &sz, sizeof(sz));
+  return timeshift_filemgr_write(tsf, &sz, sizeof(sz));
 }
 
 /* **************************************************************************
@@ -180,7 +202,7 @@ ssize_t timeshift_write_eof ( int fd )
  * *************************************************************************/
 
 static inline ssize_t _process_msg0
-  ( timeshift_t *ts, timeshift_file_t *tsf, streaming_message_t **smp )
+  ( timeshift_buffer_t *tb, timeshift_file_t *tsf, streaming_message_t **smp )
 {
   int i;
   ssize_t err;
@@ -198,39 +220,41 @@ static inline ssize_t _process_msg0
     ss = sm->sm_data;
     for (i = 0; i < ss->ss_num_components; i++)
       if (SCT_ISVIDEO(ss->ss_components[i].ssc_type))
-        ts->vididx = ss->ss_components[i].ssc_index;
+        tb->vididx = ss->ss_components[i].ssc_index;
   } else if (sm->sm_type == SMT_SIGNAL_STATUS)
-    err = timeshift_write_sigstat(tsf->fd, sm->sm_time, sm->sm_data);
+    err = timeshift_write_sigstat(tsf, sm->sm_time, sm->sm_data);
   else if (sm->sm_type == SMT_PACKET) {
-    err = timeshift_write_packet(tsf->fd, sm->sm_time, sm->sm_data);
+    off_t pos = tsf->size;
+    err = timeshift_write_packet(tsf, sm->sm_time, sm->sm_data);
     if (err > 0) {
       th_pkt_t *pkt = sm->sm_data;
 
       /* Index video iframes */
-      if (pkt->pkt_componentindex == ts->vididx &&
+      if (pkt->pkt_componentindex == tb->vididx &&
           pkt->pkt_frametype      == PKT_I_FRAME) {
-        timeshift_index_iframe_t *ti = calloc(1, sizeof(timeshift_index_iframe_t));
-        ti->pos  = tsf->size;
-        ti->time = sm->sm_time;
-        TAILQ_INSERT_TAIL(&tsf->iframes, ti, link);
+        if (tsf->iframes_count == tsf->iframes_alloc) {
+          tsf->iframes_alloc = MAX(64, tsf->iframes_alloc * 2);
+          tsf->iframes = realloc(tsf->iframes, tsf->iframes_alloc *
+                                 sizeof(timeshift_index_iframe_t));
+        }
+        tsf->iframes[tsf->iframes_count].pos  = pos;
+        tsf->iframes[tsf->iframes_count].time = sm->sm_time;
+        tsf->iframes_count++;
       }
     }
   } else if (sm->sm_type == SMT_MPEGTS)
-    err = timeshift_write_mpegts(tsf->fd, sm->sm_time, sm->sm_data);
+    err = timeshift_write_mpegts(tsf, sm->sm_time, sm->sm_data);
   else
     err = 0;
 
   /* OK */
-  if (err > 0) {
+  if (err > 0)
     tsf->last  = sm->sm_time;
-    tsf->size += err;
-    atomic_add_u64(&timeshift_total_size, err);
-  }
   return err;
 }
 
 static void _process_msg
-  ( timeshift_t *ts, streaming_message_t *sm, int *run )
+  ( timeshift_buffer_t *tb, streaming_message_t *sm, int *run )
 {
   int err;
   timeshift_file_t *tsf;
@@ -263,16 +287,20 @@ static void _process_msg
     case SMT_START:
     case SMT_MPEGTS:
     case SMT_PACKET:
-      pthread_mutex_lock(&ts->rdwr_mutex);
-      if ((tsf = timeshift_filemgr_get(ts, 1)) && (tsf->fd != -1)) {
-        if ((err = _process_msg0(ts, tsf, &sm)) < 0) {
+      pthread_mutex_lock(&tb->rdwr_mutex);
+      if ((tsf = timeshift_filemgr_get(tb, 1)) && !tsf->closed) {
+        if ((err = _process_msg0(tb, tsf, &sm)) < 0 ||
+            /* Write out coalesced data by age */
+            (tsf->wbuf_len && sm &&
+             sm->sm_time - tsf->wbuf_time >= TIMESHIFT_WBUF_TIME &&
+             timeshift_filemgr_sync(tsf) < 0)) {
           timeshift_filemgr_close(tsf);
           tsf->bad = 1;
-          ts->full = 1; ///< Stop any more writing
+          tb->full = 1; ///< Stop any more writing
         }
         tsf->refcount--;
       }
-      pthread_mutex_unlock(&ts->rdwr_mutex);
+      pthread_mutex_unlock(&tb->rdwr_mutex);
       break;
   }
 
@@ -284,8 +312,8 @@ static void _process_msg
 void *timeshift_writer ( void *aux )
 {
   int run = 1;
-  timeshift_t *ts = aux;
-  streaming_queue_t *sq = &ts->wr_queue;
+  timeshift_buffer_t *tb = aux;
+  streaming_queue_t *sq = &tb->wr_queue;
   streaming_message_t *sm;
 
   pthread_mutex_lock(&sq->sq_mutex);
@@ -293,15 +321,17 @@ void *timeshift_writer ( void *aux )
   while (run) {
 
     /* Get message */
+    // Note: not batched, timeshift_writer_flush() relies on all pending
+    //       messages still being on the queue
     sm = TAILQ_FIRST(&sq->sq_queue);
     if (sm == NULL) {
-      pthread_cond_wait(&sq->sq_cond, &sq->sq_mutex);
+      streaming_queue_wait(sq, NULL);
       continue;
     }
-    TAILQ_REMOVE(&sq->sq_queue, sm, sm_link);
+    streaming_queue_remove(sq, sm);
     pthread_mutex_unlock(&sq->sq_mutex);
 
-    _process_msg(ts, sm, &run);
+    _process_msg(tb, sm, &run);
 
     pthread_mutex_lock(&sq->sq_mutex);
   }
@@ -314,17 +344,22 @@ void *timeshift_writer ( void *aux )
  * Utilities
  * *************************************************************************/
 
-void timeshift_writer_flush ( timeshift_t *ts )
+void timeshift_writer_flush ( timeshift_buffer_t *tb )
 
 {
   streaming_message_t *sm;
-  streaming_queue_t *sq = &ts->wr_queue;
+  streaming_queue_t *sq = &tb->wr_queue;
+  timeshift_file_t *tsf;
 
   pthread_mutex_lock(&sq->sq_mutex);
   while ((sm = TAILQ_FIRST(&sq->sq_queue))) {
-    TAILQ_REMOVE(&sq->sq_queue, sm, sm_link);
-    _process_msg(ts, sm, NULL);
+    streaming_queue_remove(sq, sm);
+    _process_msg(tb, sm, NULL);
   }
+  pthread_mutex_lock(&tb->rdwr_mutex);
+  if ((tsf = TAILQ_LAST(&tb->files, timeshift_file_list)) && !tsf->closed)
+    timeshift_filemgr_sync(tsf);
+  pthread_mutex_unlock(&tb->rdwr_mutex);
   pthread_mutex_unlock(&sq->sq_mutex);
 }
 
@@ -445,6 +445,8 @@ typedef struct streaming_queue {
   pthread_cond_t  sq_cond;     /* Condvar for signalling new packets */
 
   size_t          sq_maxsize;  /* Max queue size (bytes) */
+  size_t          sq_size;     /* Current queue size (bytes) */
+  int             sq_waiting;  /* Consumer is waiting on sq_cond */
   
   struct streaming_message_queue sq_queue;
 
@@ -556,6 +558,9 @@ void tvh_pipe_close(th_pipe_t *pipe);
 
 int tvh_write(int fd, const void *buf, size_t len);
 
+struct iovec;
+int tvh_writev(int fd, struct iovec *iov, int iovcnt);
+
 void hexdump(const char *pfx, const uint8_t *data, int len);
 
 uint32_t tvh_crc32(const uint8_t *data, size_t datalen, uint32_t crc);
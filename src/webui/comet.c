@@ -40,6 +40,7 @@ static pthread_cond_t comet_cond = PTHREAD_COND_INITIALIZER;
 
 #define MAILBOX_UNUSED_TIMEOUT      20
 #define MAILBOX_EMPTY_REPLY_TIMEOUT 10
+#define MAILBOX_MIN_REPLY_DELAY     100000 /* usec, avoids comet storms */
 
 //#define mbdebug(fmt...) printf(fmt);
 #define mbdebug(fmt...)
@@ -57,6 +58,16 @@ typedef struct comet_mailbox {
   int cmb_debug;
 } comet_mailbox_t;
 
+/* Suspended poll request */
+static LIST_HEAD(, comet_waiter) waiters;
+
+typedef struct comet_waiter {
+  http_connection_t *cw_hc;
+  comet_mailbox_t *cw_cmb;
+  int64_t cw_start;
+  LIST_ENTRY(comet_waiter) cw_link;
+} comet_waiter_t;
+
 
 /**
  *
@@ -181,21 +192,83 @@ comet_serverIpPort(http_connection_t *hc, comet_mailbox_t *cmb)
 
 
 /**
- * Poll callback
+ * Reply with the queued messages
+ */
+static int
+comet_mailbox_reply(http_connection_t *hc, void *opaque)
+{
+  comet_mailbox_t *cmb = opaque;
+  htsmsg_t *m;
+
+  pthread_mutex_lock(&comet_mutex);
+
+  m = htsmsg_create_map();
+  htsmsg_add_str(m, "boxid", cmb->cmb_boxid);
+  htsmsg_add_msg(m, "messages", cmb->cmb_messages ?: htsmsg_create_list());
+  cmb->cmb_messages = NULL;
+  
+  cmb->cmb_last_used = dispatch_clock;
+
+  pthread_mutex_unlock(&comet_mutex);
+
+  htsmsg_json_serialize(m, &hc->hc_reply, 0);
+  htsmsg_destroy(m);
+  http_output_content(hc, "text/x-json; charset=UTF-8");
+  return 0;
+}
+
+/**
+ * Resume suspended polls which have messages (after a short delay)
+ * or timed out
+ */
+static void *
+comet_waiter_thread(void *aux)
+{
+  comet_waiter_t *cw, *next;
+  struct timespec ts;
+  struct timeval tv;
+  int64_t now, wake, t;
+
+  pthread_mutex_lock(&comet_mutex);
+  while(1) {
+    now = getmonoclock();
+    wake = now + MAILBOX_EMPTY_REPLY_TIMEOUT * 1000000LL;
+
+    for(cw = LIST_FIRST(&waiters); cw != NULL; cw = next) {
+      next = LIST_NEXT(cw, cw_link);
+
+      t = cw->cw_start + (cw->cw_cmb->cmb_messages ?
+                            MAILBOX_MIN_REPLY_DELAY :
+                            MAILBOX_EMPTY_REPLY_TIMEOUT * 1000000LL);
+      if(t > now) {
+        wake = MIN(wake, t);
+        continue;
+      }
+      LIST_REMOVE(cw, cw_link);
+      http_resume(cw->cw_hc);
+      free(cw);
+    }
+
+    gettimeofday(&tv, NULL);
+    t = tv.tv_sec * 1000000LL + tv.tv_usec + (wake - now);
+    ts.tv_sec  = t / 1000000;
+    ts.tv_nsec = (t % 1000000) * 1000;
+    pthread_cond_timedwait(&comet_cond, &comet_mutex, &ts);
+  }
+  return NULL;
+}
+
+/**
+ * Poll callback, waits for messages without holding a thread
  */
 static int
 comet_mailbox_poll(http_connection_t *hc, const char *remain, void *opaque)
 {
   comet_mailbox_t *cmb = NULL; 
+  comet_waiter_t *cw;
   const char *cometid = http_arg_get(&hc->hc_req_args, "boxid");
   const char *immediate = http_arg_get(&hc->hc_req_args, "immediate");
   int im = immediate ? atoi(immediate) : 0;
-  time_t reqtime;
-  struct timespec ts;
-  htsmsg_t *m;
-
-  if(!im)
-    usleep(100000); /* Always sleep 0.1 sec to avoid comet storms */
 
   pthread_mutex_lock(&comet_mutex);
 
@@ -209,29 +282,24 @@ comet_mailbox_poll(http_connection_t *hc, const char *remain, void *opaque)
     comet_access_update(hc, cmb);
     comet_serverIpPort(hc, cmb);
   }
-  time(&reqtime);
-
-  ts.tv_sec = reqtime + 10;
-  ts.tv_nsec = 0;
 
   cmb->cmb_last_used = 0; /* Make sure we're not flushed out */
 
-  if(!im && cmb->cmb_messages == NULL)
-    pthread_cond_timedwait(&comet_cond, &comet_mutex, &ts);
+  if(im) {
+    pthread_mutex_unlock(&comet_mutex);
+    return comet_mailbox_reply(hc, cmb);
+  }
 
-  m = htsmsg_create_map();
-  htsmsg_add_str(m, "boxid", cmb->cmb_boxid);
-  htsmsg_add_msg(m, "messages", cmb->cmb_messages ?: htsmsg_create_list());
-  cmb->cmb_messages = NULL;
-  
-  cmb->cmb_last_used = dispatch_clock;
+  cw = malloc(sizeof(comet_waiter_t));
+  cw->cw_hc    = hc;
+  cw->cw_cmb   = cmb;
+  cw->cw_start = getmonoclock();
+  http_suspend(hc, comet_mailbox_reply, cmb);
+  LIST_INSERT_HEAD(&waiters, cw, cw_link);
+  pthread_cond_broadcast(&comet_cond);
 
   pthread_mutex_unlock(&comet_mutex);
-
-  htsmsg_json_serialize(m, &hc->hc_reply, 0);
-  htsmsg_destroy(m);
-  http_output_content(hc, "text/x-json; charset=UTF-8");
-  return 0;
+  return HTTP_SUSPEND;
 }
 
 
@@ -279,6 +347,10 @@ comet_mailbox_dbg(http_connection_t *hc, const char *remain, void *opaque)
 void
 comet_init(void)
 {
+  pthread_t tid;
+
+  tvhthread_create(&tid, NULL, comet_waiter_thread, NULL, 1);
+
   http_path_add("/comet/poll",  NULL, comet_mailbox_poll, ACCESS_WEB_INTERFACE);
   http_path_add("/comet/debug", NULL, comet_mailbox_dbg,  ACCESS_WEB_INTERFACE);
 }
@@ -1691,6 +1691,10 @@ extjs_timeshift(http_connection_t *hc, const char *remain, void *opaque)
     htsmsg_add_u32(m, "timeshift_max_period", timeshift_max_period / 60);
     htsmsg_add_u32(m, "timeshift_unlimited_size", timeshift_unlimited_size);
     htsmsg_add_u32(m, "timeshift_max_size", timeshift_max_size / 1048576);
+    htsmsg_add_u32(m, "timeshift_shared", timeshift_shared);
+    htsmsg_add_u32(m, "timeshift_ram_size", timeshift_ram_size / 1048576);
+    htsmsg_add_u32(m, "timeshift_ram_service_size", timeshift_ram_service_size / 1048576);
+    htsmsg_add_u32(m, "timeshift_ram_only", timeshift_ram_only);
     pthread_mutex_unlock(&global_lock);
     out = json_single_record(m, "config");
 
@@ -1710,6 +1714,12 @@ extjs_timeshift(http_connection_t *hc, const char *remain, void *opaque)
     timeshift_unlimited_size = http_arg_get(&hc->hc_req_args, "timeshift_unlimited_size") ? 1 : 0;
     if ((str = http_arg_get(&hc->hc_req_args, "timeshift_max_size")))
       timeshift_max_size   = atol(str) * 1048576LL;
+    timeshift_shared = http_arg_get(&hc->hc_req_args, "timeshift_shared") ? 1 : 0;
+    if ((str = http_arg_get(&hc->hc_req_args, "timeshift_ram_size")))
+      timeshift_ram_size   = atol(str) * 1048576LL;
+    if ((str = http_arg_get(&hc->hc_req_args, "timeshift_ram_service_size")))
+      timeshift_ram_service_size = atol(str) * 1048576LL;
+    timeshift_ram_only = http_arg_get(&hc->hc_req_args, "timeshift_ram_only") ? 1 : 0;
     timeshift_save();
     pthread_mutex_unlock(&global_lock);
 
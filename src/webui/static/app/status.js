@@ -26,6 +26,20 @@ tvheadend.status_subs = function() {
 			name : 'in'
 		}, {
 			name : 'out'
+		}, {
+			name : 'descramble'
+		}, {
+			name : 'descramble_latency'
+		}, {
+			name : 'descramble_policy'
+		}, {
+			name : 'queue_packets'
+		}, {
+			name : 'queue_bytes'
+		}, {
+			name : 'queue_delay'
+		}, {
+			name : 'queue_drops'
 		}, {
 			name : 'start',
 			type : 'date',
@@ -55,6 +69,13 @@ tvheadend.status_subs = function() {
 			r.data.errors   = m.errors;
 			r.data.in       = m.in;
 			r.data.out      = m.out;
+			r.data.descramble         = m.descramble;
+			r.data.descramble_latency = m.descramble_latency;
+			r.data.descramble_policy  = m.descramble_policy;
+			r.data.queue_packets      = m.queue_packets;
+			r.data.queue_bytes        = m.queue_bytes;
+			r.data.queue_delay        = m.queue_delay;
+			r.data.queue_drops        = m.queue_drops;
 
 			tvheadend.subsStore.afterEdit(r);
 			tvheadend.subsStore.fireEvent('updated', tvheadend.subsStore, r,
@@ -126,6 +147,48 @@ tvheadend.status_subs = function() {
 		header : "Output (kb/s)",
 		dataIndex : 'out',
 		renderer: renderBw
+	}, {
+		width : 50,
+		id : 'descramble',
+		header : "Descramble (pkt/s)",
+		dataIndex : 'descramble',
+		hidden : true
+	}, {
+		width : 50,
+		id : 'descramble_latency',
+		header : "Descramble latency (us)",
+		dataIndex : 'descramble_latency',
+		hidden : true
+	}, {
+		width : 50,
+		id : 'descramble_policy',
+		header : "Descramble policy",
+		dataIndex : 'descramble_policy',
+		hidden : true
+	}, {
+		width : 50,
+		id : 'queue_packets',
+		header : "Queue (packets)",
+		dataIndex : 'queue_packets',
+		hidden : true
+	}, {
+		width : 50,
+		id : 'queue_bytes',
+		header : "Queue (bytes)",
+		dataIndex : 'queue_bytes',
+		hidden : true
+	}, {
+		width : 50,
+		id : 'queue_delay',
+		header : "Queue delay (us)",
+		dataIndex : 'queue_delay',
+		hidden : true
+	}, {
+		width : 50,
+		id : 'queue_drops',
+		header : "Queue drops",
+		dataIndex : 'queue_drops',
+		hidden : true
 	} ]);
 
 	var subs = new Ext.grid.GridPanel({
@@ -176,6 +239,8 @@ tvheadend.status_streams = function() {
 			name : 'snr'
 		}, {
 			name : 'bps'
+		}, {
+			name : 'cc'
 		},
 		],
 		url : 'api/status/inputs',
@@ -195,6 +260,7 @@ tvheadend.status_streams = function() {
         r.data.unc     = m.unc;
         r.data.snr     = m.snr;
         r.data.bps     = m.bps;
+        r.data.cc      = m.cc;
 			  stream_store.afterEdit(r);
 			  stream_store.fireEvent('updated', stream_store, r, Ext.data.Record.COMMIT);
       } else {
@@ -244,6 +310,10 @@ tvheadend.status_streams = function() {
 		width : 50,
 		header : "Uncorrected bit error rate",
 		dataIndex : 'unc'
+        },{
+		width : 50,
+		header : "Continuity errors",
+		dataIndex : 'cc'
         },{
 		width : 50,
 		header : "SNR",
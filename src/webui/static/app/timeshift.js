@@ -12,7 +12,9 @@ tvheadend.timeshift = function() {
       'timeshift_enabled', 'timeshift_ondemand',
       'timeshift_path',
       'timeshift_unlimited_period', 'timeshift_max_period',
-      'timeshift_unlimited_size', 'timeshift_max_size'
+      'timeshift_unlimited_size', 'timeshift_max_size',
+      'timeshift_shared',
+      'timeshift_ram_size', 'timeshift_ram_service_size', 'timeshift_ram_only'
     ]
   );
   
@@ -65,6 +67,32 @@ tvheadend.timeshift = function() {
     Width: 300
   });
 
+  var timeshiftShared = new Ext.form.Checkbox({
+    fieldLabel: 'Shared buffer',
+    name: 'timeshift_shared',
+    width: 300
+  });
+
+  var timeshiftRamSize = new Ext.form.NumberField({
+    fieldLabel: 'RAM Size (MB)',
+    name: 'timeshift_ram_size',
+    allowBlank: false,
+    width: 300
+  });
+
+  var timeshiftRamServiceSize = new Ext.form.NumberField({
+    fieldLabel: 'RAM per Buffer (MB)',
+    name: 'timeshift_ram_service_size',
+    allowBlank: false,
+    width: 300
+  });
+
+  var timeshiftRamOnly = new Ext.form.Checkbox({
+    fieldLabel: 'RAM only',
+    name: 'timeshift_ram_only',
+    width: 300
+  });
+
   /* ****************************************************************
    * Events
    * ***************************************************************/
@@ -110,7 +138,9 @@ tvheadend.timeshift = function() {
       timeshiftEnabled, timeshiftOndemand,
       timeshiftPath,
       timeshiftMaxPeriod, timeshiftUnlPeriod,
-      timeshiftMaxSize, timeshiftUnlSize
+      timeshiftMaxSize, timeshiftUnlSize,
+      timeshiftShared,
+      timeshiftRamSize, timeshiftRamServiceSize, timeshiftRamOnly
     ],
     tbar : [ saveButton, '->', helpButton ]
   });
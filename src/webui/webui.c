@@ -157,6 +157,126 @@ page_root2(http_connection_t *hc, const char *remain, void *opaque)
   return 0;
 }
 
+/**
+ * Static files, read from the file bundle at startup. The cache is never
+ * modified afterwards, so requests look it up without locking
+ */
+typedef struct webui_static {
+  RB_ENTRY(webui_static) ws_link;
+  char    *ws_path;
+  uint8_t *ws_data;
+  size_t   ws_size;
+  uint8_t *ws_gzip;         /* NULL if compression does not pay off */
+  size_t   ws_gzip_size;
+  char     ws_etag[24];
+  char     ws_etag_gzip[24];
+} webui_static_t;
+
+static RB_HEAD(, webui_static) webui_statics;
+
+static int
+webui_static_cmp(webui_static_t *a, webui_static_t *b)
+{
+  return strcmp(a->ws_path, b->ws_path);
+}
+
+/**
+ *
+ */
+static uint8_t *
+webui_static_read(fb_file *fp, size_t *size)
+{
+  uint8_t *data;
+  ssize_t c;
+  size_t len = 0;
+
+  *size = fb_size(fp);
+  data  = malloc(*size + 1);
+  while (!fb_eof(fp) && len < *size) {
+    if ((c = fb_read(fp, data + len, *size - len)) <= 0) {
+      free(data);
+      return NULL;
+    }
+    len += c;
+  }
+  *size = len;
+  return data;
+}
+
+/**
+ *
+ */
+static void
+webui_static_add(const char *path)
+{
+  webui_static_t *ws;
+  fb_file *fp;
+  uint32_t crc;
+
+  if (!(fp = fb_open(path, 1, 0)))
+    return;
+  ws = calloc(1, sizeof(webui_static_t));
+  ws->ws_data = webui_static_read(fp, &ws->ws_size);
+  fb_close(fp);
+  if (!ws->ws_data) {
+    free(ws);
+    return;
+  }
+
+#if ENABLE_ZLIB
+  if ((fp = fb_open(path, 0, 1))) {
+    ws->ws_gzip = webui_static_read(fp, &ws->ws_gzip_size);
+    fb_close(fp);
+    if (ws->ws_gzip && ws->ws_gzip_size >= ws->ws_size) {
+      free(ws->ws_gzip);
+      ws->ws_gzip = NULL;
+    }
+  }
+#endif
+
+  crc = tvh_crc32(ws->ws_data, ws->ws_size, 0xffffffff);
+  snprintf(ws->ws_etag, sizeof(ws->ws_etag), "\"%08x%zx\"",
+           crc, ws->ws_size);
+  snprintf(ws->ws_etag_gzip, sizeof(ws->ws_etag_gzip), "\"%08x%zx-gz\"",
+           crc, ws->ws_size);
+
+  ws->ws_path = strdup(path);
+  if (RB_INSERT_SORTED(&webui_statics, ws, ws_link, webui_static_cmp)) {
+    free(ws->ws_path);
+    free(ws->ws_gzip);
+    free(ws->ws_data);
+    free(ws);
+  }
+}
+
+/**
+ * Load a static directory tree into the cache, following symlinks
+ * (the depth limit guards against loops)
+ */
+static void
+webui_static_load(const char *path, int depth)
+{
+  fb_dir *dir;
+  fb_dirent *de;
+  struct filebundle_stat st;
+  char buf[512];
+
+  if (depth > 16 || !(dir = fb_opendir(path)))
+    return;
+  while ((de = fb_readdir(dir))) {
+    if (de->name[0] == '.')
+      continue;
+    snprintf(buf, sizeof(buf), "%s/%s", path, de->name);
+    if (fb_stat(buf, &st))
+      continue;
+    if (st.is_dir)
+      webui_static_load(buf, depth + 1);
+    else
+      webui_static_add(buf);
+  }
+  fb_closedir(dir);
+}
+
 /**
  * Static download of a file from the filesystem
  */
@@ -170,6 +290,7 @@ page_static_file(http_connection_t *hc, const char *remain, void *opaque)
   const char *content = NULL, *postfix;
   char buf[4096];
   const char *gzip;
+  webui_static_t *ws, skel;
 
   if(remain == NULL)
     return 404;
@@ -188,7 +309,19 @@ page_static_file(http_connection_t *hc, const char *remain, void *opaque)
       content = "text/css; charset=UTF-8";
   }
 
-  // TODO: handle compression
+  skel.ws_path = path;
+  if ((ws = RB_FIND(&webui_statics, &skel, ws_link, webui_static_cmp))) {
+    gzip = http_arg_get(&hc->hc_args, "Accept-Encoding");
+    if (ws->ws_gzip && gzip && strstr(gzip, "gzip"))
+      http_send_entity(hc, content, "gzip", ws->ws_etag_gzip, 10,
+                       ws->ws_gzip, ws->ws_gzip_size);
+    else
+      http_send_entity(hc, content, NULL, ws->ws_etag, 10,
+                       ws->ws_data, ws->ws_size);
+    return 0;
+  }
+
+  /* Not cached (debug mode or added since startup) */
   fb_file *fp = fb_open(path, 0, 1);
   if (!fp) {
     tvhlog(LOG_ERR, "webui", "failed to open %s", path);
@@ -223,6 +356,7 @@ http_stream_run(http_connection_t *hc, streaming_queue_t *sq,
                 th_subscription_t *s, muxer_config_t *mcfg)
 {
   streaming_message_t *sm;
+  struct streaming_message_queue batch;
   int run = 1;
   int started = 0;
   muxer_t *mux = NULL;
@@ -232,6 +366,8 @@ http_stream_run(http_connection_t *hc, streaming_queue_t *sq,
   int err = 0;
   socklen_t errlen = sizeof(err);
 
+  http_release(hc);
+
   mux = muxer_create(mc, mcfg);
   if(muxer_open_stream(mux, hc->hc_fd))
     run = 0;
@@ -241,15 +377,15 @@ http_stream_run(http_connection_t *hc, streaming_queue_t *sq,
   tp.tv_usec = 0;
   setsockopt(hc->hc_fd, SOL_SOCKET, SO_SNDTIMEO, &tp, sizeof(tp));
 
+  TAILQ_INIT(&batch);
   while(run) {
-    pthread_mutex_lock(&sq->sq_mutex);
-    sm = TAILQ_FIRST(&sq->sq_queue);
+    sm = TAILQ_FIRST(&batch);
     if(sm == NULL) {      
       gettimeofday(&tp, NULL);
       ts.tv_sec  = tp.tv_sec + 1;
       ts.tv_nsec = tp.tv_usec * 1000;
 
-      if(pthread_cond_timedwait(&sq->sq_cond, &sq->sq_mutex, &ts) == ETIMEDOUT) {
+      if(streaming_queue_dequeue_all(sq, &batch, &ts) == ETIMEDOUT) {
           timeouts++;
 
           //Check socket status
@@ -262,13 +398,11 @@ http_stream_run(http_connection_t *hc, streaming_queue_t *sq,
       run = 0;
           }
       }
-      pthread_mutex_unlock(&sq->sq_mutex);
       continue;
     }
 
     timeouts = 0; //Reset timeout counter
-    TAILQ_REMOVE(&sq->sq_queue, sm, sm_link);
-    pthread_mutex_unlock(&sq->sq_mutex);
+    TAILQ_REMOVE(&batch, sm, sm_link);
 
     switch(sm->sm_type) {
     case SMT_MPEGTS:
@@ -341,6 +475,7 @@ http_stream_run(http_connection_t *hc, streaming_queue_t *sq,
       run = 0;
     }
   }
+  streaming_queue_clear(&batch);
 
   if(started)
     muxer_close(mux);
@@ -1005,6 +1140,7 @@ page_dvrfile(http_connection_t *hc, const char *remain, void *opaque)
        disposition[0] ? disposition : NULL);
 
   if(!hc->hc_no_output) {
+    http_release(hc);
     while(content_len > 0) {
       chunk = MIN(1024 * 1024 * 1024, content_len);
 #if defined(PLATFORM_LINUX)
@@ -1079,6 +1215,10 @@ webui_static_content(const char *http_path, const char *source)
 {
   http_path_add(http_path, strdup(source), page_static_file,
     ACCESS_WEB_INTERFACE);
+
+  /* Debug mode always reads from disk so edits show up straight away */
+  if (!tvheadend_webui_debug)
+    webui_static_load(source, 0);
 }
 
 
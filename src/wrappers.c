@@ -3,6 +3,7 @@
 #include <fcntl.h>
 #include <sys/types.h>          /* See NOTES */
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <pthread.h>
 
@@ -89,6 +90,35 @@ tvh_write(int fd, const void *buf, size_t len)
   return len ? 1 : 0;
 }
 
+int
+tvh_writev(int fd, struct iovec *iov, int iovcnt)
+{
+  ssize_t c;
+
+  while (iovcnt) {
+    c = writev(fd, iov, iovcnt);
+    if (c < 0) {
+      if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
+        usleep(100);
+        continue;
+      }
+      break;
+    }
+    /* Skip what was written (iov is updated in place) */
+    while (iovcnt && (size_t)c >= iov->iov_len) {
+      c -= iov->iov_len;
+      iov++;
+      iovcnt--;
+    }
+    if (iovcnt) {
+      iov->iov_base = (uint8_t *)iov->iov_base + c;
+      iov->iov_len  -= c;
+    }
+  }
+
+  return iovcnt ? 1 : 0;
+}
+
 struct
 thread_state {
   void *(*run)(void*);
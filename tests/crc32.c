@@ -0,0 +1,136 @@
+/*
+ *  CRC32 tests and benchmark
+ *  Copyright (C) 2014 Tvheadend Project
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "tvheadend.h"
+#include "tvhtest.h"
+
+#define BENCH_SIZE 4096
+
+static uint32_t crc_ref_tab[256];
+
+typedef struct crc_bench {
+  uint32_t (*crc)(const uint8_t *data, size_t datalen, uint32_t crc);
+  const uint8_t *buf;
+  size_t len;
+  uint32_t res;
+} crc_bench_t;
+
+/*
+ * Byte-wise reference with a table computed bit by bit
+ */
+static void
+crc_ref_init ( void )
+{
+  uint32_t c;
+  int i, k;
+
+  for (i = 0; i < 256; i++) {
+    c = (uint32_t)i << 24;
+    for (k = 0; k < 8; k++)
+      c = (c << 1) ^ ((c & 0x80000000) ? 0x04c11db7 : 0);
+    crc_ref_tab[i] = c;
+  }
+}
+
+static uint32_t
+crc_ref ( const uint8_t *data, size_t datalen, uint32_t crc )
+{
+  while (datalen--)
+    crc = (crc << 8) ^ crc_ref_tab[((crc >> 24) ^ *data++) & 0xff];
+  return crc;
+}
+
+static void
+crc_test ( void )
+{
+  static uint8_t buf[1024 + 8];
+  uint32_t a, b;
+  size_t len, off, split;
+
+  a = tvh_crc32((const uint8_t *)"123456789", 9, 0xffffffff);
+  tvhtest_check(a == 0x0376e6e7, "check value %08x", a);
+
+  tvhtest_random(buf, sizeof(buf), 2);
+
+  /* Every length and alignment, sliced and tail paths */
+  for (len = 0; len <= 1024; len++)
+    for (off = 0; off < 8; off++) {
+      a = tvh_crc32(buf + off, len, 0xffffffff);
+      b = crc_ref(buf + off, len, 0xffffffff);
+      tvhtest_check(a == b, "len %zu off %zu: %08x != %08x", len, off, a, b);
+    }
+
+  /* Continuation over split buffers */
+  for (split = 0; split <= 64; split++) {
+    a = tvh_crc32(buf, split, 0xffffffff);
+    a = tvh_crc32(buf + split, 64 - split + 100, a);
+    b = crc_ref(buf, 164, 0xffffffff);
+    tvhtest_check(a == b, "split %zu: %08x != %08x", split, a, b);
+  }
+
+  /* A section with its CRC appended checks to zero */
+  a = tvh_crc32(buf, 183, 0xffffffff);
+  buf[183] = a >> 24;
+  buf[184] = a >> 16;
+  buf[185] = a >> 8;
+  buf[186] = a;
+  a = tvh_crc32(buf, 187, 0xffffffff);
+  tvhtest_check(a == 0, "section residue %08x", a);
+}
+
+static void
+crc_bench_cb ( void *aux )
+{
+  crc_bench_t *b = aux;
+
+  b->res ^= b->crc(b->buf, b->len, 0xffffffff);
+}
+
+static void
+crc_bench ( const uint8_t *buf, size_t len )
+{
+  crc_bench_t b = { .buf = buf, .len = len };
+  char name[64];
+
+  b.crc = crc_ref;
+  snprintf(name, sizeof(name), "byte-wise %zu", len);
+  tvhtest_bench(name, len, crc_bench_cb, &b);
+  b.crc = tvh_crc32;
+  snprintf(name, sizeof(name), "slice-by-8 %zu", len);
+  tvhtest_bench(name, len, crc_bench_cb, &b);
+}
+
+int
+main ( int argc, char **argv )
+{
+  static uint8_t buf[BENCH_SIZE];
+
+  crc_ref_init();
+  crc_test();
+
+  printf("crc32:\n");
+  tvhtest_random(buf, sizeof(buf), 3);
+  crc_bench(buf, 188);
+  crc_bench(buf, 1024);
+  crc_bench(buf, BENCH_SIZE);
+
+  return tvhtest_done();
+}
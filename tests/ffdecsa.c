@@ -0,0 +1,208 @@
+/*
+ *  FFdecsa backend tests and benchmark
+ *  Copyright (C) 2014 Tvheadend Project
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#include "tvheadend.h"
+#include "tvhtest.h"
+
+#define CLUSTER 256
+
+typedef struct csabackend {
+  const char *name;
+  void *(*get_key_struct)(void);
+  void  (*free_key_struct)(void *keys);
+  void  (*set_control_words)(void *keys, const unsigned char *even,
+                             const unsigned char *odd);
+  int   (*decrypt_packets)(void *keys, unsigned char **cluster);
+} csabackend_t;
+
+#define MAKEFUNCS(x) \
+extern void *get_key_struct_##x(void);\
+extern void free_key_struct_##x(void *keys);\
+extern void set_control_words_##x(void *keys, const unsigned char *even, const unsigned char *odd);\
+extern int decrypt_packets_##x(void *keys, unsigned char **cluster);
+
+#define BACKEND(n, x) \
+  (csabackend_t){ n, get_key_struct_##x, free_key_struct_##x,\
+                  set_control_words_##x, decrypt_packets_##x }
+
+MAKEFUNCS(32int);
+#ifdef CONFIG_MMX
+MAKEFUNCS(64mmx);
+#endif
+#ifdef CONFIG_SSE2
+MAKEFUNCS(128sse2);
+#endif
+#ifdef CONFIG_AVX2
+MAKEFUNCS(256avx2);
+#endif
+
+static csabackend_t backends[4];
+static int          nbackends;
+
+static const unsigned char cw_even[8] = { 0x11, 0x22, 0x33, 0x66,
+                                          0x44, 0x55, 0x66, 0xff };
+static const unsigned char cw_odd[8]  = { 0xa1, 0x07, 0x5c, 0x04,
+                                          0x9e, 0x31, 0x8d, 0x5c };
+
+typedef struct csa_bench {
+  csabackend_t  *b;
+  void          *keys;
+  unsigned char *buf;
+} csa_bench_t;
+
+static void
+csa_decrypt ( csabackend_t *b, void *keys, unsigned char *buf, int n )
+{
+  unsigned char *vec[3];
+
+  vec[0] = buf;
+  vec[1] = buf + n * 188;
+  vec[2] = NULL;
+  while (vec[0])
+    if (b->decrypt_packets(keys, vec) <= 0)
+      break;
+}
+
+/*
+ * Packets with a random mix of parity, clear packets and adaptation
+ * field lengths
+ */
+static void
+csa_fill ( unsigned char *buf, int n, uint32_t seed )
+{
+  unsigned char *p;
+  int i;
+
+  tvhtest_random(buf, n * 188, seed);
+  for (i = 0; i < n; i++) {
+    p = buf + i * 188;
+    p[0] = 0x47;
+    p[1] = 0x01;
+    p[2] = 0x00;
+    switch (p[3] % 8) {
+    case 0:  p[3] = 0x10; break;              /* clear */
+    case 1:  p[3] = 0xb0; break;              /* even, adaptation field */
+    case 2:  p[3] = 0xf0; break;              /* odd, adaptation field */
+    case 3:
+    case 4:  p[3] = 0x90; break;              /* even */
+    default: p[3] = 0xd0; break;              /* odd */
+    }
+    p[3] |= i & 0x0f;
+    if (p[3] & 0x20)
+      p[4] = p[4] % 184;
+  }
+}
+
+static void
+csa_test ( void )
+{
+  static unsigned char ref[CLUSTER * 188], buf[CLUSTER * 188];
+  void *keys;
+  int i, j, n, bad, off;
+
+  for (n = 1; n <= CLUSTER; n += n < 32 ? 1 : 37) {
+    csa_fill(ref, n, n);
+    keys = backends[0].get_key_struct();
+    backends[0].set_control_words(keys, cw_even, cw_odd);
+    csa_decrypt(&backends[0], keys, ref, n);
+    backends[0].free_key_struct(keys);
+
+    /* Scrambled payloads (of a block or more) must have changed */
+    csa_fill(buf, n, n);
+    for (j = 0; j < n; j++) {
+      tvhtest_check(!(ref[j * 188 + 3] & 0xc0),
+                    "%s cluster %d: packet %d still scrambled",
+                    backends[0].name, n, j);
+      off = 4 + ((buf[j * 188 + 3] & 0x20) ? buf[j * 188 + 4] + 1 : 0);
+      if ((buf[j * 188 + 3] & 0xc0) && off + 8 <= 188)
+        tvhtest_check(memcmp(ref + j * 188 + off, buf + j * 188 + off,
+                             188 - off),
+                      "%s cluster %d: packet %d not descrambled",
+                      backends[0].name, n, j);
+    }
+
+    for (i = 1; i < nbackends; i++) {
+      csa_fill(buf, n, n);
+      keys = backends[i].get_key_struct();
+      backends[i].set_control_words(keys, cw_even, cw_odd);
+      csa_decrypt(&backends[i], keys, buf, n);
+      backends[i].free_key_struct(keys);
+      for (bad = j = 0; j < n; j++)
+        bad += memcmp(ref + j * 188, buf + j * 188, 188) != 0;
+      tvhtest_check(!bad, "%s cluster %d: %d packet(s) differ",
+                    backends[i].name, n, bad);
+    }
+  }
+}
+
+static void
+csa_bench_cb ( void *aux )
+{
+  csa_bench_t *cb = aux;
+  int i;
+
+  for (i = 0; i < CLUSTER; i++)
+    cb->buf[i * 188 + 3] = 0x90;
+  csa_decrypt(cb->b, cb->keys, cb->buf, CLUSTER);
+}
+
+int
+main ( int argc, char **argv )
+{
+  static unsigned char buf[CLUSTER * 188];
+  csa_bench_t cb;
+  int i;
+
+  backends[nbackends++] = BACKEND("32bit", 32int);
+#if defined(__i386__) || defined(__x86_64__)
+  __builtin_cpu_init();
+#ifdef CONFIG_MMX
+  if (__builtin_cpu_supports("mmx"))
+    backends[nbackends++] = BACKEND("MMX 64bit", 64mmx);
+#endif
+#ifdef CONFIG_SSE2
+  if (__builtin_cpu_supports("sse2"))
+    backends[nbackends++] = BACKEND("SSE2 128bit", 128sse2);
+#endif
+#ifdef CONFIG_AVX2
+  if (__builtin_cpu_supports("avx2"))
+    backends[nbackends++] = BACKEND("AVX2 256bit", 256avx2);
+#endif
+#endif
+
+  csa_test();
+
+  printf("ffdecsa (%d packet clusters):\n", CLUSTER);
+  tvhtest_random(buf, sizeof(buf), 4);
+  for (i = 0; i < CLUSTER; i++)
+    buf[i * 188] = 0x47;
+  for (i = 0; i < nbackends; i++) {
+    cb.b    = &backends[i];
+    cb.buf  = buf;
+    cb.keys = cb.b->get_key_struct();
+    cb.b->set_control_words(cb.keys, cw_even, cw_odd);
+    tvhtest_bench(cb.b->name, sizeof(buf), csa_bench_cb, &cb);
+    cb.b->free_key_struct(cb.keys);
+  }
+
+  return tvhtest_done();
+}
@@ -0,0 +1,413 @@
+/*
+ *  HTTP request header parser tests and benchmark
+ *  Copyright (C) 2014 Tvheadend Project
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "tvheadend.h"
+#include "http.h"
+#include "tvhtest.h"
+
+/*
+ * Recorded client requests
+ */
+static const char http_req_playlist[] =
+  "GET /playlist/channels HTTP/1.1\r\n"
+  "Host: 192.168.1.10:9981\r\n"
+  "User-Agent: VLC/2.1.4 LibVLC/2.1.4\r\n"
+  "Range: bytes=0-\r\n"
+  "Connection: close\r\n"
+  "Icy-MetaData: 1\r\n"
+  "Authorization: Basic dXNlcjpwYXNz\r\n"
+  "\r\n";
+
+static const char http_req_comet[] =
+  "POST /comet/poll HTTP/1.1\r\n"
+  "Host: 192.168.1.10:9981\r\n"
+  "User-Agent: Mozilla/5.0 (X11; Ubuntu; Linux x86_64; rv:28.0) "
+    "Gecko/20100101 Firefox/28.0\r\n"
+  "Accept: */*\r\n"
+  "Accept-Language: en-US,en;q=0.5\r\n"
+  "Accept-Encoding: gzip, deflate\r\n"
+  "Content-Type: application/x-www-form-urlencoded; charset=UTF-8\r\n"
+  "X-Requested-With: XMLHttpRequest\r\n"
+  "Referer: http://192.168.1.10:9981/extjs.html\r\n"
+  "Content-Length: 46\r\n"
+  "Cookie: ys-epgChannel=s%3A; ys-epgTag=s%3A\r\n"
+  "Connection: keep-alive\r\n"
+  "Pragma: no-cache\r\n"
+  "Cache-Control: no-cache\r\n"
+  "\r\n"
+  "boxid=6b1e5d0fe0bd4f1e62aa1a5bde48b0f7d1c2e47a";
+
+typedef struct http_writer {
+  int fd;
+  const char *data;
+  size_t len;
+  size_t chunk;
+} http_writer_t;
+
+static void
+http_conn_init ( http_connection_t *hc, int fd )
+{
+  memset(hc, 0, sizeof(*hc));
+  hc->hc_fd = fd;
+  TAILQ_INIT(&hc->hc_args);
+}
+
+static const char *
+http_hdr ( http_connection_t *hc, const char *key )
+{
+  http_arg_t *ra;
+
+  TAILQ_FOREACH(ra, &hc->hc_args, link)
+    if (!strcasecmp(ra->key, key))
+      return ra->val;
+  return NULL;
+}
+
+static int
+http_hdr_count ( http_connection_t *hc )
+{
+  http_arg_t *ra;
+  int n = 0;
+
+  TAILQ_FOREACH(ra, &hc->hc_args, link)
+    n++;
+  return n;
+}
+
+/*
+ * Write the request in chunks, pausing in between so that the
+ * reader sees them as separate reads
+ */
+static void *
+http_writer ( void *aux )
+{
+  http_writer_t *w = aux;
+  size_t off = 0, n;
+
+  while (off < w->len) {
+    n = MIN(w->chunk, w->len - off);
+    if (write(w->fd, w->data + off, n) != n)
+      break;
+    off += n;
+    if (off < w->len)
+      usleep(100);
+  }
+  shutdown(w->fd, SHUT_WR);
+  return NULL;
+}
+
+/* Wait until readable and read again, like a parked connection */
+static int
+http_read_header_wait ( http_connection_t *hc )
+{
+  struct pollfd pfd = { .fd = hc->hc_fd, .events = POLLIN };
+  int r;
+
+  while ((r = http_read_header(hc)) > 0)
+    poll(&pfd, 1, -1);
+  return r;
+}
+
+/* Feed data (in chunks) through a socket, read and parse one header */
+static int
+http_feed ( http_connection_t *hc, const char *data, size_t len,
+            size_t chunk, char **cmd )
+{
+  http_writer_t w = { .data = data, .len = len, .chunk = chunk };
+  pthread_t tid;
+  int fds[2], r;
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) {
+    perror("socketpair");
+    exit(1);
+  }
+  http_conn_init(hc, fds[0]);
+  w.fd = fds[1];
+  pthread_create(&tid, NULL, http_writer, &w);
+  r = http_read_header_wait(hc);
+  if (!r)
+    r = http_parse_header(hc, cmd);
+  shutdown(fds[0], SHUT_RDWR);
+  pthread_join(tid, NULL);
+  close(fds[0]);
+  close(fds[1]);
+  return r;
+}
+
+static void
+http_check_playlist ( http_connection_t *hc, char **cmd, const char *what )
+{
+  const char *v;
+
+  tvhtest_check(!strcmp(cmd[0], "GET") &&
+                !strcmp(cmd[1], "/playlist/channels") &&
+                !strcmp(cmd[2], "HTTP/1.1"), "%s: request line", what);
+  tvhtest_check(http_hdr_count(hc) == 6, "%s: %d headers", what,
+                http_hdr_count(hc));
+  v = http_hdr(hc, "user-agent");
+  tvhtest_check(v && !strcmp(v, "VLC/2.1.4 LibVLC/2.1.4"),
+                "%s: User-Agent '%s'", what, v ?: "");
+  v = http_hdr(hc, "Authorization");
+  tvhtest_check(v && !strcmp(v, "Basic dXNlcjpwYXNz"),
+                "%s: Authorization '%s'", what, v ?: "");
+  tvhtest_check(hc->hc_rbuf_off == sizeof(http_req_playlist) - 1,
+                "%s: header end %zu", what, hc->hc_rbuf_off);
+}
+
+static void
+http_check_comet ( http_connection_t *hc, char **cmd, const char *what )
+{
+  const char *v;
+
+  tvhtest_check(!strcmp(cmd[0], "POST") &&
+                !strcmp(cmd[1], "/comet/poll"), "%s: request line", what);
+  tvhtest_check(http_hdr_count(hc) == 13, "%s: %d headers", what,
+                http_hdr_count(hc));
+  v = http_hdr(hc, "Content-Type");
+  tvhtest_check(v && !strcmp(v, "application/x-www-form-urlencoded; "
+                                "charset=UTF-8"),
+                "%s: Content-Type '%s'", what, v ?: "");
+  v = http_hdr(hc, "Connection");
+  tvhtest_check(v && !strcmp(v, "keep-alive"),
+                "%s: Connection '%s'", what, v ?: "");
+  /* The body (or its start) stays in the buffer */
+  tvhtest_check(!strncmp(hc->hc_rbuf + hc->hc_rbuf_off, "boxid=",
+                         MIN(6, hc->hc_rbuf_len - hc->hc_rbuf_off)),
+                "%s: body", what);
+}
+
+static void
+http_test_recorded ( void )
+{
+  static const size_t chunks[] = { 1, 2, 7, 64, 100000 };
+  http_connection_t hc;
+  char *cmd[3], what[64];
+  int i;
+
+  for (i = 0; i < ARRAY_SIZE(chunks); i++) {
+    snprintf(what, sizeof(what), "playlist/%zu", chunks[i]);
+    if (tvhtest_check(!http_feed(&hc, http_req_playlist,
+                                 sizeof(http_req_playlist) - 1,
+                                 chunks[i], cmd), "%s: parse", what))
+      http_check_playlist(&hc, cmd, what);
+    free(hc.hc_rbuf);
+
+    snprintf(what, sizeof(what), "comet/%zu", chunks[i]);
+    if (tvhtest_check(!http_feed(&hc, http_req_comet,
+                                 sizeof(http_req_comet) - 1,
+                                 chunks[i], cmd), "%s: parse", what))
+      http_check_comet(&hc, cmd, what);
+    free(hc.hc_rbuf);
+  }
+}
+
+/* Second request read from the buffer behind the first one */
+static void
+http_test_pipelined ( void )
+{
+  http_connection_t hc;
+  char buf[1024], *cmd[3];
+  size_t l1 = sizeof(http_req_comet) - 1, l2 = sizeof(http_req_playlist) - 1;
+
+  memcpy(buf, http_req_comet, l1);
+  memcpy(buf + l1, http_req_playlist, l2);
+  if (tvhtest_check(!http_feed(&hc, buf, l1 + l2, l1 + l2, cmd),
+                    "pipelined: first"))
+    http_check_comet(&hc, cmd, "pipelined/1");
+  /* Skip the body, like http_read_data() */
+  hc.hc_rbuf_off += 46;
+  hc.hc_fd = -1;
+  if (tvhtest_check(!http_read_header(&hc) &&
+                    !http_parse_header(&hc, cmd), "pipelined: second"))
+    http_check_playlist(&hc, cmd, "pipelined/2");
+  free(hc.hc_rbuf);
+}
+
+/* An incomplete header doesn't block, it's completed by later reads */
+static void
+http_test_partial ( void )
+{
+  http_connection_t hc;
+  char *cmd[3];
+  size_t l = sizeof(http_req_playlist) - 1, h = l / 2;
+  int fds[2];
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) {
+    perror("socketpair");
+    exit(1);
+  }
+  http_conn_init(&hc, fds[0]);
+  tvhtest_check(http_read_header(&hc) == 1, "partial: nothing sent");
+  if (write(fds[1], http_req_playlist, h) != h)
+    abort();
+  tvhtest_check(http_read_header(&hc) == 1 && hc.hc_rbuf_len == h,
+                "partial: first half");
+  if (write(fds[1], http_req_playlist + h, l - h) != l - h)
+    abort();
+  if (tvhtest_check(!http_read_header(&hc) &&
+                    !http_parse_header(&hc, cmd), "partial: second half"))
+    http_check_playlist(&hc, cmd, "partial");
+  free(hc.hc_rbuf);
+
+  /* Peer closed before the header ended */
+  http_conn_init(&hc, fds[0]);
+  if (write(fds[1], http_req_playlist, h) != h)
+    abort();
+  shutdown(fds[1], SHUT_WR);
+  tvhtest_check(http_read_header(&hc) < 0, "partial: closed");
+  free(hc.hc_rbuf);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+/* Request with nhdr headers, padded to total bytes */
+static size_t
+http_build ( char *buf, int nhdr, size_t total )
+{
+  size_t l;
+  int i;
+
+  l = sprintf(buf, "GET / HTTP/1.1\r\n");
+  for (i = 0; i < nhdr; i++)
+    l += sprintf(buf + l, "X-H%d: %d\r\n", i, i);
+  if (total) {
+    l += sprintf(buf + l, "X-Pad: ");
+    while (l < total - 4)
+      buf[l++] = 'a';
+  }
+  l += sprintf(buf + l, "\r\n\r\n");
+  return l;
+}
+
+static void
+http_test_limits ( void )
+{
+  static char buf[HTTP_HDR_MAX * 2];
+  http_connection_t hc;
+  char *cmd[3];
+  size_t l;
+  int r;
+
+  /* Header size */
+  l = http_build(buf, 1, HTTP_HDR_MAX);
+  r = http_feed(&hc, buf, l, 4096, cmd);
+  tvhtest_check(!r && hc.hc_rbuf_off == HTTP_HDR_MAX &&
+                http_hdr_count(&hc) == 2, "%d bytes header", HTTP_HDR_MAX);
+  free(hc.hc_rbuf);
+
+  l = http_build(buf, 1, HTTP_HDR_MAX + 1);
+  r = http_feed(&hc, buf, l, 4096, cmd);
+  tvhtest_check(r, "%d bytes header accepted", HTTP_HDR_MAX + 1);
+  tvhtest_check(hc.hc_rbuf_size <= HTTP_HDR_MAX, "buffer grew to %zu",
+                hc.hc_rbuf_size);
+  free(hc.hc_rbuf);
+
+  l = http_build(buf, 1, sizeof(buf) - 1);
+  r = http_feed(&hc, buf, l, 100000, cmd);
+  tvhtest_check(r, "%zu bytes header accepted", l);
+  free(hc.hc_rbuf);
+
+  /* Header lines */
+  l = http_build(buf, HTTP_HDR_ARGS, 0);
+  r = http_feed(&hc, buf, l, 100000, cmd);
+  tvhtest_check(!r && http_hdr_count(&hc) == HTTP_HDR_ARGS &&
+                !strcmp(http_hdr(&hc, "X-H63") ?: "", "63"),
+                "%d headers", HTTP_HDR_ARGS);
+  free(hc.hc_rbuf);
+
+  l = http_build(buf, HTTP_HDR_ARGS + 1, 0);
+  r = http_feed(&hc, buf, l, 100000, cmd);
+  tvhtest_check(r, "%d headers accepted", HTTP_HDR_ARGS + 1);
+  free(hc.hc_rbuf);
+
+  /* Truncated and malformed */
+  r = http_feed(&hc, http_req_playlist, sizeof(http_req_playlist) - 3,
+                100000, cmd);
+  tvhtest_check(r, "truncated header accepted");
+  free(hc.hc_rbuf);
+
+  r = http_feed(&hc, "GET /\r\n\r\n", 9, 100000, cmd);
+  tvhtest_check(r, "short request line accepted");
+  free(hc.hc_rbuf);
+
+  l = sprintf(buf, "GET / HTTP/1.0\nHost: x\n\n");
+  r = http_feed(&hc, buf, l, 1, cmd);
+  tvhtest_check(!r && !strcmp(http_hdr(&hc, "Host") ?: "", "x"),
+                "bare LF line ends");
+  free(hc.hc_rbuf);
+}
+
+/*
+ * Benchmark, parse from the buffer (no reads)
+ */
+typedef struct http_bench {
+  http_connection_t hc;
+  const char *req;
+  size_t len;
+} http_bench_t;
+
+static void
+http_bench_cb ( void *aux )
+{
+  http_bench_t *b = aux;
+  char *cmd[3];
+
+  memcpy(b->hc.hc_rbuf, b->req, b->len);
+  b->hc.hc_rbuf_len = b->len;
+  b->hc.hc_rbuf_off = 0;
+  if (http_read_header(&b->hc) || http_parse_header(&b->hc, cmd))
+    abort();
+}
+
+static void
+http_bench ( const char *name, const char *req, size_t len )
+{
+  http_bench_t b = { .req = req, .len = len };
+
+  http_conn_init(&b.hc, -1);
+  b.hc.hc_rbuf_size = HTTP_HDR_MAX;
+  b.hc.hc_rbuf = malloc(HTTP_HDR_MAX);
+  tvhtest_bench(name, len, http_bench_cb, &b);
+  free(b.hc.hc_rbuf);
+}
+
+int
+main ( int argc, char **argv )
+{
+  signal(SIGPIPE, SIG_IGN);
+
+  http_test_recorded();
+  http_test_pipelined();
+  http_test_partial();
+  http_test_limits();
+
+  printf("http:\n");
+  http_bench("playlist", http_req_playlist, sizeof(http_req_playlist) - 1);
+  http_bench("comet", http_req_comet, sizeof(http_req_comet) - 1);
+
+  return tvhtest_done();
+}
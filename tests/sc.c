@@ -0,0 +1,373 @@
+/*
+ *  Start code scanner tests and benchmark
+ *  Copyright (C) 2014 Tvheadend Project
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tvheadend.h"
+#include "service.h"
+#include "streaming.h"
+#include "packet.h"
+#include "parsers.h"
+#include "parsers/parser_sc.h"
+#include "tvhtest.h"
+
+#define BENCH_SIZE (1024 * 1024)
+
+/* MPEG audio PES for the parse_sc() tests, layer II 32 kbit/s 48 kHz */
+#define PES_COUNT   8
+#define PES_FRAMES  3
+#define PES_HDR     14
+#define PES_FSIZE   96
+#define PES_SIZE    (PES_HDR + PES_FRAMES * PES_FSIZE)
+
+typedef struct sc_impl {
+  const char *name;
+  int (*find)(const uint8_t *p, int len);
+} sc_impl_t;
+
+static sc_impl_t sc_impls[4];
+static int       sc_nimpls;
+
+typedef struct sc_bench {
+  int (*find)(const uint8_t *p, int len);
+  const uint8_t *buf;
+} sc_bench_t;
+
+static int
+sc_ref ( const uint8_t *p, int len )
+{
+  int i;
+
+  for (i = 0; i + 2 < len; i++)
+    if (!p[i] && !p[i+1] && p[i+2] == 1)
+      return i;
+  return -1;
+}
+
+/*
+ * Bytes from a small alphabet so that prefixes are frequent
+ */
+static void
+sc_fill ( uint8_t *p, int len, uint32_t *seed )
+{
+  static const uint8_t alpha[] = { 0, 0, 0, 1, 1, 0xb3 };
+
+  while (len--) {
+    *seed = *seed * 1103515245 + 12345;
+    *p++ = alpha[(*seed >> 16) % sizeof(alpha)];
+  }
+}
+
+static void
+sc_check ( const uint8_t *p, int len, const char *what )
+{
+  int i, r, e = sc_ref(p, len);
+
+  for (i = 0; i < sc_nimpls; i++) {
+    r = sc_impls[i].find(p, len);
+    tvhtest_check(r == e, "%s %s len %d: %d != %d",
+                  sc_impls[i].name, what, len, r, e);
+  }
+}
+
+static void
+sc_test ( void )
+{
+  uint8_t *p;
+  uint32_t seed = 1;
+  int len, pos, n;
+
+  /* A single prefix at every position, data ends at a page boundary */
+  for (len = 0; len <= 300; len++) {
+    p = tvhtest_guarded_alloc(len);
+    memset(p, 0xff, len);
+    sc_check(p, len, "none");
+    for (pos = 0; pos + 3 <= len; pos++) {
+      memset(p, 0xff, len);
+      p[pos] = p[pos+1] = 0;
+      p[pos+2] = 1;
+      sc_check(p, len, "single");
+    }
+    /* Truncated prefix at the end */
+    if (len >= 2) {
+      memset(p, 0xff, len);
+      p[len-2] = p[len-1] = 0;
+      sc_check(p, len, "truncated");
+    }
+    tvhtest_guarded_free(p, len);
+  }
+
+  /* Dense random data */
+  for (n = 0; n < 20000; n++) {
+    len = (seed >> 8) % 1024;
+    p = tvhtest_guarded_alloc(len);
+    sc_fill(p, len, &seed);
+    sc_check(p, len, "random");
+    tvhtest_guarded_free(p, len);
+  }
+}
+
+/*
+ * The parts of the streaming core used by the parsers, delivered audio
+ * frames are collected in sc_out
+ */
+static uint8_t sc_out[PES_COUNT * PES_SIZE];
+static int     sc_out_len, sc_out_pkts;
+
+th_pkt_t *
+pkt_alloc ( const void *data, size_t datalen, int64_t pts, int64_t dts )
+{
+  th_pkt_t *pkt = calloc(1, sizeof(*pkt));
+
+  if (sc_out_len + datalen <= sizeof(sc_out))
+    memcpy(sc_out + sc_out_len, data, datalen);
+  sc_out_len += datalen;
+  sc_out_pkts++;
+  pkt->pkt_pts = pts;
+  pkt->pkt_dts = dts;
+  pkt->pkt_refcount = 1;
+  return pkt;
+}
+
+void
+pkt_ref_dec ( th_pkt_t *pkt )
+{
+  free(pkt);
+}
+
+pktbuf_t *
+pktbuf_make ( void *data, size_t size )
+{
+  abort(); /* video only */
+}
+
+void
+limitedlog ( loglimiter_t *ll, const char *sys, const char *o,
+             const char *event )
+{
+  tvhtest_check(0, "%s: %s", sys, event);
+}
+
+const char *
+service_component_nicename ( elementary_stream_t *st )
+{
+  return "test";
+}
+
+void
+service_request_save ( service_t *t, int restart )
+{
+}
+
+void
+service_set_streaming_status_flags ( service_t *t, int flag )
+{
+}
+
+streaming_message_t *
+streaming_msg_create_pkt ( th_pkt_t *pkt )
+{
+  return NULL;
+}
+
+void
+streaming_msg_free ( streaming_message_t *sm )
+{
+}
+
+void
+streaming_pad_deliver ( streaming_pad_t *sp, streaming_message_t *sm )
+{
+}
+
+/*
+ * PES packets of PES_FRAMES audio frames, the frame data is full of
+ * (non audio) start codes and partial prefixes
+ */
+static void
+pes_build ( uint8_t *p, uint32_t *seed )
+{
+  int i, j;
+  int64_t pts;
+
+  for (i = 0; i < PES_COUNT; i++, p += PES_SIZE) {
+    pts = 90000 + i * PES_FRAMES * 2160;
+    p[0]  = 0;
+    p[1]  = 0;
+    p[2]  = 1;
+    p[3]  = 0xc0;
+    p[4]  = (PES_SIZE - 6) >> 8;
+    p[5]  = (PES_SIZE - 6) & 0xff;
+    p[6]  = 0x80;
+    p[7]  = 0x80;  /* PTS only */
+    p[8]  = 5;
+    p[9]  = 0x21 | ((pts >> 29) & 0x0e);
+    p[10] = pts >> 22;
+    p[11] = (pts >> 14) | 1;
+    p[12] = pts >> 7;
+    p[13] = (pts << 1) | 1;
+    for (j = 0; j < PES_FRAMES; j++) {
+      uint8_t *f = p + PES_HDR + j * PES_FSIZE;
+      f[0] = 0xff;
+      f[1] = 0xfd;
+      f[2] = 0x14;
+      f[3] = 0x00;
+      sc_fill(f + 4, PES_FSIZE - 4, seed);
+    }
+  }
+}
+
+/*
+ * Feed the PES to parse_mpeg_ts(), first bytes in one call and the rest
+ * step bytes at a time, each call in its own guarded buffer
+ */
+static void
+pes_parse ( const uint8_t *pes, int len, int first, int step )
+{
+  service_t *t = calloc(1, sizeof(*t));
+  elementary_stream_t *st = calloc(1, sizeof(*st));
+  uint8_t *p;
+  int off, n;
+
+  st->es_type      = SCT_MPEG2AUDIO;
+  st->es_startcond = 0xffffffff;
+  st->es_curdts    = PTS_UNSET;
+  st->es_curpts    = PTS_UNSET;
+  st->es_nextdts   = PTS_UNSET;
+  sc_out_len = sc_out_pkts = 0;
+
+  for (off = 0; off < len; off += n) {
+    n = MIN(off ? step : first, len - off);
+    p = tvhtest_guarded_alloc(n);
+    memcpy(p, pes + off, n);
+    parse_mpeg_ts(t, st, p, n, 0, 0);
+    tvhtest_guarded_free(p, n);
+  }
+
+  free(st->es_buf.sb_data);
+  free(st->es_buf_a.sb_data);
+  free(st);
+  free(t);
+}
+
+static void
+pes_check ( const uint8_t *exp, int exp_len, const char *impl,
+            const char *what, int first, int step )
+{
+  tvhtest_check(sc_out_len == exp_len &&
+                sc_out_pkts == exp_len / PES_FSIZE &&
+                !memcmp(sc_out, exp, exp_len),
+                "%s parse_sc %s %d/%d: %d bytes in %d packets",
+                impl, what, first, step, sc_out_len, sc_out_pkts);
+}
+
+static void
+pes_test ( void )
+{
+  static uint8_t pes[PES_COUNT * PES_SIZE], exp[sizeof(pes)];
+  uint32_t seed = 2;
+  int i, j, s, exp_len = 0;
+
+  pes_build(pes, &seed);
+
+  /* A PES is passed on when the next one starts, the last frame of
+     each when the following one is seen */
+  for (i = 0; i < PES_COUNT - 1; i++)
+    for (j = 0; j < PES_FRAMES; j++, exp_len += PES_FSIZE)
+      memcpy(exp + exp_len, pes + i * PES_SIZE + PES_HDR + j * PES_FSIZE,
+             PES_FSIZE);
+  exp_len -= PES_FSIZE;
+
+  for (i = 0; i < sc_nimpls; i++) {
+    parser_sc_find = sc_impls[i].find;
+    /* Split at every position, start codes across the boundary */
+    for (s = 1; s <= sizeof(pes); s++) {
+      pes_parse(pes, sizeof(pes), s, sizeof(pes));
+      pes_check(exp, exp_len, sc_impls[i].name, "split", s, sizeof(pes));
+    }
+    for (s = 1; s <= 67; s++) {
+      pes_parse(pes, sizeof(pes), s, s);
+      pes_check(exp, exp_len, sc_impls[i].name, "chunks", s, s);
+    }
+  }
+  parser_sc_find = parser_sc_find_c;
+}
+
+static void
+sc_bench_cb ( void *aux )
+{
+  sc_bench_t *b = aux;
+  int off = 0, r;
+
+  while ((r = b->find(b->buf + off, BENCH_SIZE - off)) >= 0)
+    off += r + 3;
+}
+
+static void
+sc_bench ( const char *what, const uint8_t *buf )
+{
+  sc_bench_t b;
+  char name[64];
+  int i;
+
+  b.buf = buf;
+  for (i = 0; i < sc_nimpls; i++) {
+    b.find = sc_impls[i].find;
+    snprintf(name, sizeof(name), "%s %s", sc_impls[i].name, what);
+    tvhtest_bench(name, BENCH_SIZE, sc_bench_cb, &b);
+  }
+}
+
+int
+main ( int argc, char **argv )
+{
+  static uint8_t buf[BENCH_SIZE];
+  int i;
+
+  sc_impls[sc_nimpls++] = (sc_impl_t){ "generic", parser_sc_find_c };
+#if defined(__i386__) || defined(__x86_64__)
+  __builtin_cpu_init();
+#if ENABLE_SSE2
+  if (__builtin_cpu_supports("sse2"))
+    sc_impls[sc_nimpls++] = (sc_impl_t){ "sse2", parser_sc_find_sse2 };
+#endif
+#if ENABLE_AVX2
+  if (__builtin_cpu_supports("avx2"))
+    sc_impls[sc_nimpls++] = (sc_impl_t){ "avx2", parser_sc_find_avx2 };
+#endif
+#endif
+
+  sc_test();
+  pes_test();
+
+  printf("start code scanner:\n");
+  tvhtest_random(buf, sizeof(buf), 1);
+  sc_bench("sparse", buf);
+  for (i = 0; i < sizeof(buf); i++)
+    buf[i] = (i % 3) == 2 ? 1 : 0xb3;
+  sc_bench("dense 01", buf);
+  for (i = 0; i < sizeof(buf); i += 188) {
+    buf[i] = buf[i+1] = 0;
+    buf[i+2] = 1;
+  }
+  sc_bench("prefix/188", buf);
+
+  return tvhtest_done();
+}
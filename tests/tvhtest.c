@@ -0,0 +1,120 @@
+/*
+ *  Standalone tests and benchmarks
+ *  Copyright (C) 2014 Tvheadend Project
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "tvheadend.h"
+#include "tvhtest.h"
+
+#define TVHTEST_BENCH_TIME 200000 /* us */
+
+int tvhtest_failed;
+
+/*
+ * Logging goes to stderr, the units under test may log
+ */
+void
+_tvhlog ( const char *file, int line, int notify, int severity,
+          const char *subsys, const char *fmt, ... )
+{
+  va_list args;
+
+  va_start(args, fmt);
+  fprintf(stderr, "%s: ", subsys);
+  vfprintf(stderr, fmt, args);
+  fputc('\n', stderr);
+  va_end(args);
+}
+
+int
+tvhtest_check0
+  ( int ok, const char *file, int line, const char *fmt, ... )
+{
+  va_list args;
+
+  if (ok)
+    return 1;
+  va_start(args, fmt);
+  fprintf(stderr, "%s:%d: FAILED: ", file, line);
+  vfprintf(stderr, fmt, args);
+  fputc('\n', stderr);
+  va_end(args);
+  tvhtest_failed++;
+  return 0;
+}
+
+void
+tvhtest_bench
+  ( const char *name, size_t bytes, void (*cb)(void *aux), void *aux )
+{
+  int64_t start, t;
+  uint64_t n = 0;
+
+  cb(aux);
+  start = getmonoclock();
+  do {
+    cb(aux);
+    n++;
+  } while ((t = getmonoclock() - start) < TVHTEST_BENCH_TIME);
+  printf("  %-32s %9.1f MB/s\n", name, (double)n * bytes / t);
+}
+
+void
+tvhtest_random ( uint8_t *buf, size_t len, uint32_t seed )
+{
+  while (len--) {
+    seed = seed * 1103515245 + 12345;
+    *buf++ = seed >> 16;
+  }
+}
+
+uint8_t *
+tvhtest_guarded_alloc ( size_t len )
+{
+  size_t pg = sysconf(_SC_PAGESIZE), sz = (len + pg - 1) / pg * pg;
+  uint8_t *p;
+
+  p = mmap(NULL, sz + pg, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED)
+    abort();
+  mprotect(p + sz, pg, PROT_NONE);
+  return p + sz - len;
+}
+
+void
+tvhtest_guarded_free ( uint8_t *p, size_t len )
+{
+  size_t pg = sysconf(_SC_PAGESIZE), sz = (len + pg - 1) / pg * pg;
+
+  munmap(p + len - sz, sz + pg);
+}
+
+int
+tvhtest_done ( void )
+{
+  if (tvhtest_failed) {
+    fprintf(stderr, "%d check(s) failed\n", tvhtest_failed);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,53 @@
+/*
+ *  Standalone tests and benchmarks
+ *  Copyright (C) 2014 Tvheadend Project
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TVHTEST_H_
+#define TVHTEST_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Each test is a small program built by "make check" against the objects
+ * of the units it covers. Checks report and count failures, the exit code
+ * of the program is the result. Benchmarks print the throughput.
+ */
+
+extern int tvhtest_failed;
+
+#define tvhtest_check(cond, fmt, ...) \
+  tvhtest_check0(!!(cond), __FILE__, __LINE__, fmt, ##__VA_ARGS__)
+
+int  tvhtest_check0 ( int ok, const char *file, int line,
+                      const char *fmt, ... )
+  __attribute__((format(printf,4,5)));
+
+/* Run cb(aux) repeatedly for a while, print the rate (bytes per call) */
+void tvhtest_bench  ( const char *name, size_t bytes,
+                      void (*cb)(void *aux), void *aux );
+
+/* Repeatable pseudo random data */
+void tvhtest_random ( uint8_t *buf, size_t len, uint32_t seed );
+
+/* Buffer of len bytes ending right before an unmapped page */
+uint8_t *tvhtest_guarded_alloc ( size_t len );
+void     tvhtest_guarded_free  ( uint8_t *p, size_t len );
+
+int  tvhtest_done   ( void );
+
+#endif /* TVHTEST_H_ */